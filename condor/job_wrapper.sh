@@ -12,22 +12,53 @@ SEED=$2
 OUTFILE=$3
 MODE=${4:-prompt} # prompt/nonprompt/d0
 ANALYSIS=${5:-none}
+FIRST_EVENT=${6:-0}
 
 echo "Starting job on $(hostname)"
 echo "Events: $EVENTS"
 echo "Seed: $SEED"
 echo "Mode: $MODE"
 echo "Analysis: $ANALYSIS"
+echo "First event: $FIRST_EVENT"
 
-# Define executables
+# Define executables; the J/psi generators format their HepMC3 output
+# directly from the pooled event (no GenEvent objects per event)
+HEPMC_ARGS=""
 if [ "$MODE" == "prompt" ]; then
     GEN_EXEC="./build/gen_prompt_jpsi"
+    HEPMC_ARGS="--pooled-hepmc"
 elif [ "$MODE" == "nonprompt" ]; then
     GEN_EXEC="./build/gen_bpkjpsi"
+    HEPMC_ARGS="--pooled-hepmc"
 else
     GEN_EXEC="./build/gen_d0_study"
 fi
 
+# Counter-based seeding: all jobs share the campaign seed and cover global
+# events FIRST_EVENT ... FIRST_EVENT + EVENTS - 1. gen_bpkjpsi counts signal
+# events rather than tried ones, so it gets the job index instead, which
+# selects its own range of event indices under the same seed.
+if [ "$MODE" == "nonprompt" ]; then
+    SEED_ARGS="--seed $SEED --job $((FIRST_EVENT / EVENTS))"
+else
+    SEED_ARGS="--seed $SEED --first-event $FIRST_EVENT"
+fi
+
+# Partial results for scripts/aggregate_results.py: with SNAPSHOT_DIR (a
+# shared directory, set by submit_condor.py --snapshot-dir) the job keeps a
+# snapshot there while it runs. rivet rewrites its output periodically by
+# itself; gen_d0_study writes its per-bin sums.
+SNAPSHOT_ARGS=""
+RIVET_OUT="$OUTFILE"
+if [ -n "$SNAPSHOT_DIR" ]; then
+    JOB_TAG="${MODE}_${SEED}_${FIRST_EVENT}"
+    if [ "$ANALYSIS" != "none" ]; then
+        RIVET_OUT="$SNAPSHOT_DIR/$JOB_TAG.yoda"
+    elif [ "$MODE" == "d0" ]; then
+        SNAPSHOT_ARGS="--snapshot $SNAPSHOT_DIR/$JOB_TAG.acc --snapshot-every ${SNAPSHOT_EVERY:-1000}"
+    fi
+fi
+
 if [ "$ANALYSIS" != "none" ]; then
     echo "Running with Rivet Pipeline..."
     FIFO="events.fifo"
@@ -35,16 +66,23 @@ if [ "$ANALYSIS" != "none" ]; then
     
     # Run Rivet in background
     # Note: Using the built-in rivet-service runner if available
-    rivet-service "rivet/${ANALYSIS}.cc" "$ANALYSIS" "$FIFO" "$OUTFILE" &
+    rivet-service "rivet/${ANALYSIS}.cc" "$ANALYSIS" "$FIFO" "$RIVET_OUT" &
     RIVET_PID=$!
     
     # Run Generator in foreground
-    $GEN_EXEC $EVENTS $FIFO
+    $GEN_EXEC $EVENTS $FIFO $SEED_ARGS $HEPMC_ARGS
     
     wait $RIVET_PID
+    if [ "$RIVET_OUT" != "$OUTFILE" ]; then
+        cp "$RIVET_OUT" "$OUTFILE"
+    fi
 else
     echo "Running Standard Generation..."
-    $GEN_EXEC $EVENTS $SEED $OUTFILE
+    if [ "$MODE" == "d0" ]; then
+        $GEN_EXEC $EVENTS $SEED $OUTFILE --first-event $FIRST_EVENT $SNAPSHOT_ARGS
+    else
+        $GEN_EXEC $EVENTS $OUTFILE $SEED_ARGS $HEPMC_ARGS
+    fi
 fi
 
 echo "Job finished with exit code $?"
@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+"""Pilot runs that size HTCondor jobs from measured generator costs.
+
+    python3 condor/pilot.py --modes prompt,nonprompt,d0 --target-hours 4
+    python3 condor/pilot.py --modes prompt --rivet JpsiJet_RivetAnalyzer
+    python3 condor/submit_condor.py --mode d0 --total-events 20000 \\
+        --plan condor/plan.json
+
+Each generator is run with the same command line as condor/job_wrapper.sh,
+first with 0 events (init time), then with increasing event counts until
+--budget seconds are used. The largest run gives, per job event (tried
+events for prompt and d0, signal events for nonprompt):
+
+  init_s            initialization time
+  s_per_event       wall time per event, excluding init
+  efficiency        signal (nonprompt) or filter (prompt) efficiency,
+                    parsed from the generator summary
+  bytes_per_event   output written per event (the job's output file, or
+                    the YODA file with --rivet)
+  peak_rss_mb       peak RSS of the generator plus the Rivet consumer
+  cpu_per_wall      CPU seconds per wall second of the job's processes
+
+From these, the plan gives the events per job that fit --target-hours, and
+the request_cpus, request_memory and request_disk of such a job. The
+statistical error of the measured rate (1/sqrt(events or signal events)) is
+added to the time per event before applying --safety. The plan is written
+as JSON, one entry per mode; re-running for another mode updates the file.
+
+Run it where the jobs run (the gen image on a worker-like node), since the
+rates depend on the CPU:
+
+    docker run --rm -v $(pwd):/work -w /work \\
+        ghcr.io/vince502/hepgeneratorframework:main \\
+        python3 condor/pilot.py --modes nonprompt --budget 300
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import re
+import shlex
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+GENERATORS = {
+    # mode: (executable, events of the first calibration run)
+    "prompt": ("gen_prompt_jpsi", 200),
+    "nonprompt": ("gen_bpkjpsi", 5),
+    "d0": ("gen_d0_study", 2),
+}
+DEFAULT_RIVET_CMD = "rivet -q -a {analysis} {fifo} -o {yoda}"
+# Shipped with every job (transfer_input_files in production.sub)
+INPUT_DIRS = ("build", "decays", "lhapdf_data")
+EFFICIENCY_PATTERNS = {
+    "nonprompt": (r"Signal events \(.*\): (\d+)", r"Total events tried: (\d+)"),
+    "prompt": (r"Filter accepted: (\d+) /", r"Filter accepted: \d+ / (\d+)"),
+}
+
+
+def job_command(exe, mode, n_events, seed, path):
+    """Generator command line as in condor/job_wrapper.sh."""
+    if mode == "d0":
+        return [exe, str(n_events), str(seed), path, "--first-event", "0"]
+    cmd = [exe, str(n_events), path, "--seed", str(seed)]
+    return cmd if mode == "nonprompt" else cmd + ["--first-event", "0"]
+
+
+def run_job(args, mode, n_events, workdir):
+    """Run one job-like process (and its Rivet consumer). Returns wall time,
+    exit code, peak RSS and CPU time summed over the processes, output size
+    and the generator's stdout."""
+    exe = os.path.join(args.build_dir, GENERATORS[mode][0])
+    base = os.path.join(workdir, f"pilot_{mode}")
+    log_path = base + ".log"
+    yoda = base + ".yoda"
+    path = base + ".txt"
+    procs = []
+    start = time.perf_counter()
+    with open(log_path, "w") as log:
+        if args.rivet_consumer:
+            path = base + ".fifo"
+            os.mkfifo(path)
+            consumer = shlex.split(args.rivet_cmd.format(
+                analysis=args.rivet, fifo=path, yoda=yoda))
+            procs.append(subprocess.Popen(consumer, stdout=subprocess.DEVNULL,
+                                          stderr=subprocess.STDOUT))
+        cmd = job_command(exe, mode, n_events, args.seed, path)
+        procs.append(subprocess.Popen(cmd + shlex.split(args.gen_args),
+                                      stdout=log, stderr=subprocess.STDOUT))
+        pending = {p.pid for p in procs}
+        code, rss, cpu = 0, 0.0, 0.0
+        while pending:
+            pid, status, usage = os.wait4(-1, 0)
+            if pid in pending:
+                pending.discard(pid)
+                code = code or os.waitstatus_to_exitcode(status)
+                rss += usage.ru_maxrss / 1024.
+                cpu += usage.ru_utime + usage.ru_stime
+        wall = time.perf_counter() - start
+    output = yoda if args.rivet_consumer else path
+    size = os.path.getsize(output) if os.path.isfile(output) else 0
+    with open(log_path) as f:
+        text = f.read()
+    for name in os.listdir(workdir):
+        os.remove(os.path.join(workdir, name))
+    return {"events": n_events, "wall": wall, "exit": code, "rss_mb": rss,
+            "cpu": cpu, "bytes": size, "log": text}
+
+
+def efficiency(mode, log):
+    """(passed, tried) from the generator summary, or None."""
+    patterns = EFFICIENCY_PATTERNS.get(mode)
+    if not patterns:
+        return None
+    found = [re.search(p, log) for p in patterns]
+    if not all(found):
+        return None
+    return int(found[0].group(1)), int(found[1].group(1))
+
+
+def measure(args, mode, workdir):
+    """Init run, then calibration runs growing by up to 8x while the budget
+    allows. Returns the measured costs, or an error string."""
+    init = run_job(args, mode, 0, workdir)
+    if init["exit"] != 0:
+        return f"init run failed:\n{init['log'][-2000:]}"
+    spent = init["wall"]
+    n, last = GENERATORS[mode][1], None
+    while True:
+        run = run_job(args, mode, n, workdir)
+        if run["exit"] != 0:
+            return f"{n}-event run failed:\n{run['log'][-2000:]}"
+        spent += run["wall"]
+        last = run
+        per_event = max(run["wall"] - init["wall"], 1e-3) / n
+        print(f"  {mode}: {n} events in {run['wall']:.1f} s "
+              f"({per_event:.3g} s/event)")
+        # spent already includes the init run
+        remaining = args.budget - spent
+        n_next = min(8 * n, int(0.9 * remaining / per_event))
+        if n_next < 2 * n:
+            break
+        n = n_next
+
+    n = last["events"]
+    result = {
+        "init_s": init["wall"],
+        "events_measured": n,
+        "s_per_event": max(last["wall"] - init["wall"], 1e-3) / n,
+        "bytes_per_event": last["bytes"] / n,
+        "output_bytes_fixed": init["bytes"],
+        "peak_rss_mb": max(init["rss_mb"], last["rss_mb"]),
+        "cpu_per_wall": last["cpu"] / last["wall"],
+        "pilot_wall_s": spent,
+    }
+    eff = efficiency(mode, last["log"])
+    if eff and eff[1] > 0:
+        passed, tried = eff
+        p = passed / tried
+        result["efficiency"] = p
+        result["efficiency_err"] = math.sqrt(max(p * (1 - p), 1e-12) / tried)
+    return result
+
+
+def round_down(x, digits=2):
+    """Round down to `digits` significant figures (at least 1)."""
+    if x < 1:
+        return 1
+    scale = 10 ** max(int(math.log10(x)) + 1 - digits, 0)
+    return int(x // scale * scale)
+
+
+def round_up(x, step):
+    return int(math.ceil(x / step) * step)
+
+
+def make_plan(args, m, input_mb):
+    """Events per job and resource requests for one mode."""
+    # One standard deviation of the counting fluctuation, then the margin
+    per_event = m["s_per_event"] * (1 + 1 / math.sqrt(m["events_measured"]))
+    per_event *= args.safety
+    target = args.target_hours * 3600
+    events = round_down(max(target - m["init_s"], 0) / per_event)
+    output_mb = (m["output_bytes_fixed"]
+                 + events * m["bytes_per_event"]) / 1e6
+    memory = (m["peak_rss_mb"] + args.rivet_memory_mb) * (1 + args.margin)
+    disk = input_mb + output_mb * (1 + args.margin) + args.scratch_mb
+    return {
+        "events_per_job": events,
+        "expected_wall_s": round(m["init_s"] + events * m["s_per_event"]),
+        "request_cpus": max(1, round(m["cpu_per_wall"])),
+        "request_memory_mb": round_up(memory, 128),
+        "request_disk_mb": round_up(disk, 256),
+        "output_mb": round(output_mb, 1),
+    }
+
+
+def input_size_mb():
+    """Size of the job inputs transferred to the worker."""
+    total = 0
+    for top in INPUT_DIRS:
+        for root, _, files in os.walk(top):
+            for name in files:
+                try:
+                    total += os.path.getsize(os.path.join(root, name))
+                except OSError:
+                    pass
+    return total / 1e6
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--modes", default="prompt,nonprompt,d0",
+                        help="generators to run (prompt, nonprompt, d0)")
+    parser.add_argument("--target-hours", type=float, default=4.0,
+                        help="wall time per job to aim for")
+    parser.add_argument("--budget", type=float, default=120.0,
+                        help="pilot wall time per mode [s]")
+    parser.add_argument("--safety", type=float, default=1.15,
+                        help="factor on the time per event (worker nodes "
+                             "slower than the pilot machine)")
+    parser.add_argument("--margin", type=float, default=0.25,
+                        help="relative margin on memory and disk")
+    parser.add_argument("--seed", type=int, default=1000)
+    parser.add_argument("--rivet", default="none",
+                        help="analysis the jobs will run (as in "
+                             "submit_condor.py --rivet)")
+    parser.add_argument("--rivet-cmd", default=DEFAULT_RIVET_CMD,
+                        help="consumer for --rivet; {analysis}, {fifo} and "
+                             "{yoda} are substituted")
+    parser.add_argument("--rivet-memory-mb", type=float, default=None,
+                        help="memory to add for Rivet if the consumer is "
+                             "not run by the pilot (default 1024)")
+    parser.add_argument("--scratch-mb", type=float, default=500.0,
+                        help="disk for logs and temporary files")
+    parser.add_argument("--gen-args", default="",
+                        help="extra generator options the jobs will use")
+    parser.add_argument("--build-dir", default="build",
+                        help="directory with the generator executables")
+    parser.add_argument("-o", "--output", default="condor/plan.json",
+                        help="plan file (updated if it exists)")
+    args = parser.parse_args()
+
+    modes = [m for m in args.modes.split(",") if m]
+    for m in modes:
+        if m not in GENERATORS:
+            print(f"Unknown mode: {m}")
+            return 1
+
+    # Rivet: run the consumer if available, otherwise add a fixed allowance
+    args.rivet_consumer = False
+    if args.rivet != "none":
+        if shutil.which(shlex.split(args.rivet_cmd)[0]):
+            args.rivet_consumer = True
+        else:
+            print(f"'{shlex.split(args.rivet_cmd)[0]}' not found: measuring "
+                  "the generator only and adding --rivet-memory-mb")
+    if args.rivet_memory_mb is None:
+        args.rivet_memory_mb = 1024. if (args.rivet != "none"
+                                         and not args.rivet_consumer) else 0.
+
+    plan = {}
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            plan = json.load(f)
+    plan.setdefault("modes", {})
+    plan["meta"] = {"host": socket.gethostname(),
+                    "platform": platform.platform(),
+                    "date": datetime.datetime.now().isoformat(
+                        timespec="seconds")}
+    input_mb = input_size_mb()
+
+    workdir = tempfile.mkdtemp(prefix="hepgen-pilot-")
+    n_bad = 0
+    for mode in modes:
+        exe = os.path.join(args.build_dir, GENERATORS[mode][0])
+        if not os.access(exe, os.X_OK):
+            print(f"Missing executable {exe}, skipping {mode}")
+            n_bad += 1
+            continue
+        print(f"{mode}: pilot for up to {args.budget:.0f} s")
+        measured = measure(args, mode, workdir)
+        if isinstance(measured, str):
+            print(f"{mode}: {measured}")
+            n_bad += 1
+            continue
+        entry = make_plan(args, measured, input_mb)
+        plan["modes"][mode] = {
+            "config": {"target_hours": args.target_hours,
+                       "safety": args.safety, "margin": args.margin,
+                       "rivet": args.rivet, "rivet_measured":
+                       args.rivet_consumer, "gen_args": args.gen_args,
+                       "input_mb": round(input_mb, 1)},
+            "measured": measured,
+            "plan": entry,
+        }
+        eff = (f", efficiency {100 * measured['efficiency']:.3g} "
+               f"+- {100 * measured['efficiency_err']:.2g} %"
+               if "efficiency" in measured else "")
+        print(f"{mode}: init {measured['init_s']:.1f} s, "
+              f"{measured['s_per_event']:.3g} s/event{eff}, "
+              f"{measured['bytes_per_event'] / 1e3:.3g} kB/event, "
+              f"peak RSS {measured['peak_rss_mb']:.0f} MB")
+        print(f"{mode}: {entry['events_per_job']} events/job "
+              f"(~{entry['expected_wall_s'] / 3600:.2f} h), "
+              f"request_cpus {entry['request_cpus']}, "
+              f"request_memory {entry['request_memory_mb']} MB, "
+              f"request_disk {entry['request_disk_mb']} MB")
+    shutil.rmtree(workdir, ignore_errors=True)
+
+    os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+    with open(args.output, "w") as f:
+        json.dump(plan, f, indent=2)
+    print(f"Plan written to {args.output}")
+    return 1 if n_bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
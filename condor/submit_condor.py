@@ -1,17 +1,64 @@
 #!/usr/bin/env python3
 import os
+import json
 import subprocess
 import argparse
+import sys
 
 def main():
     parser = argparse.ArgumentParser(description='Submit HEP jobs to HTCondor')
     parser.add_argument('--total-events', type=int, default=1000000, help='Total events to generate')
-    parser.add_argument('--events-per-job', type=int, default=100000, help='Events per job')
+    parser.add_argument('--events-per-job', type=int, default=None, help='Events per job (default: from --plan, else 100000)')
     parser.add_argument('--mode', type=str, default='prompt', choices=['prompt', 'nonprompt', 'd0'], help='Generation mode')
     parser.add_argument('--rivet', type=str, default='none', help='Rivet analysis name (e.g. JpsiJet_RivetAnalyzer)')
     parser.add_argument('--output-prefix', type=str, default='output_jpsijet', help='Prefix for output files')
+    parser.add_argument('--seed', type=int, default=1000, help='Campaign seed; job i generates global events i*events-per-job onward')
+    parser.add_argument('--plan', type=str, default=None, help='Submission plan from condor/pilot.py: events per job and resource requests for --mode')
+    parser.add_argument('--pilot', action='store_true', help='Run condor/pilot.py for --mode first and use its plan')
+    parser.add_argument('--target-hours', type=float, default=4.0, help='Job wall time the pilot sizes jobs for')
+    parser.add_argument('--cpus', type=int, default=None, help='request_cpus (overrides the plan)')
+    parser.add_argument('--memory', type=int, default=None, help='request_memory in MB (overrides the plan)')
+    parser.add_argument('--disk', type=int, default=None, help='request_disk in MB (overrides the plan)')
+    parser.add_argument('--snapshot-dir', type=str, default=None, help='Shared directory where running jobs drop partial results for scripts/aggregate_results.py')
     args = parser.parse_args()
 
+    # Pilot run: measure this mode and write the plan used below
+    if args.pilot:
+        args.plan = args.plan or 'condor/plan.json'
+        pilot = [sys.executable, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'pilot.py'),
+                 '--modes', args.mode, '--target-hours', str(args.target_hours),
+                 '--rivet', args.rivet, '--seed', str(args.seed), '-o', args.plan]
+        if subprocess.run(pilot).returncode != 0:
+            print("Pilot failed, not submitting")
+            return 1
+
+    # Requests: command line, then the plan, then production.sub defaults
+    requests = {}
+    if args.plan:
+        with open(args.plan) as f:
+            entry = json.load(f).get('modes', {}).get(args.mode)
+        if entry is None:
+            print(f"No plan for mode '{args.mode}' in {args.plan}; run condor/pilot.py --modes {args.mode}")
+            return 1
+        if entry['config']['rivet'] != args.rivet:
+            print(f"Warning: plan measured with --rivet {entry['config']['rivet']}, submitting with {args.rivet}")
+        plan = entry['plan']
+        if args.events_per_job is None:
+            args.events_per_job = plan['events_per_job']
+        requests = {'request_cpus': plan['request_cpus'],
+                    'request_memory': f"{plan['request_memory_mb']}MB",
+                    'request_disk': f"{plan['request_disk_mb']}MB"}
+        print(f"Plan {args.plan}: {plan['events_per_job']} events/job, "
+              f"~{plan['expected_wall_s'] / 3600:.2f} h per job")
+    if args.events_per_job is None:
+        args.events_per_job = 100000
+    if args.cpus is not None:
+        requests['request_cpus'] = args.cpus
+    if args.memory is not None:
+        requests['request_memory'] = f"{args.memory}MB"
+    if args.disk is not None:
+        requests['request_disk'] = f"{args.disk}MB"
+
     # Create logs directory
     if not os.path.exists('condor/logs'):
         os.makedirs('condor/logs')
@@ -20,6 +67,11 @@ def main():
     if not os.path.exists('condor/output'):
         os.makedirs('condor/output')
 
+    # Snapshot directory: must be on a filesystem the workers also mount
+    if args.snapshot_dir:
+        args.snapshot_dir = os.path.abspath(args.snapshot_dir)
+        os.makedirs(args.snapshot_dir, exist_ok=True)
+
     num_jobs = (args.total_events + args.events_per_job - 1) // args.events_per_job
     
     print(f"Generating {args.total_events} events across {num_jobs} jobs...")
@@ -27,12 +79,14 @@ def main():
     # Generate the queue parameters
     queue_file = "condor/queue_list.txt"
     with open(queue_file, "w") as f:
-        f.write("Events, Seed, OutFile, Mode, Analysis\n")
+        f.write("Events, Seed, OutFile, Mode, Analysis, FirstEvent\n")
         for i in range(num_jobs):
-            seed = 1000 + i
+            # Same seed for all jobs: counter-based seeding keys every event
+            # by (seed, global index), so jobs only differ in their range
+            first_event = i * args.events_per_job
             # Correct path for inside the container/worker node
             outfile = f"output_{i}.yoda" if args.rivet != 'none' else f"output_{i}.txt"
-            f.write(f"{args.events_per_job}, {seed}, {outfile}, {args.mode}, {args.rivet}\n")
+            f.write(f"{args.events_per_job}, {args.seed}, {outfile}, {args.mode}, {args.rivet}, {first_event}\n")
 
     # Add the queue command to a temporary .sub file
     sub_file = "condor/temp_production.sub"
@@ -41,16 +95,27 @@ def main():
     
     with open(sub_file, "w") as f:
         f.write(common_sub)
+        if args.snapshot_dir:
+            f.write(f"\n# Partial results while the jobs run\n")
+            f.write(f"environment             = \"SNAPSHOT_DIR={args.snapshot_dir}\"\n")
+        if requests:
+            # Later assignments override the defaults in production.sub
+            f.write(f"\n# Resource requests\n")
+            for key, value in requests.items():
+                f.write(f"{key:<24}= {value}\n")
         f.write(f"\n# Queue jobs\n")
-        f.write(f"queue Events, Seed, OutFile, Mode, Analysis from {queue_file}\n")
+        f.write(f"queue Events, Seed, OutFile, Mode, Analysis, FirstEvent from {queue_file}\n")
 
     # Submit
     try:
         subprocess.run(["condor_submit", sub_file], check=True)
         print("Successfully submitted to HTCondor!")
+        if args.snapshot_dir:
+            print(f"Follow the merged result with: python3 scripts/aggregate_results.py {args.snapshot_dir} -o condor/merged --watch 60")
     except Exception as e:
         print(f"Submit failed: {e}")
         print(f"You can try manually: condor_submit {sub_file}")
+    return 0
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
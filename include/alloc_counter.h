@@ -0,0 +1,66 @@
+// =============================================================================
+// alloc_counter.h
+// -----------------------------------------------------------------------------
+// Optional global allocation counters for measuring malloc traffic per event.
+//
+// Configure with -DHEPGEN_COUNT_ALLOCS=ON to replace the global operator
+// new/delete with counting versions. Without it the counters read -1 and
+// nothing is replaced. Include from exactly one translation unit per
+// executable (every generator here is a single .cc file).
+// =============================================================================
+
+#ifndef HEPGEN_ALLOC_COUNTER_H
+#define HEPGEN_ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace hepgen {
+
+struct AllocCounters {
+  std::atomic<long> nAlloc{0};
+  std::atomic<long> nBytes{0};
+};
+
+inline AllocCounters &allocCounters() {
+  static AllocCounters counters;
+  return counters;
+}
+
+// Number of operator new calls so far, or -1 if counting is disabled
+inline long allocCount() {
+#ifdef HEPGEN_COUNT_ALLOCS
+  return allocCounters().nAlloc.load(std::memory_order_relaxed);
+#else
+  return -1;
+#endif
+}
+
+inline long allocBytes() {
+#ifdef HEPGEN_COUNT_ALLOCS
+  return allocCounters().nBytes.load(std::memory_order_relaxed);
+#else
+  return -1;
+#endif
+}
+
+} // namespace hepgen
+
+#ifdef HEPGEN_COUNT_ALLOCS
+void *operator new(std::size_t n) {
+  hepgen::allocCounters().nAlloc.fetch_add(1, std::memory_order_relaxed);
+  hepgen::allocCounters().nBytes.fetch_add(long(n), std::memory_order_relaxed);
+  if (void *p = std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+#endif
+
+#endif // HEPGEN_ALLOC_COUNTER_H
@@ -0,0 +1,226 @@
+// =============================================================================
+// bkg_library.h
+// -----------------------------------------------------------------------------
+// Library of pre-generated heavy-ion underlying events for signal embedding.
+//
+// The library is a single flat binary file that is memory-mapped read-only,
+// so many embedding jobs on one node share the same page cache:
+//
+//   [BkgLibraryHeader][BkgParticle x nParticles][padding]
+//   [BkgEventRecord x nEvents]
+//
+// The padding (at most 7 zero bytes) aligns the event table for its uint64_t
+// member; eventTableOffset in the header points past it.
+// Only final-state particles are stored. Events are written with the reaction
+// plane along x (b along +x), so embedding can rotate them to any angle.
+// =============================================================================
+
+#ifndef HEPGEN_BKG_LIBRARY_H
+#define HEPGEN_BKG_LIBRARY_H
+
+#include "Pythia8/Pythia.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hepgen {
+
+constexpr char kBkgLibraryMagic[8] = {'H', 'E', 'P', 'G', 'B', 'K', 'G', '1'};
+
+struct BkgLibraryHeader {
+  char magic[8];
+  uint64_t nEvents;
+  uint64_t nParticles;
+  uint64_t eventTableOffset;
+};
+
+struct BkgParticle {
+  int32_t id;
+  float px, py, pz, e;
+};
+
+struct BkgEventRecord {
+  uint64_t firstParticle;
+  uint32_t nParticles;
+  uint32_t nColl;
+  float b;
+  uint32_t reserved;
+};
+
+// Streams events into a new library file. A failed write is reported once
+// and makes addEvent() and close() return false.
+class BkgLibraryWriter {
+public:
+  explicit BkgLibraryWriter(const std::string &path)
+      : file(std::fopen(path.c_str(), "wb")), path(path), nParticles(0) {
+    if (!file) {
+      std::cerr << "Cannot open background library " << path << std::endl;
+      return;
+    }
+    BkgLibraryHeader header = {};
+    write(&header, sizeof(header), 1);
+  }
+  ~BkgLibraryWriter() { close(); }
+
+  bool ok() const { return file != nullptr && !failed; }
+
+  bool addEvent(const Pythia8::Event &event, double b, int nColl) {
+    BkgEventRecord rec = {};
+    rec.firstParticle = nParticles;
+    rec.b = float(b);
+    rec.nColl = uint32_t(nColl);
+    for (int i = 0; i < event.size(); ++i) {
+      if (!event[i].isFinal())
+        continue;
+      BkgParticle p = {event[i].id(), float(event[i].px()),
+                       float(event[i].py()), float(event[i].pz()),
+                       float(event[i].e())};
+      write(&p, sizeof(p), 1);
+      ++rec.nParticles;
+    }
+    nParticles += rec.nParticles;
+    records.push_back(rec);
+    return ok();
+  }
+
+  // Appends the event table and finalizes the header. Returns false if any
+  // write failed; the file is then incomplete and must not be used.
+  bool close() {
+    if (!file)
+      return !failed;
+    BkgLibraryHeader header = {};
+    std::memcpy(header.magic, kBkgLibraryMagic, sizeof(header.magic));
+    header.nEvents = records.size();
+    header.nParticles = nParticles;
+    header.eventTableOffset = eventTableOffset(nParticles);
+    const char padding[alignof(BkgEventRecord)] = {};
+    write(padding, 1,
+          header.eventTableOffset - sizeof(BkgLibraryHeader) -
+              nParticles * sizeof(BkgParticle));
+    write(records.data(), sizeof(BkgEventRecord), records.size());
+    if (!failed && std::fseek(file, 0, SEEK_SET) != 0) {
+      std::cerr << "Cannot seek in background library " << path << std::endl;
+      failed = true;
+    }
+    write(&header, sizeof(header), 1);
+    if (std::fclose(file) != 0 && !failed) {
+      std::cerr << "Cannot close background library " << path << std::endl;
+      failed = true;
+    }
+    file = nullptr;
+    return !failed;
+  }
+
+  // Event table position after nParticles particles, aligned for
+  // BkgEventRecord
+  static uint64_t eventTableOffset(uint64_t nParticles) {
+    const uint64_t align = alignof(BkgEventRecord);
+    uint64_t end = sizeof(BkgLibraryHeader) + nParticles * sizeof(BkgParticle);
+    return (end + align - 1) / align * align;
+  }
+
+private:
+  void write(const void *data, size_t size, size_t count) {
+    if (failed || count == 0)
+      return;
+    if (std::fwrite(data, size, count, file) != count) {
+      std::cerr << "Cannot write background library " << path << std::endl;
+      failed = true;
+    }
+  }
+
+  std::FILE *file;
+  std::string path;
+  uint64_t nParticles;
+  std::vector<BkgEventRecord> records;
+  bool failed = false;
+};
+
+// Read-only, memory-mapped view of a library file
+class BkgLibrary {
+public:
+  explicit BkgLibrary(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Cannot open background library " << path << std::endl;
+      return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 &&
+        size_t(st.st_size) >= sizeof(BkgLibraryHeader))
+      mapSize = size_t(st.st_size);
+    if (mapSize > 0) {
+      void *addr = ::mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+      base = (addr == MAP_FAILED) ? nullptr : static_cast<const char *>(addr);
+    }
+    ::close(fd);
+    if (!base) {
+      std::cerr << "Cannot map background library " << path << std::endl;
+      return;
+    }
+    header = reinterpret_cast<const BkgLibraryHeader *>(base);
+    if (std::memcmp(header->magic, kBkgLibraryMagic, sizeof(header->magic)) !=
+            0 ||
+        header->eventTableOffset !=
+            BkgLibraryWriter::eventTableOffset(header->nParticles) ||
+        header->eventTableOffset + header->nEvents * sizeof(BkgEventRecord) >
+            mapSize) {
+      std::cerr << "Not a valid background library: " << path << std::endl;
+      header = nullptr;
+      return;
+    }
+    particles =
+        reinterpret_cast<const BkgParticle *>(base + sizeof(BkgLibraryHeader));
+    events = reinterpret_cast<const BkgEventRecord *>(
+        base + header->eventTableOffset);
+  }
+  ~BkgLibrary() {
+    if (base)
+      ::munmap(const_cast<char *>(base), mapSize);
+  }
+  BkgLibrary(const BkgLibrary &) = delete;
+  BkgLibrary &operator=(const BkgLibrary &) = delete;
+
+  bool ok() const { return header != nullptr; }
+  size_t size() const { return header ? header->nEvents : 0; }
+  const BkgEventRecord &record(size_t i) const { return events[i]; }
+
+  // Appends background event i to the signal event, rotated so that its
+  // reaction plane lies at psi. Returns the number of particles added.
+  int overlay(size_t i, double psi, Pythia8::Event &event,
+              int status = 201) const {
+    const BkgEventRecord &rec = events[i];
+    const BkgParticle *p = particles + rec.firstParticle;
+    double c = std::cos(psi), s = std::sin(psi);
+    for (uint32_t j = 0; j < rec.nParticles; ++j, ++p) {
+      Pythia8::Vec4 mom(c * p->px - s * p->py, s * p->px + c * p->py, p->pz,
+                        p->e);
+      double m2 = mom.e() * mom.e() - mom.px() * mom.px() -
+                  mom.py() * mom.py() - mom.pz() * mom.pz();
+      event.append(p->id, status, 0, 0, 0, 0, 0, 0, mom,
+                   m2 > 0. ? std::sqrt(m2) : 0.);
+    }
+    return int(rec.nParticles);
+  }
+
+private:
+  const char *base = nullptr;
+  size_t mapSize = 0;
+  const BkgLibraryHeader *header = nullptr;
+  const BkgParticle *particles = nullptr;
+  const BkgEventRecord *events = nullptr;
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_BKG_LIBRARY_H
@@ -0,0 +1,152 @@
+// =============================================================================
+// centrality.h
+// -----------------------------------------------------------------------------
+// Centrality-targeted impact-parameter sampling for Angantyr.
+//
+// Centrality classes are mapped to impact-parameter ranges with the geometric
+// approximation c = pi b^2 / sigma_inel, which is accurate to a few percent
+// for Pb-Pb below ~80% centrality. The impact parameter is then sampled
+// uniformly in the transverse area of the selected classes only, so no time is
+// spent on peripheral events that are never analyzed.
+// =============================================================================
+
+#ifndef HEPGEN_CENTRALITY_H
+#define HEPGEN_CENTRALITY_H
+
+#include "Pythia8/Pythia.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+// Inelastic Pb-Pb cross section at 5.02 TeV [mb] (ALICE, PRL 116 (2016) 222302)
+constexpr double kSigmaInelPbPb5TeV = 7670.0;
+
+// One centrality class [cMin, cMax) in percent, with its impact-parameter
+// range in fm and the per-class bookkeeping filled during generation.
+struct CentralityClass {
+  double cMin = 0.;
+  double cMax = 100.;
+  double bMin = 0.;
+  double bMax = 0.;
+  long nEvents = 0;
+  double sumWeight = 0.;
+
+  double area() const { return M_PI * (bMax * bMax - bMin * bMin); }
+  std::string label() const {
+    std::ostringstream os;
+    os << cMin << "-" << cMax << "%";
+    return os.str();
+  }
+};
+
+// Impact parameter [fm] at the edge of centrality c [%]
+inline double centralityToB(double c, double sigmaInelMb) {
+  // 1 mb = 0.1 fm^2
+  return std::sqrt(0.01 * c * 0.1 * sigmaInelMb / M_PI);
+}
+
+// Parse a comma-separated list of classes, e.g. "0-10,30-50".
+// Classes must be ordered and must not overlap.
+inline bool parseCentralityClasses(const std::string &spec, double sigmaInelMb,
+                                   std::vector<CentralityClass> &classes) {
+  classes.clear();
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    size_t dash = item.find('-');
+    if (dash == std::string::npos) {
+      std::cerr << "Bad centrality class '" << item << "' (expected lo-hi)"
+                << std::endl;
+      return false;
+    }
+    CentralityClass cls;
+    cls.cMin = std::atof(item.substr(0, dash).c_str());
+    cls.cMax = std::atof(item.substr(dash + 1).c_str());
+    if (cls.cMin < 0. || cls.cMax > 100. || cls.cMin >= cls.cMax) {
+      std::cerr << "Bad centrality class '" << item << "'" << std::endl;
+      return false;
+    }
+    if (!classes.empty() && cls.cMin < classes.back().cMax) {
+      std::cerr << "Centrality classes must be ordered and disjoint"
+                << std::endl;
+      return false;
+    }
+    cls.bMin = centralityToB(cls.cMin, sigmaInelMb);
+    cls.bMax = centralityToB(cls.cMax, sigmaInelMb);
+    classes.push_back(cls);
+  }
+  return !classes.empty();
+}
+
+// Index of the class containing impact parameter b, or -1
+inline int findCentralityClass(const std::vector<CentralityClass> &classes,
+                               double b) {
+  for (size_t k = 0; k < classes.size(); ++k)
+    if (b >= classes[k].bMin && b < classes[k].bMax)
+      return int(k);
+  return -1;
+}
+
+// Samples b uniformly in the transverse area covered by the requested classes.
+// The returned weight is the inverse sampling density (the total area in fm^2),
+// which is what Angantyr expects from the default Gaussian generator too, so
+// the cross section Pythia reports is the cross section of the classes.
+class CentralityImpactParameterGenerator
+    : public Pythia8::ImpactParameterGenerator {
+public:
+  CentralityImpactParameterGenerator(const std::vector<CentralityClass> &in,
+                                     bool randomPhiIn = true)
+      : classes(in), randomPhi(randomPhiIn), totalArea(0.) {
+    for (const auto &cls : classes)
+      totalArea += cls.area();
+  }
+
+  Pythia8::Vec4 generate(double &weight) const override {
+    // Pick a class proportional to its area, then b^2 flat inside it
+    double r = rndmPtr->flat() * totalArea;
+    size_t k = 0;
+    while (k + 1 < classes.size() && r > classes[k].area()) {
+      r -= classes[k].area();
+      ++k;
+    }
+    const CentralityClass &cls = classes[k];
+    double b2 = cls.bMin * cls.bMin +
+                rndmPtr->flat() * (cls.bMax * cls.bMax - cls.bMin * cls.bMin);
+    double b = std::sqrt(b2);
+    // With randomPhi off, b points along x so the reaction plane is at 0
+    double phi = randomPhi ? 2.0 * M_PI * rndmPtr->flat() : 0.0;
+    weight = totalArea;
+    return Pythia8::Vec4(b * std::cos(phi), b * std::sin(phi), 0.0, 0.0);
+  }
+
+private:
+  std::vector<CentralityClass> classes;
+  bool randomPhi;
+  double totalArea;
+};
+
+// Installs the generator above into Angantyr
+class CentralityHIHooks : public Pythia8::HIUserHooks {
+public:
+  explicit CentralityHIHooks(const std::vector<CentralityClass> &classes,
+                             bool randomPhi = true)
+      : bGen(classes, randomPhi) {}
+
+  bool hasImpactParameterGenerator() const override { return true; }
+  Pythia8::ImpactParameterGenerator *impactParameterGenerator() const override {
+    return const_cast<CentralityImpactParameterGenerator *>(&bGen);
+  }
+
+private:
+  CentralityImpactParameterGenerator bGen;
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_CENTRALITY_H
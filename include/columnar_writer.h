@@ -0,0 +1,379 @@
+// =============================================================================
+// columnar_writer.h
+// -----------------------------------------------------------------------------
+// Columnar particle-level output for numpy / pandas / ML studies, filled
+// directly from pythia.event in batches of events.
+//
+// Stored per event are the final state plus the intermediate particles with
+// a selected |PID| (their last copy), in event order, as columns:
+//
+//   event-level    event  <i8   event number (global index when seeded)
+//                  weight <f8   nominal event weight
+//   offsets        offsets <i4  nEvents + 1 per batch, starting at 0:
+//                               particles of event j are [o[j], o[j+1])
+//   particle-level pid <i4, px py pz e <f4 [GeV], status <i2 (Pythia),
+//                  mother <i4   index of the nearest stored ancestor along
+//                               mother1 within the event, -1 if none
+//
+// The layout follows Arrow's list arrays and Parquet's row groups. It has
+// its own small container rather than Arrow IPC, so it needs no Arrow
+// library in the generator image:
+//
+//   [ColumnarHeader][ColumnarColumn x nColumns]
+//   [batch 0: one chunk per column][batch 1: ...] ...
+//   [ColumnarBatch x nBatches][ColumnarChunk x nBatches * nColumns]
+//
+// Every chunk starts on a 64-byte boundary and is a plain little-endian
+// array, so an uncompressed file is read without copies by mapping it and
+// taking numpy views (scripts/columnar.py). With compression, each chunk is
+// byte-shuffled (the i-th bytes of all values together) and deflated;
+// chunks that do not shrink are stored raw. The footer position is filled
+// in at close; a file without it is incomplete. After a failed write the
+// footer is not written, so readers reject the file, and close() returns
+// false.
+//
+// Usage:
+//   hepgen::ColumnarWriter columnar(path, compress);   // check ok()
+//   columnar.keepPids({443, 413});                    // optional
+//   ...
+//   columnar.add(pythia.event, eventNumber, weight);
+//   ...
+//   columnar.close();
+// =============================================================================
+
+#ifndef HEPGEN_COLUMNAR_WRITER_H
+#define HEPGEN_COLUMNAR_WRITER_H
+
+#include "Pythia8/Pythia.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace hepgen {
+
+constexpr char kColumnarMagic[8] = {'H', 'E', 'P', 'G', 'C', 'O', 'L', '1'};
+
+enum ColumnarCodec : uint32_t {
+  kCodecNone = 0,
+  kCodecShuffleDeflate = 1 // byte shuffle, then zlib deflate
+};
+
+enum ColumnarLevel : uint32_t {
+  kLevelEvent = 0,    // one value per event
+  kLevelOffsets = 1,  // nEvents + 1 values per batch
+  kLevelParticle = 2  // one value per stored particle
+};
+
+struct ColumnarHeader {
+  char magic[8];
+  uint32_t nColumns;
+  uint32_t columnSize; // sizeof(ColumnarColumn), and so on, for readers
+  uint32_t batchSize;
+  uint32_t chunkSize;
+  uint64_t nEvents;
+  uint64_t nParticles;
+  uint64_t nBatches;
+  uint64_t footerOffset; // 0 while the file is being written
+  uint32_t codec;        // requested codec; chunks record their own
+  uint32_t reserved;
+};
+
+struct ColumnarColumn {
+  char name[16];
+  char dtype[4]; // numpy type string, e.g. "<f4"
+  uint32_t level;
+  uint32_t itemSize;
+  uint32_t reserved;
+};
+
+struct ColumnarBatch {
+  uint64_t firstEvent; // row of its first event in the file
+  uint32_t nEvents;
+  uint32_t nParticles;
+};
+
+struct ColumnarChunk {
+  uint64_t offset;      // byte offset in the file
+  uint64_t storedBytes; // as written
+  uint64_t rawBytes;    // after decompression
+  uint32_t codec;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(ColumnarHeader) == 64, "columnar header layout");
+static_assert(sizeof(ColumnarColumn) == 32, "columnar column layout");
+static_assert(sizeof(ColumnarBatch) == 16, "columnar batch layout");
+static_assert(sizeof(ColumnarChunk) == 32, "columnar chunk layout");
+
+// Parse "443,413" into a |PID| list
+inline bool parsePidList(const std::string &spec, std::vector<int> &pids) {
+  std::string s = spec;
+  std::replace(s.begin(), s.end(), ',', ' ');
+  std::istringstream is(s);
+  pids.clear();
+  int pid;
+  while (is >> pid)
+    pids.push_back(std::abs(pid));
+  if (!is.eof() || pids.empty()) {
+    std::cerr << "Invalid PID list: " << spec << std::endl;
+    return false;
+  }
+  return true;
+}
+
+class ColumnarWriter {
+public:
+  // Charmonia, open charm and beauty hadrons kept besides the final state
+  static std::vector<int> defaultPids() {
+    return {443, 100443, 411, 413, 421, 423, 431, 4122, 511, 521, 531, 5122};
+  }
+
+  ColumnarWriter(const std::string &path, bool compress,
+                 uint32_t eventsPerBatchIn = 1024)
+      : file(std::fopen(path.c_str(), "wb")), filePath(path),
+        codec(compress ? kCodecShuffleDeflate : kCodecNone),
+        eventsPerBatch(std::max(eventsPerBatchIn, 1u)), pids(defaultPids()) {
+    if (!file) {
+      std::cerr << "Cannot open columnar output " << path << std::endl;
+      return;
+    }
+    ColumnarHeader header = makeHeader();
+    write(&header, sizeof(header), 1);
+    for (const ColumnarColumn &c : columns())
+      write(&c, sizeof(c), 1);
+    pos = sizeof(header) + kNColumns * sizeof(ColumnarColumn);
+    batchOffsets.push_back(0);
+  }
+  ~ColumnarWriter() { close(); }
+  ColumnarWriter(const ColumnarWriter &) = delete;
+  ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+
+  bool ok() const { return file != nullptr && !failed; }
+  const std::string &path() const { return filePath; }
+  uint64_t eventsWritten() const { return nEvents; }
+  uint64_t bytesWritten() const { return pos; }
+
+  // Intermediate particles to keep (|PID|); the final state is always kept
+  void keepPids(const std::vector<int> &absPids) { pids = absPids; }
+
+  // Append the stored particles of event
+  void add(const Pythia8::Event &event, int64_t eventNumber, double weight) {
+    if (!ok())
+      return;
+    const int n = event.size();
+    local.assign(n, -1);
+    int32_t nStored = 0;
+    for (int i = 1; i < n; ++i) {
+      const Pythia8::Particle &p = event[i];
+      bool keep = p.isFinal() ||
+                  (std::find(pids.begin(), pids.end(), p.idAbs()) !=
+                       pids.end() &&
+                   p.iBotCopyId() == i);
+      if (keep)
+        local[i] = nStored++;
+    }
+    for (int i = 1; i < n; ++i) {
+      if (local[i] < 0)
+        continue;
+      const Pythia8::Particle &p = event[i];
+      int m = p.mother1();
+      for (int step = 0; m > 0 && local[m] < 0 && step < n; ++step)
+        m = event[m].mother1();
+      pid.push_back(p.id());
+      px.push_back(float(p.px()));
+      py.push_back(float(p.py()));
+      pz.push_back(float(p.pz()));
+      e.push_back(float(p.e()));
+      status.push_back(int16_t(p.status()));
+      mother.push_back(m > 0 ? local[m] : -1);
+    }
+    events.push_back(eventNumber);
+    weights.push_back(weight);
+    batchOffsets.push_back(batchOffsets.back() + nStored);
+    ++nEvents;
+    nParticles += uint64_t(nStored);
+    if (events.size() >= eventsPerBatch)
+      flush();
+  }
+
+  // Write the last batch and the footer. Returns false if any write failed;
+  // the footer is then left out and the file reads as incomplete.
+  bool close() {
+    if (!file)
+      return !failed;
+    flush();
+    align();
+    if (!failed) {
+      ColumnarHeader header = makeHeader();
+      header.footerOffset = pos;
+      write(batches.data(), sizeof(ColumnarBatch), batches.size());
+      write(chunks.data(), sizeof(ColumnarChunk), chunks.size());
+      header.nEvents = nEvents;
+      header.nParticles = nParticles;
+      header.nBatches = batches.size();
+      if (!failed && std::fseek(file, 0, SEEK_SET) != 0) {
+        std::cerr << "Cannot seek in columnar output " << filePath
+                  << std::endl;
+        failed = true;
+      }
+      write(&header, sizeof(header), 1);
+    }
+    if (std::fclose(file) != 0 && !failed) {
+      std::cerr << "Cannot close columnar output " << filePath << std::endl;
+      failed = true;
+    }
+    file = nullptr;
+    return !failed;
+  }
+
+private:
+  static constexpr uint32_t kNColumns = 10;
+
+  std::FILE *file;
+  std::string filePath;
+  uint32_t codec;
+  uint32_t eventsPerBatch;
+  std::vector<int> pids;
+  uint64_t pos = 0;
+  uint64_t nEvents = 0, nParticles = 0;
+  std::vector<ColumnarBatch> batches;
+  std::vector<ColumnarChunk> chunks;
+
+  // Current batch, capacity kept between batches
+  std::vector<int64_t> events;
+  std::vector<double> weights;
+  std::vector<int32_t> batchOffsets;
+  std::vector<int32_t> pid, mother;
+  std::vector<float> px, py, pz, e;
+  std::vector<int16_t> status;
+  std::vector<int> local;
+  std::vector<unsigned char> shuffled, packed;
+  bool failed = false;
+
+  // fwrite that reports the first failure and skips all later writes
+  void write(const void *data, size_t size, size_t count) {
+    if (failed || count == 0)
+      return;
+    if (std::fwrite(data, size, count, file) != count) {
+      std::cerr << "Cannot write columnar output " << filePath << std::endl;
+      failed = true;
+    }
+  }
+
+  static std::vector<ColumnarColumn> columns() {
+    auto column = [](const char *name, const char *dtype, uint32_t level,
+                     uint32_t itemSize) {
+      ColumnarColumn c = {};
+      std::strncpy(c.name, name, sizeof(c.name) - 1);
+      std::memcpy(c.dtype, dtype, 3);
+      c.level = level;
+      c.itemSize = itemSize;
+      return c;
+    };
+    // Same order as the chunks of a batch (flush())
+    return {column("event", "<i8", kLevelEvent, 8),
+            column("weight", "<f8", kLevelEvent, 8),
+            column("offsets", "<i4", kLevelOffsets, 4),
+            column("pid", "<i4", kLevelParticle, 4),
+            column("px", "<f4", kLevelParticle, 4),
+            column("py", "<f4", kLevelParticle, 4),
+            column("pz", "<f4", kLevelParticle, 4),
+            column("e", "<f4", kLevelParticle, 4),
+            column("status", "<i2", kLevelParticle, 2),
+            column("mother", "<i4", kLevelParticle, 4)};
+  }
+
+  ColumnarHeader makeHeader() const {
+    ColumnarHeader header = {};
+    std::memcpy(header.magic, kColumnarMagic, sizeof(header.magic));
+    header.nColumns = kNColumns;
+    header.columnSize = sizeof(ColumnarColumn);
+    header.batchSize = sizeof(ColumnarBatch);
+    header.chunkSize = sizeof(ColumnarChunk);
+    header.codec = codec;
+    return header;
+  }
+
+  void flush() {
+    if (events.empty())
+      return;
+    ColumnarBatch batch = {};
+    batch.firstEvent = nEvents - events.size();
+    batch.nEvents = uint32_t(events.size());
+    batch.nParticles = uint32_t(pid.size());
+    batches.push_back(batch);
+    writeChunk(events.data(), sizeof(int64_t), events.size());
+    writeChunk(weights.data(), sizeof(double), weights.size());
+    writeChunk(batchOffsets.data(), sizeof(int32_t), batchOffsets.size());
+    writeChunk(pid.data(), sizeof(int32_t), pid.size());
+    writeChunk(px.data(), sizeof(float), px.size());
+    writeChunk(py.data(), sizeof(float), py.size());
+    writeChunk(pz.data(), sizeof(float), pz.size());
+    writeChunk(e.data(), sizeof(float), e.size());
+    writeChunk(status.data(), sizeof(int16_t), status.size());
+    writeChunk(mother.data(), sizeof(int32_t), mother.size());
+
+    events.clear();
+    weights.clear();
+    batchOffsets.assign(1, 0);
+    pid.clear();
+    px.clear();
+    py.clear();
+    pz.clear();
+    e.clear();
+    status.clear();
+    mother.clear();
+  }
+
+  void writeChunk(const void *data, size_t itemSize, size_t n) {
+    align();
+    ColumnarChunk chunk = {};
+    chunk.offset = pos;
+    chunk.rawBytes = itemSize * n;
+    chunk.codec = kCodecNone;
+    const void *out = data;
+    size_t outBytes = chunk.rawBytes;
+    if (codec == kCodecShuffleDeflate && n > 0) {
+      // Byte shuffle: byte b of value i goes to b * n + i
+      const unsigned char *in = static_cast<const unsigned char *>(data);
+      shuffled.resize(chunk.rawBytes);
+      for (size_t b = 0; b < itemSize; ++b)
+        for (size_t i = 0; i < n; ++i)
+          shuffled[b * n + i] = in[i * itemSize + b];
+      uLongf packedBytes = compressBound(uLong(chunk.rawBytes));
+      packed.resize(packedBytes);
+      if (compress2(packed.data(), &packedBytes, shuffled.data(),
+                    uLong(chunk.rawBytes), Z_DEFAULT_COMPRESSION) == Z_OK &&
+          packedBytes < chunk.rawBytes) {
+        out = packed.data();
+        outBytes = packedBytes;
+        chunk.codec = kCodecShuffleDeflate;
+      }
+    }
+    write(out, 1, outBytes);
+    chunk.storedBytes = outBytes;
+    pos += outBytes;
+    chunks.push_back(chunk);
+  }
+
+  // Pad to the next 64-byte boundary
+  void align() {
+    static const char zeros[64] = {};
+    size_t pad = (64 - pos % 64) % 64;
+    write(zeros, 1, pad);
+    pos += pad;
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_COLUMNAR_WRITER_H
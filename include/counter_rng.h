@@ -0,0 +1,130 @@
+// =============================================================================
+// counter_rng.h
+// -----------------------------------------------------------------------------
+// Counter-based random numbers: every event's random state is a pure function
+// of (campaign seed, global event index), so a sample is the same whatever
+// the number of processes or the events per process it was split into.
+//
+//   - philox4x32: the Philox4x32-10 block function (Salmon et al., SC'11),
+//     key = campaign seed, counter = (draw, stream, event index)
+//   - CounterRng: flat() stream for one (seed, stream), positioned per event
+//   - CounterRndmEngine: the same as a Pythia RndmEngine; EvtGen (through
+//     EvtGenDecays), PHOTOS and the centrality hooks all draw from
+//     pythia.rndm and therefore from this engine
+//
+// Usage:
+//   auto rndm = hepgen::installCounterRndm(pythia, seed);   // before init()
+//   for (long i = firstEvent; i < firstEvent + nEvents; ++i) {
+//     rndm->setEvent(i);
+//     pythia.next();
+//     ...
+//   }
+// =============================================================================
+
+#ifndef HEPGEN_COUNTER_RNG_H
+#define HEPGEN_COUNTER_RNG_H
+
+#include "Pythia8/Pythia.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace hepgen {
+
+using PhiloxBlock = std::array<uint32_t, 4>;
+
+constexpr PhiloxBlock philox4x32(PhiloxBlock ctr, uint32_t k0, uint32_t k1) {
+  for (int round = 0; round < 10; ++round) {
+    uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+    uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+    ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ k0, uint32_t(p1),
+           uint32_t(p0 >> 32) ^ ctr[3] ^ k1, uint32_t(p0)};
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+  return ctr;
+}
+
+// Known-answer tests from the Random123 distribution
+static_assert(philox4x32({0, 0, 0, 0}, 0, 0)[0] == 0x6627e8d5u &&
+                  philox4x32({0, 0, 0, 0}, 0, 0)[3] == 0x9b00dbd8u,
+              "Philox4x32-10 known-answer test");
+static_assert(philox4x32({0xffffffffu, 0xffffffffu, 0xffffffffu,
+                          0xffffffffu},
+                         0xffffffffu, 0xffffffffu)[0] == 0x408f276du,
+              "Philox4x32-10 known-answer test");
+
+// Independent streams per event. New consumers get a new stream id, so
+// adding one never shifts the numbers drawn by the others.
+enum RngStream : uint32_t {
+  kStreamPythia = 0,    // Pythia, EvtGen, PHOTOS, hooks
+  kStreamEventPlane = 1, // reaction plane and embedding background pick
+  kStreamDetector = 2    // detector response smearing
+};
+
+class CounterRng {
+public:
+  // Initialization draws come from this index, never used by an event
+  static constexpr uint64_t kInitEvent = ~uint64_t(0);
+
+  explicit CounterRng(uint64_t seed = 0, uint32_t streamIn = kStreamPythia)
+      : key0(uint32_t(seed)), key1(uint32_t(seed >> 32)), stream(streamIn) {
+    setEvent(kInitEvent);
+  }
+
+  void setEvent(uint64_t index) {
+    event = index;
+    draw = 0;
+    next = 2;
+  }
+  uint64_t currentEvent() const { return event; }
+
+  // Uniform in (0, 1) with 53 random bits; one Philox block gives two
+  double flat() {
+    if (next == 2) {
+      PhiloxBlock out =
+          philox4x32({draw++, stream, uint32_t(event), uint32_t(event >> 32)},
+                     key0, key1);
+      buffer[0] = toDouble(out[0], out[1]);
+      buffer[1] = toDouble(out[2], out[3]);
+      next = 0;
+    }
+    return buffer[next++];
+  }
+
+private:
+  uint32_t key0, key1, stream;
+  uint64_t event = 0;
+  uint32_t draw = 0;
+  int next = 2;
+  double buffer[2] = {0., 0.};
+
+  static double toDouble(uint32_t hi, uint32_t lo) {
+    uint64_t bits = ((uint64_t(hi) << 32) | lo) >> 11;
+    return (double(bits) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+};
+
+class CounterRndmEngine : public Pythia8::RndmEngine {
+public:
+  explicit CounterRndmEngine(uint64_t seed) : rng(seed, kStreamPythia) {}
+  double flat() override { return rng.flat(); }
+  void setEvent(uint64_t index) { rng.setEvent(index); }
+
+private:
+  CounterRng rng;
+};
+
+// Route all of Pythia's random numbers through the counter-based engine.
+// Must be called before pythia.init(); init itself draws from kInitEvent.
+inline std::shared_ptr<CounterRndmEngine> installCounterRndm(
+    Pythia8::Pythia &pythia, uint64_t seed) {
+  auto engine = std::make_shared<CounterRndmEngine>(seed);
+  pythia.setRndmEnginePtr(engine);
+  return engine;
+}
+
+} // namespace hepgen
+
+#endif // HEPGEN_COUNTER_RNG_H
@@ -0,0 +1,371 @@
+// =============================================================================
+// detector_response.h
+// -----------------------------------------------------------------------------
+// Parametric detector response applied to pythia.event between generation
+// and analysis, so that everything downstream (HepMC3 output and Rivet, the
+// native analysis, the event index) sees detector-level final states.
+//
+// Every visible final-state particle is measured by one subsystem:
+//
+//   muons             muon system: (|eta|, pT) efficiency map, pT resolution
+//   charged, in the   tracker: (|eta|, pT) efficiency map, pT resolution
+//     tracker
+//   photons, and e+-  ECAL: sigma_E/E = stoch/sqrt(E) (+) const
+//     outside it
+//   other             HCAL: sigma_E/E = stoch/sqrt(E) (+) const; jets get
+//                     their energy smearing from the calorimeter response
+//                     of their neutral and forward constituents
+//
+// Tracks keep their direction and have their pT scaled; calorimeter objects
+// keep their direction and have their energy smeared. Particles that fail
+// the efficiency, or lie outside every acceptance, are marked as no longer
+// final (negative status), so they drop out of the final state everywhere.
+// Intermediate particles (the J/psi, B and D mesons) keep their truth
+// momenta. Neutrinos are left as they are.
+//
+// The final state is first gathered into structure-of-arrays batches, the
+// response is computed in flat loops over them, and the results are
+// scattered back. Random numbers are counter-based (counter_rng.h): one
+// Philox block per particle keyed by (seed, detector stream, event index,
+// particle), so the smearing of an event does not depend on how many
+// particles other events had or on how the sample was split into jobs.
+//
+// Settings use the Pythia runcard syntax ("Detector:" prefix optional); see
+// runcards/detector_cms.cmnd for the keys. Maps are given as |eta| edges,
+// pT lower edges and one value per (|eta| bin, pT bin), pT running fastest:
+//
+//   Detector:trackEta = 0, 0.9, 2.5      ! |eta| edges
+//   Detector:trackPT  = 0.1, 1.0         ! pT bin lower edges [GeV]
+//   Detector:trackEff = 0.85, 0.92, 0.80, 0.88
+//
+// Usage:
+//   hepgen::DetectorResponse detector;
+//   if (!detector.readFile(card)) return 1;
+//   ...
+//   detector.apply(pythia.event, seed, eventIndex);   // before fill()
+// =============================================================================
+
+#ifndef HEPGEN_DETECTOR_RESPONSE_H
+#define HEPGEN_DETECTOR_RESPONSE_H
+
+#include "Pythia8/Pythia.h"
+
+#include "counter_rng.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+// Value binned in |eta| and pT. Zero outside the |eta| edges and below the
+// first pT edge; the last pT bin extends to infinity.
+struct DetectorMap {
+  std::vector<double> etaEdges{0., 1e9};
+  std::vector<double> pTEdges{0.};
+  std::vector<double> values{0.};
+
+  double etaMax() const { return etaEdges.back(); }
+  bool consistent() const {
+    return etaEdges.size() >= 2 && !pTEdges.empty() &&
+           values.size() == (etaEdges.size() - 1) * pTEdges.size();
+  }
+  double operator()(double absEta, double pT) const {
+    if (absEta < etaEdges.front() || absEta >= etaEdges.back() ||
+        pT < pTEdges.front())
+      return 0.;
+    size_t iEta = std::upper_bound(etaEdges.begin(), etaEdges.end(), absEta) -
+                  etaEdges.begin() - 1;
+    size_t iPT = std::upper_bound(pTEdges.begin(), pTEdges.end(), pT) -
+                 pTEdges.begin() - 1;
+    return values[iEta * pTEdges.size() + iPT];
+  }
+};
+
+class DetectorResponse {
+public:
+  // Muon system and tracker: efficiency maps, and the pT resolution as a
+  // constant term per |eta| bin (+) slope * pT
+  DetectorMap muonEff, muonRes;
+  double muonResSlope = 1e-4; // [1/GeV]
+  DetectorMap trackEff, trackRes;
+  double trackResSlope = 1.5e-4;
+  // Calorimeters
+  double ecalEtaMax = 3.0, ecalStoch = 0.03, ecalConst = 0.005;
+  double hcalEtaMax = 5.0, hcalStoch = 1.0, hcalConst = 0.05;
+  double caloScale = 1.0; // energy scale, for scale systematics
+
+  DetectorResponse() {
+    // Roughly CMS Run 2; runcards/detector_cms.cmnd spells them out
+    muonEff.etaEdges = {0., 0.9, 1.2, 2.1, 2.4};
+    muonEff.pTEdges = {3.0, 5.0};
+    muonEff.values = {0.90, 0.96, 0.90, 0.96, 0.92, 0.96, 0.85, 0.94};
+    muonRes.etaEdges = muonEff.etaEdges;
+    muonRes.values = {0.010, 0.015, 0.020, 0.025};
+    trackEff.etaEdges = {0., 0.9, 1.5, 2.5};
+    trackEff.pTEdges = {0.1, 0.5, 1.0};
+    trackEff.values = {0.75, 0.88, 0.92, 0.70, 0.85, 0.90, 0.60, 0.78, 0.85};
+    trackRes.etaEdges = trackEff.etaEdges;
+    trackRes.values = {0.006, 0.010, 0.020};
+  }
+
+  bool enabled() const { return configured; }
+
+  // Parse one "key = value" line; comments start with '!' or '#'
+  bool readString(std::string line) {
+    line = line.substr(0, line.find_first_of("!#"));
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+      return trim(line).empty();
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    if (key.compare(0, 9, "detector:") == 0)
+      key = key.substr(9);
+
+    if (key == "muoneta") {
+      muonEff.etaEdges = muonRes.etaEdges = list(value);
+    } else if (key == "muonpt") {
+      muonEff.pTEdges = list(value);
+    } else if (key == "muoneff") {
+      muonEff.values = list(value);
+    } else if (key == "muonres") {
+      muonRes.values = list(value);
+    } else if (key == "muonresslope") {
+      muonResSlope = std::atof(value.c_str());
+    } else if (key == "tracketa") {
+      trackEff.etaEdges = trackRes.etaEdges = list(value);
+    } else if (key == "trackpt") {
+      trackEff.pTEdges = list(value);
+    } else if (key == "trackeff") {
+      trackEff.values = list(value);
+    } else if (key == "trackres") {
+      trackRes.values = list(value);
+    } else if (key == "trackresslope") {
+      trackResSlope = std::atof(value.c_str());
+    } else if (key == "ecaletamax") {
+      ecalEtaMax = std::atof(value.c_str());
+    } else if (key == "ecalstoch") {
+      ecalStoch = std::atof(value.c_str());
+    } else if (key == "ecalconst") {
+      ecalConst = std::atof(value.c_str());
+    } else if (key == "hcaletamax") {
+      hcalEtaMax = std::atof(value.c_str());
+    } else if (key == "hcalstoch") {
+      hcalStoch = std::atof(value.c_str());
+    } else if (key == "hcalconst") {
+      hcalConst = std::atof(value.c_str());
+    } else if (key == "caloscale") {
+      caloScale = std::atof(value.c_str());
+    } else {
+      std::cerr << "Unknown detector setting: " << key << std::endl;
+      return false;
+    }
+    configured = true;
+    return true;
+  }
+
+  bool readFile(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cerr << "Cannot open detector runcard " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+      if (!readString(line))
+        return false;
+    configured = true;
+    return check();
+  }
+
+  // Map sizes must match their edges
+  bool check() const {
+    if (muonEff.consistent() && muonRes.consistent() &&
+        trackEff.consistent() && trackRes.consistent())
+      return true;
+    std::cerr << "Detector maps: need one value per (|eta| bin, pT bin), "
+                 "and one resolution per |eta| bin"
+              << std::endl;
+    return false;
+  }
+
+  std::string describe() const {
+    std::ostringstream os;
+    os << "muon |eta|<" << muonEff.etaMax() << " track |eta|<"
+       << trackEff.etaMax() << " ecal |eta|<" << ecalEtaMax << " "
+       << ecalStoch << "/sqrt(E)+" << ecalConst << " hcal |eta|<"
+       << hcalEtaMax << " " << hcalStoch << "/sqrt(E)+" << hcalConst
+       << " caloScale=" << caloScale;
+    return os.str();
+  }
+
+  // Smear the final state of event in place. eventIndex keys the random
+  // numbers (the global event index in seeded runs).
+  void apply(Pythia8::Event &event, uint64_t seed, uint64_t eventIndex) {
+    auto start = std::chrono::steady_clock::now();
+    gather(event);
+    respond(seed, eventIndex);
+    scatter(event);
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+    ++nEvents;
+  }
+
+  void print(std::ostream &os) const {
+    os << "Detector response: " << nEvents << " events, " << nParticles
+       << " particles, " << nLost << " lost ("
+       << (nParticles ? 100. * nLost / nParticles : 0.) << "%), "
+       << (nEvents ? 1e6 * seconds / nEvents : 0.) << " us/event"
+       << std::endl;
+  }
+
+private:
+  enum Kind : unsigned char { kMuon, kCharged, kElectron, kPhoton, kNeutral };
+
+  bool configured = false;
+  long nEvents = 0, nParticles = 0, nLost = 0;
+  double seconds = 0.;
+
+  // One event's visible final state, structure of arrays; capacity is kept
+  // between events
+  std::vector<int> index;
+  std::vector<unsigned char> kind, lost;
+  std::vector<double> px, py, pz, e, m2, pT, absEta, gauss, flat, scale;
+
+  void gather(const Pythia8::Event &event) {
+    index.clear();
+    kind.clear();
+    px.clear();
+    py.clear();
+    pz.clear();
+    e.clear();
+    m2.clear();
+    for (int i = 0; i < event.size(); ++i) {
+      const Pythia8::Particle &p = event[i];
+      if (!p.isFinal() || !p.isVisible())
+        continue;
+      int idAbs = p.idAbs();
+      index.push_back(i);
+      kind.push_back(idAbs == 13   ? kMuon
+                     : idAbs == 11 ? kElectron
+                     : idAbs == 22 ? kPhoton
+                     : p.isCharged() ? kCharged
+                                     : kNeutral);
+      px.push_back(p.px());
+      py.push_back(p.py());
+      pz.push_back(p.pz());
+      e.push_back(p.e());
+      m2.push_back(p.m2());
+    }
+  }
+
+  void respond(uint64_t seed, uint64_t eventIndex) {
+    const size_t n = index.size();
+    pT.resize(n);
+    absEta.resize(n);
+    gauss.resize(n);
+    flat.resize(n);
+    scale.resize(n);
+    lost.resize(n);
+
+    // Kinematics
+    const double tiny = std::numeric_limits<double>::min();
+    for (size_t k = 0; k < n; ++k) {
+      pT[k] = std::sqrt(px[k] * px[k] + py[k] * py[k]);
+      double pAbs = std::sqrt(pT[k] * pT[k] + pz[k] * pz[k]);
+      absEta[k] = std::log((pAbs + std::abs(pz[k])) / std::max(pT[k], tiny));
+    }
+
+    // Random numbers: one Philox block per particle, two words for a
+    // Box-Muller normal and one for the efficiency
+    const uint32_t key0 = uint32_t(seed), key1 = uint32_t(seed >> 32);
+    const uint32_t ev0 = uint32_t(eventIndex), ev1 = uint32_t(eventIndex >> 32);
+    for (size_t k = 0; k < n; ++k) {
+      PhiloxBlock r =
+          philox4x32({uint32_t(k), kStreamDetector, ev0, ev1}, key0, key1);
+      double u0 = (r[0] + 0.5) * 0x1p-32, u1 = (r[1] + 0.5) * 0x1p-32;
+      gauss[k] = std::sqrt(-2. * std::log(u0)) * std::cos(2. * M_PI * u1);
+      flat[k] = (r[2] + 0.5) * 0x1p-32;
+    }
+
+    // Response: scale factor of the three-momentum, and efficiency
+    const double trackEtaMax = trackEff.etaMax();
+    for (size_t k = 0; k < n; ++k) {
+      double eff, sigma;
+      bool tracked = kind[k] == kMuon ||
+                     (kind[k] != kPhoton && kind[k] != kNeutral &&
+                      absEta[k] < trackEtaMax);
+      if (kind[k] == kMuon) {
+        eff = muonEff(absEta[k], pT[k]);
+        sigma = std::hypot(muonRes(absEta[k], 0.), muonResSlope * pT[k]);
+      } else if (tracked) {
+        eff = trackEff(absEta[k], pT[k]);
+        sigma = std::hypot(trackRes(absEta[k], 0.), trackResSlope * pT[k]);
+      } else {
+        bool ecal = (kind[k] == kPhoton || kind[k] == kElectron) &&
+                    absEta[k] < ecalEtaMax;
+        eff = (ecal || absEta[k] < hcalEtaMax) ? 1. : 0.;
+        double stoch = ecal ? ecalStoch : hcalStoch;
+        double cnst = ecal ? ecalConst : hcalConst;
+        sigma = std::hypot(stoch / std::sqrt(std::max(e[k], tiny)), cnst);
+      }
+      double f = 1. + sigma * gauss[k];
+      if (!tracked) {
+        // Smear the energy, keep the mass: |p'| = sqrt(E'^2 - m^2)
+        double eNew = caloScale * f * e[k];
+        double p2 = pT[k] * pT[k] + pz[k] * pz[k];
+        double p2New = eNew > 0. ? eNew * eNew - m2[k] : -1.;
+        f = (p2New > 0. && p2 > 0.) ? std::sqrt(p2New / p2) : -1.;
+      }
+      scale[k] = f;
+      lost[k] = (flat[k] >= eff || f <= 0.) ? 1 : 0;
+    }
+  }
+
+  void scatter(Pythia8::Event &event) {
+    const size_t n = index.size();
+    for (size_t k = 0; k < n; ++k) {
+      Pythia8::Particle &p = event[index[k]];
+      if (lost[k]) {
+        p.statusNeg();
+        ++nLost;
+        continue;
+      }
+      double f = scale[k];
+      double pxNew = f * px[k], pyNew = f * py[k], pzNew = f * pz[k];
+      p.p(pxNew, pyNew, pzNew,
+          std::sqrt(pxNew * pxNew + pyNew * pyNew + pzNew * pzNew + m2[k]));
+    }
+    nParticles += long(n);
+  }
+
+  static std::vector<double> list(std::string value) {
+    std::replace(value.begin(), value.end(), ',', ' ');
+    std::istringstream is(value);
+    std::vector<double> out;
+    double x;
+    while (is >> x)
+      out.push_back(x);
+    return out;
+  }
+
+  static std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return (b == std::string::npos) ? "" : s.substr(b, e - b + 1);
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_DETECTOR_RESPONSE_H
@@ -0,0 +1,203 @@
+// =============================================================================
+// event_filter.h
+// -----------------------------------------------------------------------------
+// Declarative acceptance filter evaluated on pythia.event before HepMC3
+// conversion, so events the analysis would veto are never converted or
+// written.
+//
+// Settings use the Pythia runcard syntax and can come from a file or from
+// the command line ("Filter:" prefix optional on the command line):
+//
+//   Filter:pids          = 443      ! |PID| list, empty = no particle cut
+//   Filter:pTMin         = 6.5      ! [GeV]
+//   Filter:pTMax         = 30.      ! [GeV], <= 0 = no limit
+//   Filter:etaMax        = 2.4      ! |eta| limit, <= 0 = no limit
+//   Filter:nMin          = 1        ! min. number of matching particles
+//   Filter:nMax          = -1       ! max. number, < 0 = no limit
+//   Filter:leadJetPTMin  = 30.      ! anti-kT leading-jet pT [GeV], 0 = off
+//   Filter:jetR          = 0.4
+//   Filter:jetEtaMax     = 5.0      ! |eta| of jet constituents
+// =============================================================================
+
+#ifndef HEPGEN_EVENT_FILTER_H
+#define HEPGEN_EVENT_FILTER_H
+
+#include "Pythia8/Pythia.h"
+#include "signal_selector.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+class EventFilter {
+public:
+  std::vector<int> absPids;
+  double pTMin = 0.;
+  double pTMax = -1.;
+  double etaMax = -1.;
+  int nMin = 1;
+  int nMax = -1;
+  double leadJetPTMin = 0.;
+  double jetR = 0.4;
+  double jetEtaMax = 5.0;
+
+  long nTried = 0;
+  long nAccepted = 0;
+
+  bool enabled() const { return configured; }
+  double acceptRate() const {
+    return nTried > 0 ? double(nAccepted) / double(nTried) : 0.;
+  }
+
+  // Parse one "key = value" line; comments start with '!' or '#'
+  bool readString(std::string line) {
+    line = line.substr(0, line.find_first_of("!#"));
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+      return trim(line).empty();
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    if (key.compare(0, 7, "filter:") == 0)
+      key = key.substr(7);
+
+    if (key == "pids") {
+      absPids.clear();
+      std::replace(value.begin(), value.end(), ',', ' ');
+      std::istringstream is(value);
+      int pid;
+      while (is >> pid)
+        absPids.push_back(std::abs(pid));
+    } else if (key == "ptmin") {
+      pTMin = std::atof(value.c_str());
+    } else if (key == "ptmax") {
+      pTMax = std::atof(value.c_str());
+    } else if (key == "etamax") {
+      etaMax = std::atof(value.c_str());
+    } else if (key == "nmin") {
+      nMin = std::atoi(value.c_str());
+    } else if (key == "nmax") {
+      nMax = std::atoi(value.c_str());
+    } else if (key == "leadjetptmin") {
+      leadJetPTMin = std::atof(value.c_str());
+    } else if (key == "jetr") {
+      jetR = std::atof(value.c_str());
+    } else if (key == "jetetamax") {
+      jetEtaMax = std::atof(value.c_str());
+    } else {
+      std::cerr << "Unknown filter setting: " << key << std::endl;
+      return false;
+    }
+    configured = true;
+    return true;
+  }
+
+  bool readFile(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cerr << "Cannot open filter runcard " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+      if (!readString(line))
+        return false;
+    return true;
+  }
+
+  // Evaluate on the current event and update the counters
+  bool accept(const Pythia8::Event &event) {
+    ++nTried;
+    if (!configured || (passParticles(event) && passJets(event))) {
+      ++nAccepted;
+      return true;
+    }
+    return false;
+  }
+
+  // Same, looking up the filter particles in a prebuilt |PID| index
+  bool accept(const Pythia8::Event &event, const PidIndex &index) {
+    ++nTried;
+    if (!configured || (passParticles(event, &index) && passJets(event))) {
+      ++nAccepted;
+      return true;
+    }
+    return false;
+  }
+
+  std::string describe() const {
+    std::ostringstream os;
+    os << "pids=";
+    for (size_t i = 0; i < absPids.size(); ++i)
+      os << (i ? "," : "") << absPids[i];
+    os << " pTMin=" << pTMin << " pTMax=" << pTMax << " etaMax=" << etaMax
+       << " nMin=" << nMin << " nMax=" << nMax
+       << " leadJetPTMin=" << leadJetPTMin << " jetR=" << jetR
+       << " jetEtaMax=" << jetEtaMax;
+    return os.str();
+  }
+
+private:
+  bool configured = false;
+  std::unique_ptr<Pythia8::SlowJet> slowJet;
+
+  static std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return (b == std::string::npos) ? "" : s.substr(b, e - b + 1);
+  }
+
+  bool passParticles(const Pythia8::Event &event,
+                     const PidIndex *index = nullptr) const {
+    if (absPids.empty())
+      return true;
+    int n = 0;
+    if (index) {
+      for (int pid : absPids)
+        for (int i : index->find(pid))
+          n += passKinematics(event, i);
+    } else {
+      for (int i = 0; i < event.size(); ++i)
+        if (std::find(absPids.begin(), absPids.end(), event[i].idAbs()) !=
+            absPids.end())
+          n += passKinematics(event, i);
+    }
+    return n >= nMin && (nMax < 0 || n <= nMax);
+  }
+
+  bool passKinematics(const Pythia8::Event &event, int i) const {
+    const Pythia8::Particle &p = event[i];
+    // Count each particle once, in its last (post-recoil) copy
+    if (p.iBotCopyId() != i)
+      return false;
+    if (p.pT() < pTMin || (pTMax > 0. && p.pT() > pTMax))
+      return false;
+    if (etaMax > 0. && std::abs(p.eta()) > etaMax)
+      return false;
+    return true;
+  }
+
+  bool passJets(const Pythia8::Event &event) {
+    if (leadJetPTMin <= 0.)
+      return true;
+    // Anti-kT (power -1) on all visible final-state particles
+    if (!slowJet)
+      slowJet = std::make_unique<Pythia8::SlowJet>(-1, jetR, leadJetPTMin,
+                                                   jetEtaMax, 2);
+    slowJet->analyze(event);
+    return slowJet->sizeJet() > 0 && slowJet->pT(0) >= leadJetPTMin;
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_EVENT_FILTER_H
@@ -0,0 +1,130 @@
+// =============================================================================
+// event_index.h
+// -----------------------------------------------------------------------------
+// Sidecar index for HepMC3 Asciiv3 outputs.
+//
+// Next to every regular-file output "x.hepmc3" the generators write
+// "x.hepmc3.idx", a flat binary table with one fixed-size record per event:
+//
+//   [EventIndexHeader][EventIndexRecord x nEvents]
+//
+// Each record holds the byte range of the event in the HepMC3 file and a few
+// summary fields, so a reader can seek to any event, split a file into
+// ranges for parallel jobs or select events by summary without parsing the
+// HepMC3 text. Records are appended as events are written; nEvents and the
+// HepMC3 size in the header are filled in at close, and a reader of an
+// unfinished index takes the record count from the file size.
+//
+// The layout is little-endian and fixed (48-byte records), readable from
+// Python with struct / numpy (scripts/hepmc3_index.py).
+// =============================================================================
+
+#ifndef HEPGEN_EVENT_INDEX_H
+#define HEPGEN_EVENT_INDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hepgen {
+
+constexpr char kEventIndexMagic[8] = {'H', 'E', 'P', 'G', 'I', 'D', 'X', '1'};
+
+struct EventIndexHeader {
+  char magic[8];
+  uint32_t recordSize;
+  uint32_t reserved;
+  uint64_t nEvents;    // 0 while the file is being written
+  uint64_t hepmcBytes; // size of the HepMC3 file at close
+};
+
+struct EventIndexRecord {
+  uint64_t offset;     // byte offset of the "E" line
+  uint64_t length;     // bytes up to the next event or the footer
+  int64_t eventNumber; // HepMC3 event number (global index when seeded)
+  double weight;       // nominal event weight
+  float leadingJetPt;  // anti-kT R = 0.4, |eta| < 5, 0 if none above 5 GeV
+  float b;             // impact parameter [fm], -1 without heavy ions
+  uint16_t nJpsi;      // J/psi (443), each once
+  uint16_t nDstar;     // D*+- (413), each once
+  uint32_t reserved;
+};
+
+static_assert(sizeof(EventIndexHeader) == 32, "index header layout");
+static_assert(sizeof(EventIndexRecord) == 48, "index record layout");
+
+inline std::string eventIndexPath(const std::string &hepmcPath) {
+  return hepmcPath + ".idx";
+}
+
+// Read-only, memory-mapped view of an index file
+class EventIndex {
+public:
+  explicit EventIndex(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return; // no index: callers fall back to a sequential scan
+    struct stat st;
+    if (::fstat(fd, &st) == 0 &&
+        size_t(st.st_size) >= sizeof(EventIndexHeader))
+      mapSize = size_t(st.st_size);
+    if (mapSize > 0) {
+      void *addr = ::mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+      base = (addr == MAP_FAILED) ? nullptr : static_cast<const char *>(addr);
+    }
+    ::close(fd);
+    if (!base) {
+      std::cerr << "Cannot map event index " << path << std::endl;
+      return;
+    }
+    header = reinterpret_cast<const EventIndexHeader *>(base);
+    if (std::memcmp(header->magic, kEventIndexMagic, sizeof(header->magic)) !=
+            0 ||
+        header->recordSize != sizeof(EventIndexRecord)) {
+      std::cerr << "Not a valid event index: " << path << std::endl;
+      header = nullptr;
+      return;
+    }
+    nRecords = (mapSize - sizeof(EventIndexHeader)) / sizeof(EventIndexRecord);
+    if (header->nEvents > 0 && header->nEvents < nRecords)
+      nRecords = header->nEvents;
+    records = reinterpret_cast<const EventIndexRecord *>(
+        base + sizeof(EventIndexHeader));
+  }
+  ~EventIndex() {
+    if (base)
+      ::munmap(const_cast<char *>(base), mapSize);
+  }
+  EventIndex(const EventIndex &) = delete;
+  EventIndex &operator=(const EventIndex &) = delete;
+
+  bool ok() const { return header != nullptr; }
+  bool complete() const { return header && header->nEvents > 0; }
+  size_t size() const { return header ? nRecords : 0; }
+  const EventIndexRecord &record(size_t i) const { return records[i]; }
+
+  // False if the HepMC3 file changed since the index was closed
+  bool matches(const std::string &hepmcPath) const {
+    struct stat st;
+    if (!header || ::stat(hepmcPath.c_str(), &st) != 0)
+      return false;
+    return !complete() || uint64_t(st.st_size) == header->hepmcBytes;
+  }
+
+private:
+  const char *base = nullptr;
+  size_t mapSize = 0;
+  size_t nRecords = 0;
+  const EventIndexHeader *header = nullptr;
+  const EventIndexRecord *records = nullptr;
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_EVENT_INDEX_H
@@ -0,0 +1,128 @@
+// =============================================================================
+// event_index_writer.h
+// -----------------------------------------------------------------------------
+// Writes the sidecar index (event_index.h) alongside a HepMC3 output
+// (HepMC3Output, hepmc3_pool.h).
+//
+// The summary fields are computed from pythia.event as written:
+// J/psi and D* counts (bottom copies), the leading anti-kT R = 0.4 jet on
+// the visible final state, and the impact parameter for heavy ions.
+//
+// Usage:
+//   auto index = hepgen::EventIndexWriter::open(outFile); // null for FIFOs
+//   ...
+//   writer->write(hepmcEvent);
+//   if (index) index->add(*writer, hepmcEvent, pythia);
+//   ...
+//   writer->close();
+//   if (index) index->close(*writer);
+// =============================================================================
+
+#ifndef HEPGEN_EVENT_INDEX_WRITER_H
+#define HEPGEN_EVENT_INDEX_WRITER_H
+
+#include "Pythia8/Pythia.h"
+
+#include "event_index.h"
+#include "hepmc3_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <sys/stat.h>
+
+namespace hepgen {
+
+class EventIndexWriter {
+public:
+  // Index for a HepMC3 output that is already open. Returns nullptr for
+  // outputs that are not regular files (FIFOs, /dev/null), where byte
+  // offsets mean nothing.
+  static std::unique_ptr<EventIndexWriter> open(const std::string &hepmcPath) {
+    struct stat st;
+    if (::stat(hepmcPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      return nullptr;
+    std::unique_ptr<EventIndexWriter> index(
+        new EventIndexWriter(eventIndexPath(hepmcPath)));
+    if (!index->file)
+      return nullptr;
+    return index;
+  }
+  ~EventIndexWriter() {
+    if (file)
+      std::fclose(file);
+  }
+
+  // Record the event just written by writer
+  void add(const HepMC3Output &writer, const PooledHepMC3Event &hepmc,
+           const Pythia8::Pythia &pythia) {
+    EventIndexRecord rec = {};
+    rec.offset = writer.lastEventOffset();
+    rec.length = writer.offset() - rec.offset;
+    rec.eventNumber = hepmc.eventNumber;
+    rec.weight = hepmc.weights.empty() ? 1. : hepmc.weights[0];
+    rec.b = pythia.info.hiInfo ? float(pythia.info.hiInfo->b()) : -1.f;
+
+    const Pythia8::Event &event = pythia.event;
+    unsigned nJpsi = 0, nDstar = 0;
+    for (int i = 0; i < event.size(); ++i) {
+      int idAbs = event[i].idAbs();
+      if ((idAbs == 443 || idAbs == 413) && event[i].iBotCopyId() == i)
+        ++(idAbs == 443 ? nJpsi : nDstar);
+    }
+    rec.nJpsi = uint16_t(std::min(nJpsi, 65535u));
+    rec.nDstar = uint16_t(std::min(nDstar, 65535u));
+
+    slowJet.analyze(event);
+    rec.leadingJetPt = slowJet.sizeJet() > 0 ? float(slowJet.pT(0)) : 0.f;
+
+    std::fwrite(&rec, sizeof(rec), 1, file);
+    ++nEvents;
+  }
+
+  // Finalize the header; call after writer.close()
+  void close(const HepMC3Output &writer) {
+    if (!file)
+      return;
+    EventIndexHeader header = makeHeader();
+    header.nEvents = nEvents;
+    header.hepmcBytes = writer.offset();
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fclose(file);
+    file = nullptr;
+  }
+
+  const std::string &path() const { return indexPath; }
+
+private:
+  std::FILE *file;
+  std::string indexPath;
+  uint64_t nEvents = 0;
+  Pythia8::SlowJet slowJet; // anti-kT R = 0.4, pT > 5 GeV, |eta| < 5
+
+  explicit EventIndexWriter(const std::string &pathIn)
+      : file(std::fopen(pathIn.c_str(), "wb")), indexPath(pathIn),
+        slowJet(-1, 0.4, 5., 5.0, 2, 2) {
+    if (!file) {
+      std::cerr << "Cannot open event index " << indexPath << std::endl;
+      return;
+    }
+    EventIndexHeader header = makeHeader();
+    std::fwrite(&header, sizeof(header), 1, file);
+  }
+
+  static EventIndexHeader makeHeader() {
+    EventIndexHeader header = {};
+    std::memcpy(header.magic, kEventIndexMagic, sizeof(header.magic));
+    header.recordSize = sizeof(EventIndexRecord);
+    return header;
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_EVENT_INDEX_WRITER_H
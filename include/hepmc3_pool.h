@@ -0,0 +1,637 @@
+// =============================================================================
+// hepmc3_pool.h
+// -----------------------------------------------------------------------------
+// Allocation-free Pythia8 -> HepMC3 Asciiv3 conversion.
+//
+// Pythia8ToHepMC3 builds a HepMC3::GenEvent graph per event, i.e. one
+// shared_ptr per particle and vertex plus the vectors linking them. Here the
+// event record is converted into a pooled, flat event (plain vectors reused
+// across events) and written straight to the Asciiv3 text format, so after
+// the first few events conversion and writing do not touch the allocator.
+//
+// The vertex structure follows Pythia8ToHepMC3: a particle is attached to the
+// end vertex of its first mother that already has one, otherwise a new vertex
+// is created with all mothers as incoming particles. HepMC3 particle ids are
+// the Pythia event indices, so entries can be matched to pythia.event.
+//
+// Two writers take the pooled event, behind the HepMC3Output interface:
+//   - HepMC3AsciiWriter (default): builds a reused HepMC3::GenEvent from it
+//     (toGenEvent) and writes with HepMC3::WriterAscii
+//   - PooledHepMC3Writer (opt-in, --pooled-hepmc): formats Asciiv3 directly,
+//     without GenParticle/GenVertex objects. tests/test_hepmc3_pool.cc reads
+//     its output back with HepMC3::ReaderAscii and compares it with the
+//     GenEvents.
+// =============================================================================
+
+#ifndef HEPGEN_HEPMC3_POOL_H
+#define HEPGEN_HEPMC3_POOL_H
+
+#include "Pythia8/Pythia.h"
+
+#include "HepMC3/Attribute.h"
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenParticle.h"
+#include "HepMC3/GenRunInfo.h"
+#include "HepMC3/GenVertex.h"
+#include "HepMC3/Version.h"
+#include "HepMC3/WriterAscii.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace hepgen {
+
+// Flat event storage, reused from one event to the next
+class PooledHepMC3Event {
+public:
+  struct Particle {
+    int pid, status;
+    double px, py, pz, e, m;
+    int prodVertex; // index into vertices, -1 = none (beams)
+  };
+  struct Vertex {
+    double x, y, z, t;
+    std::vector<int> in; // incoming particle ids, capacity is kept
+  };
+
+  long eventNumber = 0;
+  std::vector<Particle> particles; // index = HepMC3 id (0 unused)
+  std::vector<Vertex> vertices;
+  std::vector<double> weights;
+
+  size_t nVertices() const { return nVert; }
+  size_t nParticles() const {
+    return particles.empty() ? 0 : particles.size() - 1;
+  }
+  size_t nAttributes() const { return nAttr; }
+  const std::string &attributeName(size_t i) const { return attrs[i].name; }
+  const std::string &attributeValue(size_t i) const { return attrs[i].value; }
+
+  // Drop the content but keep every buffer's capacity
+  void clear() {
+    particles.clear();
+    for (size_t v = 0; v < nVert; ++v)
+      vertices[v].in.clear();
+    nVert = 0;
+    weights.clear();
+    nAttr = 0;
+  }
+
+  // Event-level attributes ("A 0 <name> <value>"); strings are reused
+  void setAttribute(const char *name, const std::string &value) {
+    Attr &a = nextAttr(name);
+    a.value.assign(value);
+  }
+  void setAttribute(const char *name, const char *value) {
+    Attr &a = nextAttr(name);
+    a.value.assign(value);
+  }
+  void setAttribute(const char *name, double value) {
+    Attr &a = nextAttr(name);
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    a.value.assign(buf, res.ptr);
+  }
+  void setAttribute(const char *name, long value) {
+    Attr &a = nextAttr(name);
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    a.value.assign(buf, res.ptr);
+  }
+  void setAttribute(const char *name, int value) {
+    setAttribute(name, long(value));
+  }
+
+  // Names matching the weights fill() stores, for the run information.
+  // Valid after pythia.init().
+  static std::vector<std::string> weightNames(const Pythia8::Pythia &pythia) {
+    std::vector<std::string> names{"Weight"};
+    for (int i = 1; i < pythia.info.numberOfWeights(); ++i)
+      names.push_back(pythia.info.weightNameByIndex(i));
+    return names;
+  }
+
+  // Convert the current Pythia event, including the standard attributes
+  // Pythia8ToHepMC3 stores (cross section, PDF info, process id, scales)
+  void fill(const Pythia8::Pythia &pythia) {
+    fillRecord(pythia.event);
+
+    ++eventNumber;
+    // Nominal weight first, then the named variations (UncertaintyBands)
+    weights.push_back(pythia.info.weight());
+    for (int i = 1; i < pythia.info.numberOfWeights(); ++i)
+      weights.push_back(pythia.info.weightValueByIndex(i));
+
+    // Cross section in pb, as HepMC3::GenCrossSection
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%.8e %.8e %ld %ld",
+                  pythia.info.sigmaGen() * 1e9, pythia.info.sigmaErr() * 1e9,
+                  pythia.info.nAccepted(), pythia.info.nTried());
+    setAttribute("GenCrossSection", buf);
+    std::snprintf(buf, sizeof(buf), "%d %d %.8e %.8e %.8e %.8e %.8e 0 0",
+                  pythia.info.id1pdf(), pythia.info.id2pdf(),
+                  pythia.info.x1pdf(), pythia.info.x2pdf(), pythia.info.QFac(),
+                  pythia.info.pdf1(), pythia.info.pdf2());
+    setAttribute("GenPdfInfo", buf);
+    setAttribute("signal_process_id", pythia.info.code());
+    setAttribute("event_scale", pythia.info.QRen());
+    setAttribute("alphaQCD", pythia.info.alphaS());
+    setAttribute("alphaQED", pythia.info.alphaEM());
+    setAttribute("mpi", pythia.info.nMPI());
+    if (pythia.info.hiInfo) {
+      setAttribute("impact_parameter", pythia.info.hiInfo->b());
+      setAttribute("ncoll", pythia.info.hiInfo->nCollTot() -
+                                pythia.info.hiInfo->nCollEL());
+    }
+  }
+
+  // Particles and vertices of an event record only; clears the weights and
+  // attributes and leaves the event number alone
+  void fillRecord(const Pythia8::Event &ev) {
+    const int n = ev.size();
+    clear();
+    particles.resize(n);
+    endVertex.assign(n, -1);
+
+    for (int i = 1; i < n; ++i) {
+      const Pythia8::Particle &p = ev[i];
+      Particle &out = particles[i];
+      out.pid = p.id();
+      out.status = p.statusHepMC();
+      out.px = p.px();
+      out.py = p.py();
+      out.pz = p.pz();
+      out.e = p.e();
+      out.m = p.m();
+      out.prodVertex = -1;
+
+      collectMothers(p);
+      int v = -1;
+      for (int m : mothers)
+        if (endVertex[m] >= 0) {
+          v = endVertex[m];
+          break;
+        }
+      bool hasPos = p.xProd() != 0. || p.yProd() != 0. || p.zProd() != 0. ||
+                    p.tProd() != 0.;
+      if (v < 0 && (!mothers.empty() || hasPos))
+        v = newVertex();
+      if (v < 0)
+        continue;
+      Vertex &vtx = vertices[v];
+      if (hasPos && vtx.x == 0. && vtx.y == 0. && vtx.z == 0. && vtx.t == 0.) {
+        vtx.x = p.xProd();
+        vtx.y = p.yProd();
+        vtx.z = p.zProd();
+        vtx.t = p.tProd();
+      }
+      for (int m : mothers)
+        if (endVertex[m] < 0) {
+          endVertex[m] = v;
+          vtx.in.push_back(m);
+        }
+      out.prodVertex = v;
+    }
+  }
+
+private:
+  struct Attr {
+    std::string name, value;
+  };
+  std::vector<Attr> attrs;
+  size_t nAttr = 0;
+  size_t nVert = 0;
+  std::vector<int> endVertex; // Pythia index -> end vertex, -1 = none
+  std::vector<int> mothers;
+
+  Attr &nextAttr(const char *name) {
+    if (nAttr == attrs.size())
+      attrs.emplace_back();
+    Attr &a = attrs[nAttr++];
+    a.name.assign(name);
+    return a;
+  }
+
+  int newVertex() {
+    if (nVert == vertices.size())
+      vertices.emplace_back();
+    Vertex &vtx = vertices[nVert];
+    vtx.x = vtx.y = vtx.z = vtx.t = 0.;
+    return int(nVert++);
+  }
+
+  // Same content as Particle::motherList(), without allocating, and with
+  // the "no mother" index 0 dropped
+  void collectMothers(const Pythia8::Particle &p) {
+    mothers.clear();
+    int m1 = p.mother1(), m2 = p.mother2();
+    int statusAbs = std::abs(p.status());
+    if (statusAbs == 11 || statusAbs == 12 || (m1 == 0 && m2 == 0))
+      return;
+    if (m2 == 0 || m2 == m1) {
+      mothers.push_back(m1);
+    } else if ((statusAbs > 80 && statusAbs < 90) ||
+               (statusAbs > 100 && statusAbs < 107)) {
+      for (int m = m1; m <= m2; ++m)
+        mothers.push_back(m);
+    } else {
+      mothers.push_back(std::min(m1, m2));
+      mothers.push_back(std::max(m1, m2));
+    }
+    // Drop the system entry, keep order
+    size_t k = 0;
+    for (int m : mothers)
+      if (m > 0)
+        mothers[k++] = m;
+    mothers.resize(k);
+  }
+};
+
+// The same event as a HepMC3::GenEvent, as Pythia8ToHepMC3 would build it:
+// particle ids are the pooled ids, vertex v gets id -(v + 1), particles
+// without production vertex (the beams) hang off the root vertex, and the
+// attributes are stored as strings
+inline void toGenEvent(const PooledHepMC3Event &in, HepMC3::GenEvent &out) {
+  out.clear();
+  out.set_units(HepMC3::Units::GEV, HepMC3::Units::MM);
+  out.set_event_number(int(in.eventNumber));
+  out.weights() = in.weights;
+
+  std::vector<HepMC3::GenParticlePtr> particles(in.particles.size());
+  for (size_t i = 1; i < in.particles.size(); ++i) {
+    const PooledHepMC3Event::Particle &p = in.particles[i];
+    particles[i] = std::make_shared<HepMC3::GenParticle>(
+        HepMC3::FourVector(p.px, p.py, p.pz, p.e), p.pid, p.status);
+    particles[i]->set_generated_mass(p.m);
+  }
+  std::vector<HepMC3::GenVertexPtr> vertices(in.nVertices());
+  for (size_t v = 0; v < in.nVertices(); ++v) {
+    const PooledHepMC3Event::Vertex &vtx = in.vertices[v];
+    vertices[v] = std::make_shared<HepMC3::GenVertex>(
+        HepMC3::FourVector(vtx.x, vtx.y, vtx.z, vtx.t));
+    for (int m : vtx.in)
+      vertices[v]->add_particle_in(particles[m]);
+  }
+  for (size_t i = 1; i < in.particles.size(); ++i)
+    if (in.particles[i].prodVertex >= 0)
+      vertices[in.particles[i].prodVertex]->add_particle_out(particles[i]);
+
+  // Particles first, in order, so that their ids are the pooled ids
+  for (size_t i = 1; i < in.particles.size(); ++i)
+    out.add_particle(particles[i]);
+  for (const auto &vtx : vertices)
+    out.add_vertex(vtx);
+  for (size_t a = 0; a < in.nAttributes(); ++a)
+    out.add_attribute(in.attributeName(a),
+                      std::make_shared<HepMC3::StringAttribute>(
+                          in.attributeValue(a)));
+}
+
+// Asciiv3 output of pooled events, written by one of the two classes below
+class HepMC3Output {
+public:
+  virtual ~HepMC3Output() = default;
+
+  // Not opened, or a write fell short (disk full, consumer of a FIFO gone);
+  // still valid after close()
+  virtual bool failed() const = 0;
+  virtual void write(const PooledHepMC3Event &evt) = 0;
+  virtual void close() = 0;
+
+  // Run information, written before the first event
+  void setWeightNames(const std::vector<std::string> &names) {
+    weightNames = names;
+  }
+  void addRunAttribute(const std::string &name, const std::string &value) {
+    runAttributes.emplace_back(name, value);
+  }
+  // Run information only known at the end (final counters): written at
+  // close as run attributes after the end-of-listing line, where
+  // HepMC3::ReaderAscii still reads them into the run info
+  void addTrailerAttribute(const std::string &name, const std::string &value) {
+    trailerAttributes.emplace_back(name, value);
+  }
+
+  // Byte offset at which the next event will start
+  uint64_t offset() const { return bytesWritten; }
+  // Byte offset of the "E" line of the last event written
+  uint64_t lastEventOffset() const { return lastEvent; }
+  long eventsWritten() const { return nEvents; }
+
+protected:
+  std::vector<std::string> weightNames{"Weight"};
+  std::vector<std::pair<std::string, std::string>> runAttributes;
+  std::vector<std::pair<std::string, std::string>> trailerAttributes;
+  uint64_t bytesWritten = 0;
+  uint64_t lastEvent = 0;
+  long nEvents = 0;
+
+  std::string trailer() const {
+    std::string text;
+    for (const auto &attr : trailerAttributes)
+      text += "A " + attr.first + ' ' + attr.second + '\n';
+    return text;
+  }
+};
+
+// Default output: every event is converted to a reused HepMC3::GenEvent and
+// written by HepMC3::WriterAscii. The WriterAscii is created at the first
+// event (or at close), once the run information is complete.
+class HepMC3AsciiWriter : public HepMC3Output {
+public:
+  explicit HepMC3AsciiWriter(const std::string &pathIn)
+      : path(pathIn), stream(pathIn) {
+    if (!stream) {
+      std::cerr << "Cannot open HepMC3 output " << path << std::endl;
+      writeFailed = true;
+    }
+  }
+  ~HepMC3AsciiWriter() override { close(); }
+
+  bool failed() const override { return writeFailed; }
+
+  void write(const PooledHepMC3Event &evt) override {
+    if (!stream.is_open())
+      return;
+    if (!writer)
+      start();
+    lastEvent = position();
+    toGenEvent(evt, event);
+    event.set_run_info(runInfo);
+    writer->write_event(event);
+    bytesWritten = position();
+    // WriterAscii keeps the run-info lines from its constructor in its own
+    // buffer (no public flush) and writes them together with the first
+    // event, so that event starts at its "E" line, further on
+    if (nEvents == 0)
+      lastEvent = findEventLine(lastEvent, bytesWritten);
+    ++nEvents;
+  }
+
+  void close() override {
+    if (!stream.is_open())
+      return;
+    if (!writer)
+      start();
+    writer->close(); // writes the footer; sink is no ofstream, so stays open
+    stream << trailer();
+    stream.close();
+    if (!sink || !stream) {
+      std::cerr << "Cannot write HepMC3 output " << path << std::endl;
+      writeFailed = true;
+    }
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+      bytesWritten = uint64_t(st.st_size);
+  }
+
+private:
+  std::string path;
+  bool writeFailed = false;
+  std::ofstream stream;
+  // Plain ostream on the file buffer for WriterAscii, which would close an
+  // ofstream before the trailer is written
+  std::ostream sink{stream.rdbuf()};
+  std::shared_ptr<HepMC3::GenRunInfo> runInfo;
+  std::unique_ptr<HepMC3::WriterAscii> writer;
+  HepMC3::GenEvent event;
+
+  void start() {
+    runInfo = std::make_shared<HepMC3::GenRunInfo>();
+    runInfo->set_weight_names(weightNames);
+    for (const auto &attr : runAttributes)
+      runInfo->add_attribute(
+          attr.first, std::make_shared<HepMC3::StringAttribute>(attr.second));
+    writer = std::make_unique<HepMC3::WriterAscii>(sink, runInfo);
+  }
+
+  // WriterAscii flushes its buffer after every event, so the stream position
+  // is the file offset; FIFOs have none
+  uint64_t position() {
+    std::streamoff pos = stream.tellp();
+    return pos < 0 ? bytesWritten : uint64_t(pos);
+  }
+
+  // Offset of the first line starting with "E " in [from, to) of the file,
+  // from if there is none or the output is not a regular file
+  uint64_t findEventLine(uint64_t from, uint64_t to) {
+    if (to <= from)
+      return from;
+    stream.flush();
+    std::ifstream in(path, std::ios::binary);
+    std::string text(size_t(to - from), '\0');
+    if (!in.seekg(std::streamoff(from)) || !in.read(&text[0], text.size()))
+      return from;
+    if (text.compare(0, 2, "E ") == 0)
+      return from;
+    size_t at = text.find("\nE ");
+    return at == std::string::npos ? from : from + at + 1;
+  }
+};
+
+// Opt-in output (--pooled-hepmc): Asciiv3 formatted directly from the pooled
+// event, as WriterAscii would write it. Output is buffered in a reused string
+// and handed to stdio in large blocks; works on regular files and FIFOs.
+class PooledHepMC3Writer : public HepMC3Output {
+public:
+  explicit PooledHepMC3Writer(const std::string &path, int precisionIn = 16,
+                              size_t bufferSize = size_t(1) << 22)
+      : precision(precisionIn) {
+    file = std::fopen(path.c_str(), "w");
+    if (!file) {
+      std::cerr << "Cannot open HepMC3 output " << path << std::endl;
+      writeFailed = true;
+      return;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, bufferSize);
+    buf.reserve(size_t(1) << 20);
+    buf = "HepMC::Version ";
+    buf += HEPMC3_VERSION;
+    buf += "\nHepMC::Asciiv3-START_EVENT_LISTING\n";
+    flush();
+  }
+  ~PooledHepMC3Writer() override { close(); }
+
+  bool failed() const override { return writeFailed; }
+
+  void write(const PooledHepMC3Event &evt) override {
+    if (!file)
+      return;
+    if (nEvents == 0)
+      writeRunInfo();
+
+    lastEvent = bytesWritten + buf.size();
+    put("E ");
+    putInt(evt.eventNumber);
+    put(' ');
+    putInt(long(evt.nVertices()));
+    put(' ');
+    putInt(long(evt.nParticles()));
+    put("\nU GEV MM\n");
+    if (!evt.weights.empty()) {
+      put('W');
+      for (double w : evt.weights)
+        putDouble(w);
+      put('\n');
+    }
+    for (size_t a = 0; a < evt.nAttributes(); ++a) {
+      put("A 0 ");
+      put(evt.attributeName(a));
+      put(' ');
+      put(evt.attributeValue(a));
+      put('\n');
+    }
+
+    // Vertices are written just before their first outgoing particle. A
+    // vertex with one incoming particle and no position stays implicit: the
+    // particle then names its parent particle instead of the vertex.
+    vertexWritten.assign(evt.nVertices(), 0);
+    const size_t n = evt.particles.size();
+    for (size_t i = 1; i < n; ++i) {
+      const PooledHepMC3Event::Particle &p = evt.particles[i];
+      long parent = 0;
+      if (p.prodVertex >= 0) {
+        const PooledHepMC3Event::Vertex &v = evt.vertices[p.prodVertex];
+        bool hasPos = v.x != 0. || v.y != 0. || v.z != 0. || v.t != 0.;
+        if (v.in.size() == 1 && !hasPos) {
+          parent = v.in[0];
+        } else {
+          parent = -(p.prodVertex + 1);
+          if (!vertexWritten[p.prodVertex]) {
+            vertexWritten[p.prodVertex] = 1;
+            writeVertex(parent, v, hasPos);
+          }
+        }
+      }
+      put("P ");
+      putInt(long(i));
+      put(' ');
+      putInt(parent);
+      put(' ');
+      putInt(p.pid);
+      putDouble(p.px);
+      putDouble(p.py);
+      putDouble(p.pz);
+      putDouble(p.e);
+      putDouble(p.m);
+      put(' ');
+      putInt(p.status);
+      put('\n');
+    }
+    ++nEvents;
+    flush();
+  }
+
+  void close() override {
+    if (!file)
+      return;
+    buf = "HepMC::Asciiv3-END_EVENT_LISTING\n\n";
+    buf += trailer();
+    flush();
+    if (std::fclose(file) != 0 && !writeFailed) {
+      std::cerr << "Cannot write HepMC3 output" << std::endl;
+      writeFailed = true;
+    }
+    file = nullptr;
+  }
+
+private:
+  std::FILE *file = nullptr;
+  bool writeFailed = false;
+  int precision;
+  std::string buf;
+  std::vector<char> vertexWritten;
+
+  void put(char c) { buf.push_back(c); }
+  void put(const char *s) { buf.append(s); }
+  void put(const std::string &s) { buf.append(s); }
+  void putInt(long v) {
+    char tmp[24];
+    auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    buf.append(tmp, res.ptr);
+  }
+  // " %.<precision>e", as HepMC3::WriterAscii
+  void putDouble(double v) {
+    char tmp[40];
+    tmp[0] = ' ';
+    auto res = std::to_chars(tmp + 1, tmp + sizeof(tmp), v,
+                             std::chars_format::scientific, precision);
+    buf.append(tmp, res.ptr);
+  }
+
+  void writeVertex(long id, const PooledHepMC3Event::Vertex &v, bool hasPos) {
+    put("V ");
+    putInt(id);
+    put(" 0 [");
+    for (size_t k = 0; k < v.in.size(); ++k) {
+      if (k)
+        put(',');
+      putInt(v.in[k]);
+    }
+    put(']');
+    if (hasPos) {
+      put(" @");
+      putDouble(v.x);
+      putDouble(v.y);
+      putDouble(v.z);
+      putDouble(v.t);
+    }
+    put('\n');
+  }
+
+  void writeRunInfo() {
+    put('W');
+    for (const auto &name : weightNames) {
+      put(' ');
+      put(name);
+    }
+    put('\n');
+    for (const auto &attr : runAttributes) {
+      put("A ");
+      put(attr.first);
+      put(' ');
+      put(attr.second);
+      put('\n');
+    }
+  }
+
+  void flush() {
+    if (!writeFailed &&
+        std::fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
+      std::cerr << "Cannot write HepMC3 output" << std::endl;
+      writeFailed = true;
+    }
+    bytesWritten += buf.size();
+    buf.clear();
+  }
+};
+
+// Asciiv3 output at path: HepMC3AsciiWriter, or PooledHepMC3Writer when
+// pooled. Null if the file cannot be opened.
+inline std::unique_ptr<HepMC3Output> openHepMC3Output(const std::string &path,
+                                                      bool pooled) {
+  std::unique_ptr<HepMC3Output> out;
+  if (pooled)
+    out = std::make_unique<PooledHepMC3Writer>(path);
+  else
+    out = std::make_unique<HepMC3AsciiWriter>(path);
+  if (out->failed())
+    return nullptr;
+  return out;
+}
+
+} // namespace hepgen
+
+#endif // HEPGEN_HEPMC3_POOL_H
@@ -0,0 +1,385 @@
+// =============================================================================
+// hepmc3_skim.h
+// -----------------------------------------------------------------------------
+// Selective HepMC3 Asciiv3 reader.
+//
+// HepMC3::ReaderAscii builds the full GenEvent graph of every event, one
+// particle and vertex object per entry, although an analysis of a few
+// species touches a tiny fraction of a Pb-Pb record. SkimReaderAscii works
+// on the event text instead:
+//
+//   - events without any particle of the requested |PID|s are skipped after
+//     reading the PID field of each P line; no objects are built
+//   - in a matching event only the requested particles, their direct decay
+//     products and all their ancestors are materialized, with the vertices
+//     linking them, so production_vertex() / particles_in() chains and
+//     end_vertex() / particles_out() of the requested particles work as
+//     in the full record
+//   - event number, weights and event attributes ("A 0" lines, as
+//     unparsed strings: use GenEvent::attribute_as_string) are kept
+//   - with a sidecar index (event_index.h), readEventAt() reads single
+//     events by byte offset, so events can be skipped unread
+//
+// Particle and vertex ids are not preserved. Units are assumed GEV MM, as
+// written by the generators here.
+//
+// Usage:
+//   hepgen::SkimReaderAscii reader("events.hepmc3", {413});
+//   HepMC3::GenEvent event;
+//   while (reader.readEvent(event)) { ... }
+// =============================================================================
+
+#ifndef HEPGEN_HEPMC3_SKIM_H
+#define HEPGEN_HEPMC3_SKIM_H
+
+#include "HepMC3/Attribute.h"
+#include "HepMC3/FourVector.h"
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenParticle.h"
+#include "HepMC3/GenVertex.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hepgen {
+
+class SkimReaderAscii {
+public:
+  SkimReaderAscii(const std::string &path, const std::vector<int> &absPids)
+      : in(path), species(absPids) {
+    if (!in) {
+      std::cerr << "Cannot open " << path << std::endl;
+      return;
+    }
+    // Header up to the first event
+    bool asciiv3 = false;
+    while (std::getline(in, pending)) {
+      if (pending.compare(0, 34, "HepMC::Asciiv3-START_EVENT_LISTING") == 0)
+        asciiv3 = true;
+      if (pending.compare(0, 2, "E ") == 0)
+        break;
+    }
+    if (!asciiv3) {
+      std::cerr << path << ": not a HepMC3 Asciiv3 file" << std::endl;
+      in.close();
+      return;
+    }
+    good = true;
+  }
+
+  bool ok() const { return good; }
+
+  // Next event with at least one requested particle; false at end of file
+  bool readEvent(HepMC3::GenEvent &event) {
+    while (good && readBlock()) {
+      ++nScanned;
+      nParticlesScanned += long(particles.size()) - 1;
+      if (!hasMatch) {
+        ++nSkipped;
+        continue;
+      }
+      materialize(event);
+      return true;
+    }
+    return false;
+  }
+
+  // The event starting at byte offset (from the sidecar index,
+  // event_index.h); false if it has no requested particle
+  bool readEventAt(uint64_t offset, HepMC3::GenEvent &event) {
+    if (!good)
+      return false;
+    in.clear();
+    in.seekg(std::streamoff(offset));
+    if (!std::getline(in, pending) || !readBlock())
+      return false;
+    ++nScanned;
+    nParticlesScanned += long(particles.size()) - 1;
+    if (!hasMatch)
+      return false;
+    materialize(event);
+    return true;
+  }
+
+  long eventsScanned() const { return nScanned; }
+  long eventsSkipped() const { return nSkipped; }
+  long particlesScanned() const { return nParticlesScanned; }
+  long particlesMaterialized() const { return nMaterialized; }
+
+private:
+  // Compact view of one P or V line; the line is only parsed in full for
+  // entries that are materialized
+  struct Entry {
+    int pid = 0;
+    int parent = 0;  // P: > 0 parent particle, < 0 vertex, 0 none
+    size_t line = 0; // offset of the line in block
+  };
+
+  std::ifstream in;
+  std::vector<int> species;
+  bool good = false;
+  std::string pending; // "E" line of the next event
+  std::string line;
+
+  // Current event
+  std::string block;
+  bool hasMatch = false;
+  std::vector<Entry> particles; // index = HepMC3 particle id (0 unused)
+  std::unordered_map<int, size_t> vertexLines; // vertex id -> line offset
+  std::vector<size_t> attributeLines;
+  size_t weightLine = std::string::npos;
+
+  // Materialization
+  std::vector<char> needed;
+  std::vector<int> stack;
+  std::vector<int> vertexIn;
+  std::vector<int> decayVertices;
+  std::vector<HepMC3::GenParticlePtr> made;
+  std::unordered_map<int, HepMC3::GenVertexPtr> vertices;
+
+  long nScanned = 0, nSkipped = 0;
+  long nParticlesScanned = 0, nMaterialized = 0;
+
+  bool wanted(int pid) const {
+    return std::find(species.begin(), species.end(), std::abs(pid)) !=
+           species.end();
+  }
+
+  // Read the lines of one event into block, index its P and V lines and
+  // check the PIDs. Only the first three fields of a P line are parsed.
+  bool readBlock() {
+    if (pending.compare(0, 2, "E ") != 0)
+      return false;
+    block.clear();
+    particles.assign(1, Entry());
+    vertexLines.clear();
+    attributeLines.clear();
+    weightLine = std::string::npos;
+    hasMatch = false;
+    block.append(pending).push_back('\n');
+    pending.clear();
+
+    while (std::getline(in, line)) {
+      if (line.compare(0, 2, "E ") == 0 || line.compare(0, 7, "HepMC::") == 0) {
+        pending.swap(line);
+        break;
+      }
+      size_t offset = block.size();
+      block.append(line).push_back('\n');
+      if (line.size() < 2 || line[1] != ' ')
+        continue;
+      const char *s = block.c_str() + offset + 2;
+      char *end;
+      switch (line[0]) {
+      case 'P': {
+        Entry p;
+        p.line = offset;
+        std::strtol(s, &end, 10); // id: particles are written in order
+        p.parent = int(std::strtol(end, &end, 10));
+        p.pid = int(std::strtol(end, &end, 10));
+        if (wanted(p.pid))
+          hasMatch = true;
+        particles.push_back(p);
+        break;
+      }
+      case 'V':
+        vertexLines[int(std::strtol(s, &end, 10))] = offset;
+        break;
+      case 'A':
+        if (s[0] == '0' && s[1] == ' ')
+          attributeLines.push_back(offset);
+        break;
+      case 'W':
+        weightLine = offset;
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Incoming particle ids of a vertex line "V id status [i1,i2,...] ..."
+  void parseVertexIn(size_t offset, std::vector<int> &ids) const {
+    ids.clear();
+    const char *s = block.c_str() + offset;
+    const char *open = std::strchr(s, '[');
+    const char *eol = std::strchr(s, '\n');
+    if (!open || open > eol)
+      return;
+    char *end = const_cast<char *>(open + 1);
+    while (*end != ']' && end < eol) {
+      int id = int(std::strtol(end, &end, 10));
+      if (id > 0)
+        ids.push_back(id);
+      if (*end == ',')
+        ++end;
+      else if (*end != ']')
+        break;
+    }
+  }
+
+  // Mark id and all its ancestors
+  void markAncestors(int id) {
+    stack.assign(1, id);
+    while (!stack.empty()) {
+      int i = stack.back();
+      stack.pop_back();
+      if (i <= 0 || i >= int(particles.size()) || needed[i])
+        continue;
+      needed[i] = 1;
+      int parent = particles[i].parent;
+      if (parent > 0) {
+        stack.push_back(parent);
+      } else if (parent < 0) {
+        auto it = vertexLines.find(parent);
+        if (it != vertexLines.end()) {
+          parseVertexIn(it->second, vertexIn);
+          stack.insert(stack.end(), vertexIn.begin(), vertexIn.end());
+        }
+      }
+    }
+  }
+
+  HepMC3::GenParticlePtr makeParticle(int i) {
+    const char *s = block.c_str() + particles[i].line + 2;
+    char *end;
+    std::strtol(s, &end, 10); // id
+    std::strtol(end, &end, 10); // parent
+    std::strtol(end, &end, 10); // pid
+    double px = std::strtod(end, &end);
+    double py = std::strtod(end, &end);
+    double pz = std::strtod(end, &end);
+    double e = std::strtod(end, &end);
+    double m = std::strtod(end, &end);
+    int status = int(std::strtol(end, &end, 10));
+    auto p = std::make_shared<HepMC3::GenParticle>(
+        HepMC3::FourVector(px, py, pz, e), particles[i].pid, status);
+    p->set_generated_mass(m);
+    return p;
+  }
+
+  // Production vertex of particle i: the explicit vertex (key < 0) or the
+  // implicit end vertex of its single parent (key = parent id)
+  HepMC3::GenVertexPtr vertexFor(int key) {
+    auto it = vertices.find(key);
+    if (it != vertices.end())
+      return it->second;
+    HepMC3::GenVertexPtr v;
+    if (key < 0) {
+      const char *s = block.c_str() + vertexLines[key] + 2;
+      char *end;
+      std::strtol(s, &end, 10); // id
+      int status = int(std::strtol(end, &end, 10));
+      const char *at = std::strchr(end, '@');
+      const char *eol = std::strchr(end, '\n');
+      HepMC3::FourVector pos;
+      if (at && at < eol) {
+        end = const_cast<char *>(at + 1);
+        double x = std::strtod(end, &end);
+        double y = std::strtod(end, &end);
+        double z = std::strtod(end, &end);
+        double t = std::strtod(end, &end);
+        pos = HepMC3::FourVector(x, y, z, t);
+      }
+      v = std::make_shared<HepMC3::GenVertex>(pos);
+      v->set_status(status);
+      parseVertexIn(vertexLines[key], vertexIn);
+      for (int id : vertexIn)
+        if (made[id])
+          v->add_particle_in(made[id]);
+    } else {
+      v = std::make_shared<HepMC3::GenVertex>();
+      v->add_particle_in(made[key]);
+    }
+    vertices.emplace(key, v);
+    return v;
+  }
+
+  void materialize(HepMC3::GenEvent &event) {
+    const int n = int(particles.size());
+    needed.assign(n, 0);
+
+    // Requested particles and their ancestors
+    for (int i = 1; i < n; ++i)
+      if (wanted(particles[i].pid))
+        markAncestors(i);
+
+    // Direct decay products of the requested particles (and their other
+    // parents, so a multi-parent vertex is complete). Each vertex line is
+    // parsed once to find the vertices the requested particles go into.
+    decayVertices.clear();
+    for (const auto &kv : vertexLines) {
+      parseVertexIn(kv.second, vertexIn);
+      for (int id : vertexIn)
+        if (id < n && wanted(particles[id].pid)) {
+          decayVertices.push_back(kv.first);
+          break;
+        }
+    }
+    for (int i = 1; i < n; ++i) {
+      int parent = particles[i].parent;
+      if (needed[i] || parent == 0)
+        continue;
+      if (parent > 0 ? parent < n && wanted(particles[parent].pid)
+                     : std::find(decayVertices.begin(), decayVertices.end(),
+                                 parent) != decayVertices.end())
+        markAncestors(i);
+    }
+
+    // Build the sparse event
+    event.clear();
+    event.set_event_number(
+        int(std::strtol(block.c_str() + 2, nullptr, 10)));
+    made.assign(n, nullptr);
+    vertices.clear();
+    for (int i = 1; i < n; ++i)
+      if (needed[i]) {
+        made[i] = makeParticle(i);
+        ++nMaterialized;
+      }
+    for (int i = 1; i < n; ++i)
+      if (made[i] && particles[i].parent != 0)
+        vertexFor(particles[i].parent)->add_particle_out(made[i]);
+    for (int i = 1; i < n; ++i)
+      if (made[i])
+        event.add_particle(made[i]);
+    for (auto &kv : vertices)
+      event.add_vertex(kv.second);
+
+    // Weights and event attributes
+    if (weightLine != std::string::npos) {
+      const char *s = block.c_str() + weightLine + 1;
+      char *end;
+      std::vector<double> &w = event.weights();
+      w.clear();
+      for (;;) {
+        double value = std::strtod(s, &end);
+        if (end == s)
+          break;
+        w.push_back(value);
+        s = end;
+      }
+    }
+    for (size_t offset : attributeLines) {
+      size_t nameBegin = offset + 4;
+      size_t nameEnd = block.find(' ', nameBegin);
+      size_t eol = block.find('\n', nameBegin);
+      if (nameEnd == std::string::npos || nameEnd > eol)
+        continue;
+      event.add_attribute(
+          block.substr(nameBegin, nameEnd - nameBegin),
+          std::make_shared<HepMC3::StringAttribute>(
+              block.substr(nameEnd + 1, eol - nameEnd - 1)));
+    }
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_HEPMC3_SKIM_H
@@ -0,0 +1,480 @@
+// =============================================================================
+// jpsijet_native.h
+// -----------------------------------------------------------------------------
+// In-process version of rivet/JpsiJet_RivetAnalyzer.cc.
+//
+// The Rivet path serializes every event to HepMC3 text, pipes it through a
+// FIFO and parses it again before clustering. Here the same selection runs
+// directly on the generator record:
+//
+//   - particle status, parents and children come from the pooled HepMC3
+//     event (hepmc3_pool.h), i.e. exactly the graph Rivet would read back
+//   - anti-kT R = 0.4 jets are clustered with Pythia's SlowJet on its fjcore
+//     backend (the FastJet core), from the same final-state particles
+//
+// Cuts, quirks included, follow the Rivet analysis line by line, so the two
+// can be compared bin by bin (scripts/compare_yoda.py). Keep both in sync.
+//
+// With several event weights (shower variations) every histogram exists
+// once per weight, named like Rivet's multi-weight output: the nominal one
+// as "/JpsiJet_RivetAnalyzer/zJpsi", variation v as ".../zJpsi[v]".
+//
+// Extra jet selections (JPSIJET_CONFIGS for Rivet, readSelections() here)
+// are filled in the same pass, as ".../zJpsi_<name>". The J/psi selection
+// and tagging are shared and the jets are clustered once per radius.
+//
+// Like Rivet, the analysis vetoes events whose J/psi comes from a b hadron.
+// setVetoNonPrompt(false) keeps them, for non-prompt samples (gen_bpkjpsi),
+// where every J/psi does; such results have no Rivet counterpart.
+// =============================================================================
+
+#ifndef HEPGEN_JPSIJET_NATIVE_H
+#define HEPGEN_JPSIJET_NATIVE_H
+
+#include "Pythia8/Pythia.h"
+
+#include "hepmc3_pool.h"
+#include "signal_selector.h"
+#include "yoda_writer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+// One jet selection of the analysis. The defaults are the built-in cuts.
+struct JpsiJetSelection {
+  std::string name;    // histogram suffix "_<name>"; empty when built in
+  double R = 0.4;      // anti-kT radius
+  double ptMin = 30.;  // jet pT window [GeV]
+  double ptMax = 40.;
+  double etaMax = 2.;  // jet acceptance
+  double dR2Max = 0.4; // J/psi-jet matching
+};
+
+class JpsiJetNativeAnalysis {
+public:
+  explicit JpsiJetNativeAnalysis(
+      const std::string &nameIn = "JpsiJet_RivetAnalyzer")
+      : name(nameIn), selections(1) {
+    book();
+  }
+
+  // One histogram set per event weight, in the order of
+  // PooledHepMC3Event::weightNames(); the first is the nominal weight.
+  // Call before the first event.
+  void setWeightNames(const std::vector<std::string> &names) {
+    weightSuffixes.clear();
+    for (size_t k = 0; k < names.size(); ++k)
+      weightSuffixes.push_back(k == 0 ? "" : "[" + names[k] + "]");
+    if (weightSuffixes.empty())
+      weightSuffixes.push_back("");
+    book();
+  }
+
+  // Add the jet selections of a card (runcards/jpsijet_configs.txt), the
+  // same file Rivet reads through JPSIJET_CONFIGS:
+  //   <name> <R> <pT min> <pT max> <|eta| max> <dR^2 max>
+  // Call before the first event.
+  bool readSelections(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cerr << "Cannot open jet selection card " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+      ++lineNo;
+      size_t hash = line.find('#');
+      if (hash != std::string::npos)
+        line.erase(hash);
+      std::istringstream is(line);
+      JpsiJetSelection sel;
+      if (!(is >> sel.name))
+        continue;
+      if (!(is >> sel.R >> sel.ptMin >> sel.ptMax >> sel.etaMax >>
+            sel.dR2Max)) {
+        std::cerr << path << ":" << lineNo
+                  << ": expected '<name> <R> <pT min> <pT max> <|eta| max> "
+                     "<dR^2 max>'"
+                  << std::endl;
+        return false;
+      }
+      bool valid = sel.R > 0. && sel.ptMin >= 0. && sel.ptMax > sel.ptMin;
+      for (char c : sel.name)
+        valid = valid && (std::isalnum(static_cast<unsigned char>(c)) ||
+                          c == '_');
+      for (const JpsiJetSelection &other : selections)
+        valid = valid && other.name != sel.name;
+      if (!valid) {
+        std::cerr << path << ":" << lineNo << ": invalid jet selection "
+                  << sel.name << std::endl;
+        return false;
+      }
+      selections.push_back(sel);
+    }
+    book();
+    return true;
+  }
+
+  // Veto events with a non-prompt J/psi, as the Rivet analysis does
+  void setVetoNonPrompt(bool veto) { vetoNonPrompt = veto; }
+
+  size_t nSelections() const { return selections.size(); }
+  size_t nClusterings() const { return jetFinders.size(); }
+
+  // Analyze one event. hepmc must have been filled from the same event.
+  void analyze(const Pythia8::Event &event, const PooledHepMC3Event &hepmc) {
+    weights = &hepmc.weights;
+    for (size_t k = 0; k < histos.size(); ++k)
+      histos[k].evtCount.fill(weight(k));
+    buildGraph(hepmc);
+
+    // J/psi: UnstableParticles(abspid 443, |eta| < 2.4, 6.5 < pT < 30)
+    jpsis.clear();
+    pidIndex.build(event);
+    for (int i : pidIndex.find(443))
+      if (isUnstableParticle(hepmc, i)) {
+        const auto &p = hepmc.particles[i];
+        double pT = perp(p);
+        if (std::abs(eta(p)) < 2.4 && pT > 6.5 && pT < 30.)
+          jpsis.push_back(i);
+      }
+    if (jpsis.empty())
+      return;
+    if (vetoNonPrompt && fromBottom(hepmc, jpsis[0]))
+      return;
+
+    fill(&Histos::hnJpsi, double(std::min<size_t>(jpsis.size(), 5)));
+    const auto &jpsi = hepmc.particles[jpsis[0]];
+    double pTJpsi = perp(jpsi);
+    fill(&Histos::hJpsipT, pTJpsi);
+
+    // Tag final-state particles that coincide with a J/psi decay product.
+    // Rivet compares fabs((eta - etaDau) < 1e-4), i.e. a signed eta
+    // difference; reproduced as is.
+    checkEta.clear();
+    checkPhi.clear();
+    for (int iJ : jpsis)
+      for (int c : children(iJ)) {
+        checkEta.push_back(eta(hepmc.particles[c]));
+        checkPhi.push_back(phi(hepmc.particles[c]));
+      }
+    tagged.assign(hepmc.particles.size(), 0);
+    for (size_t i = 1; i < hepmc.particles.size(); ++i) {
+      const auto &p = hepmc.particles[i];
+      int aid = std::abs(p.pid);
+      if (p.status != 1 || aid == 12 || aid == 14 || aid == 16)
+        continue;
+      double etaP = eta(p), phiP = phi(p);
+      if (std::abs(etaP) >= 5.0)
+        continue;
+      for (size_t k = 0; k < checkEta.size(); ++k)
+        if ((etaP - checkEta[k]) < 1e-4 &&
+            std::abs(phiP - checkPhi[k]) < 1e-4)
+          tagged[i] = 1;
+    }
+
+    // Anti-kT on the visible final state with |eta| < 5, once per radius
+    for (auto &slowJet : jetFinders)
+      slowJet->analyze(event);
+
+    double etaJpsi = eta(jpsi), phiJpsi = phi(jpsi);
+    int fromGtoCC = -1; // evaluated once, on the first matched jet
+    for (size_t s = 0; s < selections.size(); ++s) {
+      const JpsiJetSelection &sel = selections[s];
+      Pythia8::SlowJet &slowJet = *jetFinders[finderOf[s]];
+      // Jets are sorted by pT: those above this selection's cut come first
+      int nAbove = 0;
+      while (nAbove < slowJet.sizeJet() && slowJet.pT(nAbove) >= sel.ptMin)
+        ++nAbove;
+      if (nAbove < 1)
+        continue;
+      fillJet(s, &JetHistos::hJetpT, slowJet.pT(0));
+      if (jpsis.size() != 1)
+        continue;
+
+      int nJets = 0;
+      for (int j = 0; j < nAbove; ++j) {
+        Pythia8::Vec4 pJet = slowJet.p(j);
+        // Rivet and FastJet both use phi in [0, 2pi) and do not wrap the
+        // difference here
+        double dPhi = phi0To2Pi(pJet.phi()) - phiJpsi;
+        double dEta = pJet.eta() - etaJpsi;
+        double deltaRsquare = dPhi * dPhi + dEta * dEta;
+        int hasJpsi = 0;
+        for (int c : slowJet.constituents(j))
+          hasJpsi += tagged[c];
+        if (hasJpsi < 2)
+          continue;
+        if (deltaRsquare > sel.dR2Max)
+          continue;
+        if (std::abs(slowJet.pT(j)) > sel.ptMax)
+          continue;
+        if (std::abs(pJet.eta()) > sel.etaMax)
+          continue;
+        if (nJets > 0)
+          continue;
+        nJets++;
+        double z = pTJpsi / slowJet.pT(j);
+        if (fromGtoCC < 0)
+          fromGtoCC = isFromGtoCC(hepmc, jpsis[0]) ? 1 : 0;
+        if (fromGtoCC)
+          fillJet(s, &JetHistos::hZgcc, z);
+        else
+          fillJet(s, &JetHistos::hZqqcc, z);
+        fillJet(s, &JetHistos::hZ, z);
+        for (size_t k = 0; k < histos.size(); ++k)
+          histos[k].jets[s].nJetsCounter.fill(nJets * weight(k));
+        if (s == 0)
+          ++nSelected;
+      }
+    }
+  }
+
+  bool write(const std::string &path) const {
+    std::vector<const YodaObject *> objects;
+    for (const Histos &h : histos) {
+      objects.insert(objects.end(), {&h.evtCount, &h.hnJpsi, &h.hJpsipT});
+      for (const JetHistos &j : h.jets)
+        objects.insert(objects.end(), {&j.nJetsCounter, &j.hZ, &j.hZqqcc,
+                                       &j.hZgcc, &j.hJetpT});
+    }
+    return writeYodaFile(path, objects);
+  }
+
+  long eventsAnalyzed() const { return long(histos[0].evtCount.numEntries); }
+  // Events with a J/psi jet under the built-in selection
+  long eventsSelected() const { return nSelected; }
+
+private:
+  // The histograms of one jet selection for one event weight
+  struct JetHistos {
+    YodaCounter nJetsCounter;
+    YodaHisto1D hZ, hZqqcc, hZgcc, hJetpT;
+
+    JetHistos(const std::string &name, const std::string &tag,
+              const std::string &suffix)
+        : nJetsCounter(path(name, "_njets" + tag, suffix)),
+          hZ(path(name, "zJpsi" + tag, suffix), zEdges()),
+          hZqqcc(path(name, "zJpsiFromqqbar" + tag, suffix), zEdges()),
+          hZgcc(path(name, "zJpsiFromgtocc" + tag, suffix), zEdges()),
+          hJetpT(path(name, "JetpT" + tag, suffix),
+                 {5, 10, 15, 20, 30, 40, 50, 70, 100}) {}
+  };
+
+  // The analysis' histograms for one event weight
+  struct Histos {
+    YodaCounter evtCount;
+    YodaHisto1D hnJpsi, hJpsipT;
+    std::vector<JetHistos> jets; // one per selection
+
+    Histos(const std::string &name, const std::string &suffix,
+           const std::vector<JpsiJetSelection> &selections)
+        : evtCount("/_EVTCOUNT" + suffix),
+          hnJpsi(path(name, "nJpsi", suffix), {0, 1, 2, 3, 4}),
+          hJpsipT(path(name, "JpsipT", suffix),
+                  {5, 6, 8, 10, 15, 20, 25, 30}) {
+      for (const JpsiJetSelection &sel : selections)
+        jets.emplace_back(name, sel.name.empty() ? "" : "_" + sel.name,
+                          suffix);
+    }
+  };
+
+  static std::string path(const std::string &name, const std::string &h,
+                          const std::string &suffix) {
+    return "/" + name + "/" + h + suffix;
+  }
+  static std::vector<double> zEdges() {
+    return {0.16,  0.22,  0.298, 0.376, 0.454, 0.532,
+            0.610, 0.688, 0.766, 0.844, 0.922, 1.0};
+  }
+
+  std::string name;
+  std::vector<JpsiJetSelection> selections;
+  std::vector<std::string> weightSuffixes{""};
+  std::vector<Histos> histos;
+  const std::vector<double> *weights = nullptr;
+  bool vetoNonPrompt = true;
+  // One jet finder per distinct radius, down to the lowest pT cut using it
+  std::vector<std::unique_ptr<Pythia8::SlowJet>> jetFinders;
+  std::vector<size_t> finderOf; // per selection
+  PidIndex pidIndex;
+  long nSelected = 0;
+
+  // Per-event scratch, capacity kept between events
+  std::vector<int> jpsis, endVertex, outStart, outList, cursor, stack;
+  std::vector<double> checkEta, checkPhi;
+  std::vector<char> tagged, visited;
+
+  // Weight k of the current event; events without the variation weights
+  // fall back to the nominal one
+  double weight(size_t k) const {
+    if (weights->empty())
+      return 1.;
+    return k < weights->size() ? (*weights)[k] : (*weights)[0];
+  }
+  void fill(YodaHisto1D Histos::*h, double x) {
+    for (size_t k = 0; k < histos.size(); ++k)
+      (histos[k].*h).fill(x, weight(k));
+  }
+  void fillJet(size_t s, YodaHisto1D JetHistos::*h, double x) {
+    for (size_t k = 0; k < histos.size(); ++k)
+      (histos[k].jets[s].*h).fill(x, weight(k));
+  }
+
+  // Histograms per weight and selection, and the jet finders
+  void book() {
+    histos.clear();
+    for (const std::string &suffix : weightSuffixes)
+      histos.emplace_back(name, suffix, selections);
+    std::vector<double> radii, ptMin;
+    finderOf.clear();
+    for (const JpsiJetSelection &sel : selections) {
+      size_t f = std::find(radii.begin(), radii.end(), sel.R) - radii.begin();
+      if (f == radii.size()) {
+        radii.push_back(sel.R);
+        ptMin.push_back(sel.ptMin);
+      }
+      ptMin[f] = std::min(ptMin[f], sel.ptMin);
+      finderOf.push_back(f);
+    }
+    jetFinders.clear();
+    for (size_t f = 0; f < radii.size(); ++f)
+      jetFinders.emplace_back(
+          new Pythia8::SlowJet(-1, radii[f], ptMin[f], 5.0, 2, 2));
+  }
+
+  // Rivet's transverse momentum, pseudorapidity and [0, 2pi) azimuth
+  static double perp(const PooledHepMC3Event::Particle &p) {
+    return std::sqrt(p.px * p.px + p.py * p.py);
+  }
+  static double eta(const PooledHepMC3Event::Particle &p) {
+    double pT = perp(p);
+    double pAbs = std::sqrt(p.px * p.px + p.py * p.py + p.pz * p.pz);
+    if (pAbs == 0.)
+      return 0.;
+    double e = std::log(
+        (pAbs + std::abs(p.pz)) /
+        std::max(pT, std::numeric_limits<double>::epsilon() * pAbs));
+    return p.pz > 0. ? e : -e;
+  }
+  static double phi0To2Pi(double phi) {
+    return phi < 0. ? phi + 2. * M_PI : phi;
+  }
+  static double phi(const PooledHepMC3Event::Particle &p) {
+    return phi0To2Pi(std::atan2(p.py, p.px));
+  }
+
+  // End vertex per particle and the outgoing particles per vertex (CSR)
+  void buildGraph(const PooledHepMC3Event &hepmc) {
+    size_t nV = hepmc.nVertices();
+    endVertex.assign(hepmc.particles.size(), -1);
+    for (size_t v = 0; v < nV; ++v)
+      for (int m : hepmc.vertices[v].in)
+        endVertex[m] = int(v);
+    outStart.assign(nV + 1, 0);
+    for (size_t i = 1; i < hepmc.particles.size(); ++i)
+      if (hepmc.particles[i].prodVertex >= 0)
+        ++outStart[hepmc.particles[i].prodVertex + 1];
+    for (size_t v = 0; v < nV; ++v)
+      outStart[v + 1] += outStart[v];
+    outList.resize(outStart[nV]);
+    cursor.assign(outStart.begin(), outStart.end() - 1);
+    for (size_t i = 1; i < hepmc.particles.size(); ++i)
+      if (hepmc.particles[i].prodVertex >= 0)
+        outList[cursor[hepmc.particles[i].prodVertex]++] = int(i);
+  }
+
+  struct Range {
+    const int *b, *e;
+    const int *begin() const { return b; }
+    const int *end() const { return e; }
+  };
+  Range children(int i) const {
+    int v = endVertex[i];
+    if (v < 0)
+      return {nullptr, nullptr};
+    return {outList.data() + outStart[v], outList.data() + outStart[v + 1]};
+  }
+  static const std::vector<int> &parents(const PooledHepMC3Event &hepmc,
+                                         int i) {
+    static const std::vector<int> none;
+    int v = hepmc.particles[i].prodVertex;
+    return v < 0 ? none : hepmc.vertices[v].in;
+  }
+
+  // Rivet UnstableParticles: status 1 or 2, non-zero pT, and not a copy of
+  // a status-2 parent with the same id
+  static bool isUnstableParticle(const PooledHepMC3Event &hepmc, int i) {
+    const auto &p = hepmc.particles[i];
+    if (p.status != 1 && p.status != 2)
+      return false;
+    if (p.px == 0. && p.py == 0.)
+      return false;
+    for (int m : parents(hepmc, i))
+      if (hepmc.particles[m].pid == p.pid && hepmc.particles[m].status == 2)
+        return false;
+    return true;
+  }
+
+  // Depth-first walk over all ancestors; pred(j) is tested on each one
+  template <class Pred>
+  bool anyAncestor(const PooledHepMC3Event &hepmc, int i, bool includeSelf,
+                   Pred pred) {
+    visited.assign(hepmc.particles.size(), 0);
+    stack.clear();
+    if (includeSelf)
+      stack.push_back(i);
+    else
+      for (int m : parents(hepmc, i))
+        stack.push_back(m);
+    while (!stack.empty()) {
+      int j = stack.back();
+      stack.pop_back();
+      if (visited[j])
+        continue;
+      visited[j] = 1;
+      if (pred(j))
+        return true;
+      for (int m : parents(hepmc, j))
+        stack.push_back(m);
+    }
+    return false;
+  }
+
+  // Rivet Particle::fromBottom(): a decayed (status 2) b-hadron ancestor
+  bool fromBottom(const PooledHepMC3Event &hepmc, int i) {
+    return anyAncestor(hepmc, i, false, [&](int j) {
+      return hepmc.particles[j].status == 2 &&
+             flavour::isBHadron(hepmc.particles[j].pid);
+    });
+  }
+
+  // The analysis' isFromGtoCC: a gluon in the ancestry (or the particle
+  // itself) with at least two charm-quark children
+  bool isFromGtoCC(const PooledHepMC3Event &hepmc, int i) {
+    return anyAncestor(hepmc, i, true, [&](int j) {
+      if (hepmc.particles[j].pid != 21)
+        return false;
+      int cCount = 0;
+      for (int c : children(j))
+        if (std::abs(hepmc.particles[c].pid) == 4)
+          ++cCount;
+      return cCount >= 2;
+    });
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_JPSIJET_NATIVE_H
@@ -0,0 +1,207 @@
+// =============================================================================
+// onium_ldme.h
+// -----------------------------------------------------------------------------
+// NRQCD long-distance matrix element (LDME) reweighting for Pythia's onium
+// processes.
+//
+// Each hard onium subprocess produces one (state, colour channel) pair and
+// its cross section is proportional to one LDME, e.g. <O^{J/psi}(3S1[8])>.
+// An event generated with LDME O_gen therefore represents a sample with any
+// other value O_new after multiplying its weight by O_new / O_gen:
+//
+//   - OniumSubprocess: per event, the hard subprocess code, the physical
+//     state (J/psi, psi(2S), chi_cJ, ...), the channel ("3S1(1)", "3S1(8)",
+//     "1S0(8)", "3P0(8)") and the generation LDME read from the
+//     Charmonium:/Bottomonium: settings
+//   - LdmeSet: an LDME card, one "<state pid> <channel> <value>" per line;
+//     P-wave octet values are <O(3P0[8])>/m_Q^2 as in Pythia
+//
+// States or channels missing from a card keep their generation weight.
+// Onia produced in the parton shower (OniaShower) are not reweighted.
+// =============================================================================
+
+#ifndef HEPGEN_ONIUM_LDME_H
+#define HEPGEN_ONIUM_LDME_H
+
+#include "Pythia8/Pythia.h"
+
+#include "signal_selector.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hepgen {
+
+// =============================================================================
+// LdmeSet: LDME values by (state, channel)
+// =============================================================================
+class LdmeSet {
+public:
+  bool readFile(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cerr << "Cannot open LDME card " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+      ++lineNo;
+      size_t hash = line.find('#');
+      if (hash != std::string::npos)
+        line.erase(hash);
+      std::istringstream is(line);
+      int pid;
+      std::string channel;
+      double value;
+      if (!(is >> pid))
+        continue;
+      if (!(is >> channel >> value)) {
+        std::cerr << path << ":" << lineNo
+                  << ": expected '<pid> <channel> <value>'" << std::endl;
+        return false;
+      }
+      values[{pid, channel}] = value;
+    }
+    return true;
+  }
+
+  // False if the card does not set this (state, channel)
+  bool find(int state, const std::string &channel, double &value) const {
+    auto it = values.find({state, channel});
+    if (it == values.end())
+      return false;
+    value = it->second;
+    return true;
+  }
+
+  size_t size() const { return values.size(); }
+
+private:
+  std::map<std::pair<int, std::string>, double> values;
+};
+
+// =============================================================================
+// OniumSubprocess: classification of the hard onium subprocess of an event
+// =============================================================================
+class OniumSubprocess {
+public:
+  // Reads the generation LDMEs; call after pythia.init()
+  void init(Pythia8::Pythia &pythia) {
+    settings.clear();
+    for (const char *prefix : {"Charmonium", "Bottomonium"})
+      for (const char *group : {"3S1", "3PJ"}) {
+        std::string key = std::string(prefix) + ":states(" + group + ")";
+        if (!pythia.settings.isMVec(key))
+          continue;
+        std::vector<int> states = pythia.settings.mvec(key);
+        for (size_t k = 0; k < states.size(); ++k)
+          for (const char *channel :
+               {"3S1(1)", "3S1(8)", "1S0(8)", "3P0(1)", "3P0(8)"}) {
+            std::string ldmeKey = std::string(prefix) + ":O(" + group +
+                                  ")[" + channel + "]";
+            if (!pythia.settings.isPVec(ldmeKey))
+              continue;
+            std::vector<double> ldmes = pythia.settings.pvec(ldmeKey);
+            if (k < ldmes.size())
+              settings[{states[k], channel}] = ldmes[k];
+          }
+      }
+  }
+
+  // Classify the current event. False if the hard process has no onium.
+  bool classify(const Pythia8::Pythia &pythia) {
+    code = pythia.info.code();
+    state = 0;
+    ldme = 0.;
+    channel = nullptr;
+
+    // Outgoing onium of the hard process: the physical state or a colour-
+    // octet pre-state (99...), which turns into the physical one
+    int idHard = 0;
+    for (int i = 5; i < pythia.process.size(); ++i)
+      if (flavour::isOnium(pythia.process[i].id())) {
+        idHard = pythia.process[i].idAbs();
+        break;
+      }
+    if (idHard == 0)
+      return false;
+    state = idHard < 9900000 ? idHard : octetState(pythia.event, idHard);
+    if (state == 0)
+      return false;
+
+    channel = &channelOf(pythia);
+    auto it = settings.find({state, *channel});
+    if (it != settings.end())
+      ldme = it->second;
+    return true;
+  }
+
+  // Weight factor O_new / O_gen for an LDME set (1 if not reweightable)
+  double reweight(const LdmeSet &set) const {
+    double value;
+    if (!channel || ldme == 0. || !set.find(state, *channel, value))
+      return 1.;
+    return value / ldme;
+  }
+
+  // Colour channel of the current event, "" if unknown
+  const std::string &channelName() const {
+    static const std::string none;
+    return channel ? *channel : none;
+  }
+
+  int code = 0;     // Pythia subprocess code
+  int state = 0;    // physical onium PDG code, 0 = none
+  double ldme = 0.; // generation LDME of (state, channel), 0 = unknown
+
+private:
+  std::map<std::pair<int, std::string>, double> settings;
+  std::unordered_map<int, std::string> channelByCode;
+  const std::string *channel = nullptr;
+
+  // "g g -> ccbar[3S1(8)] g" -> "3S1(8)"; P waves are normalized to the
+  // 3P0 matrix element, so "3PJ(n)" is named by the LDME it scales with
+  const std::string &channelOf(const Pythia8::Pythia &pythia) {
+    auto it = channelByCode.find(code);
+    if (it != channelByCode.end())
+      return it->second;
+    std::string name = pythia.info.name();
+    std::string ch;
+    size_t open = name.find('['), close = name.find(']', open);
+    if (open != std::string::npos && close != std::string::npos)
+      ch = name.substr(open + 1, close - open - 1);
+    if (ch.compare(0, 3, "3PJ") == 0)
+      ch.replace(0, 3, "3P0");
+    return channelByCode.emplace(code, ch).first->second;
+  }
+
+  // Physical state a colour-octet pre-state decays into in this event. Not
+  // cached by octet id: nothing ties an octet id to a single physical state,
+  // and a stale mapping would apply another state's LDME.
+  int octetState(const Pythia8::Event &event, int idOctet) const {
+    for (int i = 1; i < event.size(); ++i) {
+      if (event[i].idAbs() != idOctet)
+        continue;
+      const Pythia8::Particle &oct = event[event[i].iBotCopyId()];
+      int d1 = oct.daughter1();
+      int d2 = std::max(oct.daughter1(), oct.daughter2());
+      for (int d = d1; d > 0 && d <= d2; ++d)
+        if (flavour::isOnium(event[d].id()) && event[d].idAbs() < 9900000)
+          return event[d].idAbs();
+    }
+    return 0;
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_ONIUM_LDME_H
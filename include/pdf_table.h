@@ -0,0 +1,488 @@
+// =============================================================================
+// pdf_table.h
+// -----------------------------------------------------------------------------
+// Pre-tabulated LHAPDF set as a drop-in Pythia PDF.
+//
+// With CP5 MPI every event evaluates the beam PDFs thousands of times, and
+// each LHAPDF call searches its knot arrays and interpolates one flavour at
+// a time. TabulatedPDF samples the set once at startup and answers every
+// call for all flavours together:
+//
+//   - PdfGrid: the set on a flat [Q2 row][x node][flavour] table of floats.
+//     The x axis is uniform in u = ln x + 5 x (dense at small x, still fine
+//     towards x = 1), the Q2 axis uniform in ln Q2 within each heavy-quark
+//     threshold segment, so no stencil crosses a flavour threshold. Nodes
+//     are found by arithmetic, not search, and the 4x4 cubic stencil reads
+//     four runs of contiguous memory.
+//   - TabulatedPDF: the Pythia8::PDF for one beam. Optional direct-mapped
+//     (x, Q2) memo cache (one per PDF object, i.e. per Pythia instance and
+//     thread), and a validation mode that evaluates LHAPDF as well at every
+//     call and records the deviation.
+//
+// Outside the LHAPDF grid the values are frozen at the boundary, as in
+// Pythia's LHAPDF6 interface; with PDF:extrapolate = on, x below the grid
+// goes to LHAPDF directly.
+//
+// Usage:
+//   pythia.readString("PDF:pSet = LHAPDF6:NNPDF31_nnlo_as_0118");
+//   auto pdfStats = hepgen::installTabulatedPDF(pythia, mode); // before init
+//   ...
+//   pdfStats->print(std::cout);
+// =============================================================================
+
+#ifndef HEPGEN_PDF_TABLE_H
+#define HEPGEN_PDF_TABLE_H
+
+#include "LHAPDF/LHAPDF.h"
+#include "Pythia8/Pythia.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+// bbar (-5) ... b (5) with the gluon at id 0, padded to 12 so the per-node
+// flavour loop is a fixed-length run the compiler vectorizes. LHAPDF's
+// all-flavour vector runs tbar (-6) ... t (6), so flavour k is its k + 1.
+constexpr int kPdfFlavours = 11;
+constexpr int kPdfStride = 12;
+inline int pdfFlavourId(int k) { return k == 5 ? 21 : k - 5; }
+
+enum class PdfTableMode { kOff, kTable, kMemo, kValidate };
+
+// "on" | "memo" | "validate"
+inline bool parsePdfTableMode(const std::string &spec, PdfTableMode &mode) {
+  if (spec == "on")
+    mode = PdfTableMode::kTable;
+  else if (spec == "memo")
+    mode = PdfTableMode::kMemo;
+  else if (spec == "validate")
+    mode = PdfTableMode::kValidate;
+  else {
+    std::cerr << "--pdf-table expects on, memo or validate, got '" << spec
+              << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+struct PdfGridOptions {
+  double du = 0.1;      // x node spacing in u = ln x + 5 x
+  double dLogQ2 = 0.2;  // Q2 node spacing in ln Q2
+  int memoBits = 12;    // memo cache of 2^memoBits entries
+};
+
+// =============================================================================
+// PdfDeviation: table vs. direct LHAPDF
+// =============================================================================
+// Relative deviation |table - lhapdf| / max(|lhapdf|, 1e-3): values below
+// 1e-3 (sea quarks at large x) are compared in absolute terms.
+struct PdfDeviation {
+  long nPoints = 0;
+  double sumDev = 0., maxDev = 0.;
+  double worstX = 0., worstQ2 = 0.;
+  int worstId = 0;
+
+  void add(double x, double Q2, const double *table, const double *direct) {
+    ++nPoints;
+    for (int k = 0; k < kPdfFlavours; ++k) {
+      double dev = std::abs(table[k] - direct[k]) /
+                   std::max(std::abs(direct[k]), 1e-3);
+      sumDev += dev / kPdfFlavours;
+      if (dev > maxDev) {
+        maxDev = dev;
+        worstX = x;
+        worstQ2 = Q2;
+        worstId = pdfFlavourId(k);
+      }
+    }
+  }
+
+  void print(std::ostream &os, const char *label) const {
+    if (nPoints == 0)
+      return;
+    os << "  " << label << ": " << nPoints << " points, mean deviation "
+       << sumDev / nPoints << ", max " << maxDev << " (id " << worstId
+       << ", x = " << worstX << ", Q2 = " << worstQ2 << ")" << std::endl;
+  }
+};
+
+// Shared by the PDFs of both beams
+struct PdfTableStats {
+  std::string set;
+  int nX = 0, nQ2 = 0;
+  double megabytes = 0., buildSeconds = 0.;
+  long evaluations = 0, memoHits = 0, direct = 0;
+  PdfDeviation scan; // every cell midpoint, at startup
+  PdfDeviation run;  // every evaluation during generation
+
+  void print(std::ostream &os) const {
+    os << "PDF table " << set << ": " << nX << " x " << nQ2 << " nodes, "
+       << megabytes << " MB, built in " << buildSeconds << " s" << std::endl;
+    os << "  evaluations: " << evaluations;
+    if (memoHits > 0)
+      os << ", memo hits: " << memoHits << " ("
+         << 100. * memoHits / std::max(evaluations, 1L) << "%)";
+    if (direct > 0)
+      os << ", direct (extrapolated): " << direct;
+    os << std::endl;
+    scan.print(os, "validation, cell midpoints");
+    run.print(os, "validation, generation");
+  }
+};
+
+// =============================================================================
+// PdfGrid: the tabulated set
+// =============================================================================
+class PdfGrid {
+public:
+  static constexpr double kXStretch = 5.;
+
+  void build(LHAPDF::PDF &pdf, const PdfGridOptions &opt) {
+    xMin = pdf.xMin();
+    xMax = pdf.xMax();
+    q2Min = pdf.q2Min();
+    q2Max = pdf.q2Max();
+
+    // x axis: uniform in u, nodes by Newton inversion of u(x)
+    xAxis = UniformAxis::span(uOf(xMin), uOf(xMax), opt.du);
+    xNodes.resize(xAxis.n);
+    for (int i = 0; i < xAxis.n; ++i)
+      xNodes[i] = xOf(xAxis.start + i * xAxis.step);
+    xNodes.back() = xMax;
+
+    // Q2 axis: one segment per heavy-quark threshold interval
+    std::vector<double> edges = {std::log(q2Min)};
+    for (int id = 4; id <= 6; ++id) {
+      double q = pdf.quarkThreshold(id);
+      if (q > 0. && q * q > q2Min * (1. + 1e-6) && q * q < q2Max)
+        edges.push_back(std::log(q * q));
+    }
+    edges.push_back(std::log(q2Max));
+    segments.clear();
+    int nRows = 0;
+    for (size_t s = 0; s + 1 < edges.size(); ++s) {
+      Segment seg;
+      seg.axis = UniformAxis::span(edges[s], edges[s + 1], opt.dLogQ2);
+      seg.rowBegin = nRows;
+      nRows += seg.axis.n;
+      segments.push_back(seg);
+    }
+
+    table.assign(size_t(nRows) * xAxis.n * kPdfStride, 0.f);
+    std::vector<double> xf;
+    for (const Segment &seg : segments)
+      for (int j = 0; j < seg.axis.n; ++j) {
+        double Q2 = std::exp(seg.axis.start + j * seg.axis.step);
+        if (j == seg.axis.n - 1 && &seg != &segments.back())
+          Q2 *= 1. - 1e-9; // stay below the threshold on the top row
+        for (int i = 0; i < xAxis.n; ++i) {
+          pdf.xfxQ2(xNodes[i], Q2, xf);
+          float *node = &table[(size_t(seg.rowBegin + j) * xAxis.n + i) *
+                               kPdfStride];
+          for (int k = 0; k < kPdfFlavours; ++k)
+            node[k] = float(xf[k + 1]);
+        }
+      }
+  }
+
+  // All flavours at (x, Q2) inside the grid, cubic in u and ln Q2
+  void interpolate(double x, double Q2, double *out) const {
+    double tx, tq;
+    int sx = xAxis.locate(uOf(x), tx);
+    double lq = std::log(Q2);
+    const Segment *seg = &segments.front();
+    for (const Segment &s : segments)
+      if (lq >= s.axis.start)
+        seg = &s;
+    int sq = seg->axis.locate(lq, tq);
+
+    double wx[4], wq[4];
+    cubicWeights(tx, wx);
+    cubicWeights(tq, wq);
+    double acc[kPdfStride] = {};
+    for (int a = 0; a < 4; ++a) {
+      const float *row =
+          &table[(size_t(seg->rowBegin + sq + a) * xAxis.n + sx) * kPdfStride];
+      for (int b = 0; b < 4; ++b) {
+        double w = wq[a] * wx[b];
+        const float *node = row + b * kPdfStride;
+        for (int k = 0; k < kPdfStride; ++k)
+          acc[k] += w * node[k];
+      }
+    }
+    std::memcpy(out, acc, sizeof(acc));
+  }
+
+  // Compare against LHAPDF at every cell midpoint, the worst case for the
+  // interpolation
+  void scan(LHAPDF::PDF &lha, PdfDeviation &dev) const {
+    std::vector<double> xf;
+    double table[kPdfStride], direct[kPdfStride];
+    for (const Segment &seg : segments)
+      for (int j = 0; j + 1 < seg.axis.n; ++j) {
+        double Q2 = std::exp(seg.axis.start + (j + 0.5) * seg.axis.step);
+        for (int i = 0; i + 1 < xAxis.n; ++i) {
+          double x = xOf(xAxis.start + (i + 0.5) * xAxis.step);
+          interpolate(x, Q2, table);
+          lha.xfxQ2(x, Q2, xf);
+          for (int k = 0; k < kPdfFlavours; ++k)
+            direct[k] = xf[k + 1];
+          dev.add(x, Q2, table, direct);
+        }
+      }
+  }
+
+  int nX() const { return xAxis.n; }
+  int nQ2() const {
+    return segments.empty() ? 0
+                            : segments.back().rowBegin + segments.back().axis.n;
+  }
+  double megabytes() const { return table.size() * sizeof(float) / 1048576.; }
+
+  double xMin = 0., xMax = 1., q2Min = 0., q2Max = 0.;
+
+private:
+  struct UniformAxis {
+    double start = 0., step = 1.;
+    int n = 0;
+
+    // At least 4 nodes, the last one exactly at stop
+    static UniformAxis span(double start, double stop, double step) {
+      UniformAxis axis;
+      axis.start = start;
+      axis.n = std::max(4, int(std::ceil((stop - start) / step)) + 1);
+      axis.step = (stop - start) / (axis.n - 1);
+      return axis;
+    }
+
+    // First node of the 4-point stencil around v, and v's position in it
+    int locate(double v, double &tau) const {
+      double f = (v - start) / step;
+      int s = std::min(std::max(int(std::floor(f)) - 1, 0), n - 4);
+      tau = f - s;
+      return s;
+    }
+  };
+
+  struct Segment {
+    UniformAxis axis;
+    int rowBegin = 0;
+  };
+
+  UniformAxis xAxis;
+  std::vector<double> xNodes;
+  std::vector<Segment> segments;
+  std::vector<float> table;
+
+  static double uOf(double x) { return std::log(x) + kXStretch * x; }
+
+  static double xOf(double u) {
+    double y = std::min(u, 0.);
+    for (int it = 0; it < 50; ++it) {
+      double step = (y + kXStretch * std::exp(y) - u) /
+                    (1. + kXStretch * std::exp(y));
+      y -= step;
+      if (std::abs(step) < 1e-14)
+        break;
+    }
+    return std::exp(y);
+  }
+
+  // Lagrange weights of nodes 0..3 at position tau
+  static void cubicWeights(double tau, double *w) {
+    double t1 = tau - 1., t2 = tau - 2., t3 = tau - 3.;
+    w[0] = -t1 * t2 * t3 / 6.;
+    w[1] = tau * t2 * t3 / 2.;
+    w[2] = -tau * t1 * t3 / 2.;
+    w[3] = tau * t1 * t2 / 6.;
+  }
+};
+
+// =============================================================================
+// TabulatedPDF: Pythia PDF for one beam on a shared PdfGrid
+// =============================================================================
+class TabulatedPDF : public Pythia8::PDF {
+public:
+  TabulatedPDF(int idBeamIn, std::shared_ptr<const PdfGrid> gridIn,
+               std::shared_ptr<LHAPDF::PDF> lhaIn, PdfTableMode modeIn,
+               std::shared_ptr<PdfTableStats> statsIn, bool extrapolateIn,
+               int memoBits)
+      : Pythia8::PDF(idBeamIn), grid(std::move(gridIn)),
+        lha(std::move(lhaIn)), stats(std::move(statsIn)), mode(modeIn),
+        extrapolate(extrapolateIn) {
+    if (mode == PdfTableMode::kMemo) {
+      memo.resize(size_t(1) << memoBits);
+      memoShift = 64 - memoBits;
+    }
+    isSet = true;
+  }
+
+  void xfUpdate(int, double x, double Q2) override {
+    ++stats->evaluations;
+    double xf[kPdfStride];
+
+    // Freeze at the boundary, as Pythia's LHAPDF6 interface does
+    x = std::min(x, grid->xMax);
+    Q2 = std::min(std::max(Q2, grid->q2Min), grid->q2Max);
+    if (x < grid->xMin) {
+      if (extrapolate) {
+        ++stats->direct;
+        evaluateDirect(x, Q2, xf);
+        setValues(xf);
+        return;
+      }
+      x = grid->xMin;
+    }
+
+    if (!memo.empty()) {
+      MemoEntry &entry = memo[memoSlot(x, Q2)];
+      if (entry.x == x && entry.Q2 == Q2) {
+        ++stats->memoHits;
+        setValues(entry.xf);
+        return;
+      }
+      grid->interpolate(x, Q2, entry.xf);
+      entry.x = x;
+      entry.Q2 = Q2;
+      setValues(entry.xf);
+      return;
+    }
+
+    grid->interpolate(x, Q2, xf);
+    if (mode == PdfTableMode::kValidate) {
+      double direct[kPdfStride];
+      evaluateDirect(x, Q2, direct);
+      stats->run.add(x, Q2, xf, direct);
+    }
+    setValues(xf);
+  }
+
+  bool insideBounds(double x, double Q2) override {
+    return x > grid->xMin && x < grid->xMax && Q2 > grid->q2Min &&
+           Q2 < grid->q2Max;
+  }
+  double alphaS(double Q2) override { return lha->alphasQ2(Q2); }
+  double mQuarkPDF(int id) override { return lha->quarkMass(std::abs(id)); }
+
+private:
+  struct MemoEntry {
+    double x = -1., Q2 = -1.;
+    double xf[kPdfStride];
+  };
+
+  std::shared_ptr<const PdfGrid> grid;
+  std::shared_ptr<LHAPDF::PDF> lha;
+  std::shared_ptr<PdfTableStats> stats;
+  PdfTableMode mode;
+  bool extrapolate;
+  std::vector<MemoEntry> memo;
+  int memoShift = 64;
+  std::vector<double> lhaValues;
+
+  size_t memoSlot(double x, double Q2) const {
+    uint64_t bx, bq;
+    std::memcpy(&bx, &x, sizeof(bx));
+    std::memcpy(&bq, &Q2, sizeof(bq));
+    return size_t((bx * 0x9E3779B97F4A7C15ull ^ bq * 0xC2B2AE3D27D4EB4Full) >>
+                  memoShift);
+  }
+
+  void evaluateDirect(double x, double Q2, double *xf) {
+    lha->xfxQ2(x, Q2, lhaValues);
+    for (int k = 0; k < kPdfFlavours; ++k)
+      xf[k] = lhaValues[k + 1];
+  }
+
+  void setValues(const double *xf) {
+    xbbar = xf[0];
+    xcbar = xf[1];
+    xsbar = xf[2];
+    xubar = xf[3];
+    xdbar = xf[4];
+    xg = xf[5];
+    xd = xf[6];
+    xu = xf[7];
+    xs = xf[8];
+    xc = xf[9];
+    xb = xf[10];
+    xuVal = xu - xubar;
+    xuSea = xubar;
+    xdVal = xd - xdbar;
+    xdSea = xdbar;
+    xgamma = 0.;
+    idSav = 9; // all flavours updated
+  }
+};
+
+// Tabulate the LHAPDF6 set in PDF:pSet and install it for both beams.
+// Call before pythia.init(); nullptr on failure. Proton and antiproton beams
+// only: Angantyr sets up its sub-collision PDFs itself.
+inline std::shared_ptr<PdfTableStats> installTabulatedPDF(
+    Pythia8::Pythia &pythia, PdfTableMode mode,
+    const PdfGridOptions &opt = PdfGridOptions()) {
+  int idA = pythia.settings.mode("Beams:idA");
+  int idB = pythia.settings.mode("Beams:idB");
+  if (std::abs(idA) != 2212 || std::abs(idB) != 2212) {
+    std::cerr << "PDF table: only proton beams are supported" << std::endl;
+    return nullptr;
+  }
+  const std::string prefix = "LHAPDF6:";
+  std::string pSet = pythia.settings.word("PDF:pSet");
+  if (pSet.compare(0, prefix.size(), prefix) != 0) {
+    std::cerr << "PDF table: PDF:pSet is not an LHAPDF6 set (" << pSet << ")"
+              << std::endl;
+    return nullptr;
+  }
+  std::string setName = pSet.substr(prefix.size());
+  int member = 0;
+  size_t slash = setName.find('/');
+  if (slash != std::string::npos) {
+    member = std::atoi(setName.c_str() + slash + 1);
+    setName.erase(slash);
+  }
+
+  std::shared_ptr<LHAPDF::PDF> lha;
+  try {
+    LHAPDF::setVerbosity(0);
+    lha.reset(LHAPDF::mkPDF(setName, member));
+  } catch (const LHAPDF::Exception &e) {
+    std::cerr << "PDF table: " << e.what() << std::endl;
+    return nullptr;
+  }
+  if (!lha)
+    return nullptr;
+
+  auto stats = std::make_shared<PdfTableStats>();
+  auto start = std::chrono::steady_clock::now();
+  auto grid = std::make_shared<PdfGrid>();
+  grid->build(*lha, opt);
+  stats->buildSeconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  stats->set = setName + "/" + std::to_string(member);
+  stats->nX = grid->nX();
+  stats->nQ2 = grid->nQ2();
+  stats->megabytes = grid->megabytes();
+  if (mode == PdfTableMode::kValidate)
+    grid->scan(*lha, stats->scan);
+
+  bool extrapolate = pythia.settings.flag("PDF:extrapolate");
+  pythia.setPDFPtr(std::make_shared<TabulatedPDF>(idA, grid, lha, mode, stats,
+                                                  extrapolate, opt.memoBits),
+                   std::make_shared<TabulatedPDF>(idB, grid, lha, mode, stats,
+                                                  extrapolate, opt.memoBits));
+  return stats;
+}
+
+} // namespace hepgen
+
+#endif // HEPGEN_PDF_TABLE_H
@@ -0,0 +1,303 @@
+// =============================================================================
+// precision_monitor.h
+// -----------------------------------------------------------------------------
+// Running statistical precision of the D* spin alignment and flow in
+// gen_d0_study, per (prompt/non-prompt, pT bin), for stopping a run once
+// every bin has reached a target precision.
+//
+// The estimators are moments, updated per candidate with its event weight:
+//   rho00 = (5 <cos^2 theta> - 1) / 2,   W(theta) ~ (1 - rho00)
+//                                          + (3 rho00 - 1) cos^2 theta
+//   v2    = <cos 2(phi - Psi_RP)>
+// with errors sqrt(var / Neff), Neff = (sum w)^2 / sum w^2. For unit
+// weights this is the v2 error of scripts/plot_d0_combined.py. At rho00 =
+// 1/3 the moment error of rho00 equals that of a likelihood fit. The fit in
+// the plot script rescales its covariance by chi2/ndf, so it differs by that
+// fluctuation. The pT bins default to those of the plot script. A bin needs
+// at least 50 candidates, the minimum the plot script fits, before it can
+// converge.
+//
+// PtHatBiasHook moves the remaining effort to the bins that still need
+// candidates. Events with pTHat below the lower edge of the lowest bin that
+// has not converged are selected less often, by max(0.1, (pTHat/edge)^n),
+// and carry the inverse as event weight. The bias never exceeds 1, so the
+// cross-section maxima found at initialization stay valid. Converged bins
+// keep receiving (weighted) candidates; if their Neff falls below the
+// target again, the threshold moves back down.
+//
+// writeSnapshot() stores the raw sums of every bin in a small text file.
+// Jobs rewrite the file periodically, and scripts/aggregate_results.py adds
+// the files of all jobs while they run.
+//
+// Usage:
+//   hepgen::PrecisionMonitor monitor;
+//   monitor.parseTargets("rho00=0.02,v2=0.01");
+//   ...  monitor.add(nonPrompt, pT, cosTheta, cos2DeltaPhi, weight);
+//   if (monitor.done()) break;
+//   monitor.print(std::cout);
+//   monitor.writeSnapshot("d0_1234_0.acc", seed, firstEvent, nDone, true);
+// =============================================================================
+
+#ifndef HEPGEN_PRECISION_MONITOR_H
+#define HEPGEN_PRECISION_MONITOR_H
+
+#include "Pythia8/Pythia.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+// Weighted moments of one (type, pT) bin
+struct PrecisionBin {
+  long n = 0;
+  double sumW = 0.;
+  double sumW2 = 0.;
+  double sumC2 = 0.; // sum w cos^2 theta
+  double sumC4 = 0.;
+  double sumV = 0.; // sum w cos 2 dphi
+  double sumV2 = 0.;
+
+  void add(double cosTheta, double cos2DeltaPhi, double w) {
+    double c2 = cosTheta * cosTheta;
+    n++;
+    sumW += w;
+    sumW2 += w * w;
+    sumC2 += w * c2;
+    sumC4 += w * c2 * c2;
+    sumV += w * cos2DeltaPhi;
+    sumV2 += w * cos2DeltaPhi * cos2DeltaPhi;
+  }
+  double nEff() const { return sumW2 > 0. ? sumW * sumW / sumW2 : 0.; }
+  double rho00() const {
+    return sumW > 0. ? 0.5 * (5. * sumC2 / sumW - 1.) : 0.;
+  }
+  double v2() const { return sumW > 0. ? sumV / sumW : 0.; }
+  double rho00Err() const { return 2.5 * error(sumC2, sumC4); }
+  double v2Err() const { return error(sumV, sumV2); }
+
+private:
+  // Error of the weighted mean of x from sum w x and sum w x^2
+  double error(double sx, double sx2) const {
+    double neff = nEff();
+    if (neff <= 1.)
+      return INFINITY;
+    double mean = sx / sumW;
+    double var = std::max(sx2 / sumW - mean * mean, 0.);
+    return std::sqrt(var / neff);
+  }
+};
+
+class PrecisionMonitor {
+public:
+  static constexpr long kMinEntries = 50; // plot_d0_combined.py fit minimum
+
+  PrecisionMonitor() : ptEdges{3., 5., 7., 10., 15., 20., 30.} { resize(); }
+
+  // Comma-separated targets on the absolute errors, e.g.
+  // "rho00=0.02,v2=0.01". A quantity without a target is not checked.
+  bool parseTargets(const std::string &spec) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      size_t eq = item.find('=');
+      char *end = nullptr;
+      double value = eq == std::string::npos
+                         ? 0.
+                         : std::strtod(item.c_str() + eq + 1, &end);
+      std::string key = item.substr(0, eq);
+      if (eq == std::string::npos || *end != '\0' || value <= 0. ||
+          (key != "rho00" && key != "v2")) {
+        std::cerr << "Invalid precision target '" << item
+                  << "' (expected rho00=<err> and/or v2=<err>)" << std::endl;
+        return false;
+      }
+      (key == "rho00" ? rhoTarget : v2Target) = value;
+    }
+    return enabled();
+  }
+
+  // Comma-separated increasing pT bin edges [GeV]
+  bool parsePtEdges(const std::string &spec) {
+    std::vector<double> edges;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      char *end = nullptr;
+      double value = std::strtod(item.c_str(), &end);
+      if (item.empty() || *end != '\0' ||
+          (!edges.empty() && value <= edges.back())) {
+        std::cerr << "Invalid pT bin edges '" << spec << "'" << std::endl;
+        return false;
+      }
+      edges.push_back(value);
+    }
+    if (edges.size() < 2) {
+      std::cerr << "Need at least two pT bin edges" << std::endl;
+      return false;
+    }
+    ptEdges = edges;
+    resize();
+    return true;
+  }
+
+  bool enabled() const { return rhoTarget > 0. || v2Target > 0.; }
+  int nPtBins() const { return int(ptEdges.size()) - 1; }
+
+  // Candidate of type 0 (prompt) or 1 (non-prompt); outside the bins ignored
+  void add(int type, double pT, double cosTheta, double cos2DeltaPhi,
+           double weight) {
+    if (pT < ptEdges.front() || pT >= ptEdges.back())
+      return;
+    int iPt = int(std::upper_bound(ptEdges.begin(), ptEdges.end(), pT) -
+                  ptEdges.begin()) -
+              1;
+    bins[type * nPtBins() + iPt].add(cosTheta, cos2DeltaPhi, weight);
+  }
+
+  bool converged(const PrecisionBin &bin) const {
+    return bin.n >= kMinEntries &&
+           (rhoTarget <= 0. || bin.rho00Err() <= rhoTarget) &&
+           (v2Target <= 0. || bin.v2Err() <= v2Target);
+  }
+
+  // All bins at their target precision
+  bool done() const {
+    for (const auto &bin : bins)
+      if (!converged(bin))
+        return false;
+    return true;
+  }
+
+  // Lower pT edge of the lowest bin (either type) not yet converged, or the
+  // upper edge of the last bin when all are
+  double starvedPt() const {
+    for (int iPt = 0; iPt < nPtBins(); ++iPt)
+      for (int type = 0; type < 2; ++type)
+        if (!converged(bins[type * nPtBins() + iPt]))
+          return ptEdges[iPt];
+    return ptEdges.back();
+  }
+
+  // One line per bin with its estimates and errors
+  void print(std::ostream &os) const {
+    os << "Precision per bin (targets:";
+    if (rhoTarget > 0.)
+      os << " rho00 " << rhoTarget;
+    if (v2Target > 0.)
+      os << " v2 " << v2Target;
+    os << ")\n";
+    char line[160];
+    for (int type = 0; type < 2; ++type)
+      for (int iPt = 0; iPt < nPtBins(); ++iPt) {
+        const PrecisionBin &bin = bins[type * nPtBins() + iPt];
+        std::snprintf(line, sizeof(line),
+                      "  %-10s %5.1f-%5.1f GeV  n %8ld  Neff %9.1f  rho00 "
+                      "%6.3f +- %6.4f  v2 %7.4f +- %6.4f  %s\n",
+                      type ? "non-prompt" : "prompt", ptEdges[iPt],
+                      ptEdges[iPt + 1], bin.n, bin.nEff(), bin.rho00(),
+                      bin.rho00Err(), bin.v2(), bin.v2Err(),
+                      converged(bin) ? "ok" : "-");
+        os << line;
+      }
+  }
+
+  // Comment lines for the output file:
+  // # precision type ptMin ptMax n nEff rho00 err v2 err converged
+  void write(std::ostream &os) const {
+    for (int type = 0; type < 2; ++type)
+      for (int iPt = 0; iPt < nPtBins(); ++iPt) {
+        const PrecisionBin &bin = bins[type * nPtBins() + iPt];
+        os << "# precision " << type << " " << ptEdges[iPt] << " "
+           << ptEdges[iPt + 1] << " " << bin.n << " " << bin.nEff() << " "
+           << bin.rho00() << " " << bin.rho00Err() << " " << bin.v2() << " "
+           << bin.v2Err() << " " << int(converged(bin)) << "\n";
+      }
+  }
+
+  // Accumulator snapshot, written to <path>.part and renamed into place:
+  //   # hepgen accumulator d0_precision v1
+  //   job <seed> <firstEvent>
+  //   events <n> final <0|1>
+  //   ptEdges <e0> <e1> ...
+  //   bin <type> <iPt> <n> <sumW> <sumW2> <sumC2> <sumC4> <sumV> <sumV2>
+  // All sums add across jobs; (seed, firstEvent) identifies the job.
+  bool writeSnapshot(const std::string &path, long seed, long long firstEvent,
+                     long nEvents, bool final) const {
+    std::string part = path + ".part";
+    {
+      std::ofstream out(part);
+      if (!out) {
+        std::cerr << "Cannot open snapshot " << part << std::endl;
+        return false;
+      }
+      out.precision(17);
+      out << "# hepgen accumulator d0_precision v1\n";
+      out << "job " << seed << " " << firstEvent << "\n";
+      out << "events " << nEvents << " final " << int(final) << "\n";
+      out << "ptEdges";
+      for (double e : ptEdges)
+        out << " " << e;
+      out << "\n";
+      for (int type = 0; type < 2; ++type)
+        for (int iPt = 0; iPt < nPtBins(); ++iPt) {
+          const PrecisionBin &bin = bins[type * nPtBins() + iPt];
+          out << "bin " << type << " " << iPt << " " << bin.n << " "
+              << bin.sumW << " " << bin.sumW2 << " " << bin.sumC2 << " "
+              << bin.sumC4 << " " << bin.sumV << " " << bin.sumV2 << "\n";
+        }
+      if (!out)
+        return false;
+    }
+    if (std::rename(part.c_str(), path.c_str()) != 0) {
+      std::cerr << "Cannot rename " << part << " to " << path << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  void resize() { bins.assign(2 * nPtBins(), PrecisionBin()); }
+
+  std::vector<double> ptEdges;
+  std::vector<PrecisionBin> bins; // type-major: [type * nPtBins + iPt]
+  double rhoTarget = 0.;
+  double v2Target = 0.;
+};
+
+// Suppresses the selection of hard processes with pTHat below a threshold
+// that the caller moves during the run (see above). Threshold 0: no bias.
+class PtHatBiasHook : public Pythia8::UserHooks {
+public:
+  static constexpr double kMinBias = 0.1; // largest event weight 10
+
+  explicit PtHatBiasHook(double power) : power(power) {}
+
+  void setThreshold(double pT) { threshold = pT; }
+  double getThreshold() const { return threshold; }
+
+  bool canBiasSelection() override { return true; }
+  double biasSelectionBy(const Pythia8::SigmaProcess *,
+                         const Pythia8::PhaseSpace *phaseSpacePtr,
+                         bool) override {
+    double pTHat = phaseSpacePtr->pTHat();
+    if (threshold <= 0. || pTHat >= threshold)
+      return 1.;
+    return std::max(kMinBias, std::pow(pTHat / threshold, power));
+  }
+
+private:
+  double power;
+  double threshold = 0.;
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_PRECISION_MONITOR_H
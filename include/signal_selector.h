@@ -0,0 +1,289 @@
+// =============================================================================
+// signal_selector.h
+// -----------------------------------------------------------------------------
+// Shared signal selection on pythia.event:
+//
+//   - flavour tables: constexpr classification of hadron PDG codes by their
+//     quark content (isBHadron, isCHadron, ...)
+//   - PidIndex: the event record bucketed by |PID| in a single pass, so every
+//     lookup only visits the particles of that species
+//   - DecayChain: declarative decay-chain matcher, e.g.
+//
+//       const hepgen::DecayChain kBpToKJpsi(521, {321, {443, {13, -13}}});
+//       const hepgen::DecayChain kDstarToD0Pi(413, {421, 211});
+//
+//     Codes are given for the particle; the charge conjugate is matched too.
+//     A node without daughters matches any decay (or none).
+// =============================================================================
+
+#ifndef HEPGEN_SIGNAL_SELECTOR_H
+#define HEPGEN_SIGNAL_SELECTOR_H
+
+#include "Pythia8/Pythia.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+namespace hepgen {
+
+// =============================================================================
+// Flavour classification
+// =============================================================================
+namespace flavour {
+
+// Quark-content bits, indexed by the n_q1 n_q2 n_q3 digits of the PDG code
+enum : uint8_t {
+  kStrange = 1 << 0,
+  kCharm = 1 << 1,
+  kBottom = 1 << 2,
+  kHidden = 1 << 3 // quarkonium-like meson (q qbar of the same flavour)
+};
+
+constexpr std::array<uint8_t, 1000> makeQuarkTable() {
+  std::array<uint8_t, 1000> table = {};
+  for (int q = 0; q < 1000; ++q) {
+    int nq1 = q / 100, nq2 = (q / 10) % 10, nq3 = q % 10;
+    uint8_t bits = 0;
+    for (int nq : {nq1, nq2, nq3}) {
+      if (nq == 3)
+        bits |= kStrange;
+      if (nq == 4)
+        bits |= kCharm;
+      if (nq == 5)
+        bits |= kBottom;
+    }
+    if (nq1 == 0 && nq2 > 0 && nq2 == nq3)
+      bits |= kHidden;
+    table[q] = bits;
+  }
+  return table;
+}
+
+constexpr std::array<uint8_t, 1000> kQuarkTable = makeQuarkTable();
+
+// Hadron codes have n_q2 > 0 and at most 7 digits, so nuclei, leptons,
+// bosons and partons are not hadrons. Pythia's colour-octet onium states
+// (99000n_qn_q...) are classified like the singlet they turn into.
+constexpr bool isHadron(int pid) {
+  int a = pid < 0 ? -pid : pid;
+  return a >= 100 && a < 10000000 && (a / 100) % 10 > 0;
+}
+
+constexpr uint8_t quarkBits(int pid) {
+  int a = pid < 0 ? -pid : pid;
+  return isHadron(pid) ? kQuarkTable[(a / 10) % 1000] : 0;
+}
+
+// Open or hidden beauty
+constexpr bool isBHadron(int pid) { return quarkBits(pid) & kBottom; }
+
+// Charm content without beauty (open charm and charmonium)
+constexpr bool isCHadron(int pid) {
+  return (quarkBits(pid) & (kCharm | kBottom)) == kCharm;
+}
+
+constexpr bool isOnium(int pid) {
+  return (quarkBits(pid) & kHidden) && (quarkBits(pid) & (kCharm | kBottom));
+}
+
+// Heaviest quark flavour of a hadron (5, 4, 3) or 0 for light / non-hadrons
+constexpr int heaviestQuark(int pid) {
+  uint8_t bits = quarkBits(pid);
+  return (bits & kBottom) ? 5 : (bits & kCharm) ? 4 : (bits & kStrange) ? 3 : 0;
+}
+
+// True if the particle is its own antiparticle, so that charge conjugation
+// of a decay chain leaves its code unchanged
+constexpr bool isSelfConjugate(int pid) {
+  int a = pid < 0 ? -pid : pid;
+  if (a == 21 || a == 22 || a == 23 || a == 25 || a == 130 || a == 310)
+    return true;
+  return isHadron(pid) && (quarkBits(pid) & kHidden) != 0;
+}
+
+static_assert(isBHadron(521) && isBHadron(-5122) && isBHadron(553), "");
+static_assert(isCHadron(421) && isCHadron(443) && !isCHadron(541), "");
+static_assert(!isBHadron(5) && !isBHadron(1000822080), "");
+static_assert(isSelfConjugate(443) && !isSelfConjugate(421), "");
+
+} // namespace flavour
+
+// =============================================================================
+// PidIndex: event record entries bucketed by |PID|
+// =============================================================================
+// Buckets are kept between events and only cleared, so once the species
+// present in typical events have been seen no further allocation happens.
+class PidIndex {
+public:
+  // Index entries [0, iEnd) of the event (iEnd < 0: the whole event)
+  void build(const Pythia8::Event &event, int iEnd = -1) {
+    for (int slot : used)
+      buckets[slot].clear();
+    used.clear();
+    indexed = 0;
+    update(event, iEnd);
+  }
+
+  // Index entries appended since the last build/update, e.g. by EvtGen
+  void update(const Pythia8::Event &event, int iEnd = -1) {
+    int n = (iEnd < 0 || iEnd > event.size()) ? event.size() : iEnd;
+    for (int i = indexed; i < n; ++i) {
+      std::vector<int> &bucket = bucketFor(event[i].idAbs());
+      if (bucket.empty())
+        used.push_back(slotOf[event[i].idAbs()]);
+      bucket.push_back(i);
+    }
+    indexed = n > indexed ? n : indexed;
+  }
+
+  // Event indices of all entries with this |PID|, in event order
+  const std::vector<int> &find(int pid) const {
+    auto it = slotOf.find(std::abs(pid));
+    return it == slotOf.end() ? empty : buckets[it->second];
+  }
+
+  bool contains(int pid) const { return !find(pid).empty(); }
+  int size() const { return indexed; }
+
+private:
+  std::unordered_map<int, int> slotOf;
+  std::vector<std::vector<int>> buckets;
+  std::vector<int> used;
+  std::vector<int> empty;
+  int indexed = 0;
+
+  std::vector<int> &bucketFor(int absPid) {
+    auto it = slotOf.find(absPid);
+    if (it != slotOf.end())
+      return buckets[it->second];
+    slotOf.emplace(absPid, int(buckets.size()));
+    buckets.emplace_back();
+    return buckets.back();
+  }
+};
+
+// =============================================================================
+// DecayChain: declarative decay-chain matcher
+// =============================================================================
+class DecayChain {
+public:
+  DecayChain(int pidIn, std::initializer_list<DecayChain> daughtersIn = {})
+      : pid(pidIn), daughters(daughtersIn) {}
+
+  int headPid() const { return pid; }
+
+  // Number of particles in the chain (the length of a match)
+  int size() const {
+    int n = 1;
+    for (const DecayChain &d : daughters)
+      n += d.size();
+    return n;
+  }
+
+  // Extra photons among the decay products (PHOTOS FSR) are accepted by
+  // default; any other extra daughter fails the match
+  DecayChain &allowExtraPhotons(bool allow) {
+    extraPhotons = allow;
+    for (DecayChain &d : daughters)
+      d.allowExtraPhotons(allow);
+    return *this;
+  }
+
+  // Match the chain with its head at event entry i. On success the matched
+  // event indices are stored in chain order (head first, then depth first
+  // through the daughters as declared), always at their last copy.
+  bool match(const Pythia8::Event &event, int i,
+             std::vector<int> &matched) const {
+    matched.clear();
+    int id = event[i].id();
+    int sign = (id == pid || flavour::isSelfConjugate(pid)) ? 1 : -1;
+    if (id != sign * pid)
+      return false;
+    return matchNode(event, i, sign, matched);
+  }
+
+  // Find all matches among the candidates of the index. Each match appends
+  // size() indices to the output, so match k starts at k * size().
+  int findAll(const Pythia8::Event &event, const PidIndex &index,
+              std::vector<int> &matches) const {
+    matches.clear();
+    int nMatch = 0;
+    for (int i : index.find(pid)) {
+      // Only the last copy decays; earlier copies would double count
+      if (event[i].iBotCopyId() != i)
+        continue;
+      if (!match(event, i, scratch))
+        continue;
+      matches.insert(matches.end(), scratch.begin(), scratch.end());
+      ++nMatch;
+    }
+    return nMatch;
+  }
+
+private:
+  int pid;
+  std::vector<DecayChain> daughters;
+  bool extraPhotons = true;
+  mutable std::vector<int> scratch;
+
+  int expected(int sign) const {
+    return flavour::isSelfConjugate(pid) ? pid : sign * pid;
+  }
+
+  bool matchNode(const Pythia8::Event &event, int i, int sign,
+                 std::vector<int> &matched) const {
+    int iBot = event[i].iBotCopyId();
+    matched.push_back(iBot);
+    if (daughters.empty())
+      return true;
+
+    int d1 = event[iBot].daughter1();
+    int d2 = event[iBot].daughter2();
+    if (d1 <= 0)
+      return false;
+    if (d2 < d1)
+      d2 = d1;
+    int nDau = d2 - d1 + 1;
+    if (nDau < int(daughters.size()) || nDau > 32)
+      return false;
+    uint32_t usedMask = 0;
+    if (!assign(event, d1, nDau, 0, sign, usedMask, matched))
+      return false;
+    // Unassigned daughters must be photons if extras are allowed at all
+    for (int k = 0; k < nDau; ++k)
+      if (!(usedMask & (1u << k)) &&
+          (!extraPhotons || event[d1 + k].id() != 22))
+        return false;
+    return true;
+  }
+
+  // Backtracking assignment of declared daughters to distinct decay products
+  bool assign(const Pythia8::Event &event, int d1, int nDau, size_t iChild,
+              int sign, uint32_t &usedMask, std::vector<int> &matched) const {
+    if (iChild == daughters.size())
+      return true;
+    const DecayChain &child = daughters[iChild];
+    size_t mark = matched.size();
+    for (int k = 0; k < nDau; ++k) {
+      if (usedMask & (1u << k))
+        continue;
+      if (event[d1 + k].id() != child.expected(sign))
+        continue;
+      usedMask |= 1u << k;
+      if (child.matchNode(event, d1 + k, sign, matched) &&
+          assign(event, d1, nDau, iChild + 1, sign, usedMask, matched))
+        return true;
+      usedMask &= ~(1u << k);
+      matched.resize(mark);
+    }
+    return false;
+  }
+};
+
+} // namespace hepgen
+
+#endif // HEPGEN_SIGNAL_SELECTOR_H
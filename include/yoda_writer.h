@@ -0,0 +1,138 @@
+// =============================================================================
+// yoda_writer.h
+// -----------------------------------------------------------------------------
+// Minimal YODA-compatible histogram and counter objects for analyses that run
+// inside the generators. Objects are written in the YODA 2 text format
+// (YODA_HISTO1D_V3 / YODA_COUNTER_V3), so the output can be read by yodals,
+// yodamerge, rivet-mkhtml and the plotting scripts like a Rivet result.
+// Files are written to <path>.part and renamed into place, so a file that
+// is rewritten periodically (--snapshot-every) is never seen half-written
+// by scripts/aggregate_results.py.
+// =============================================================================
+
+#ifndef HEPGEN_YODA_WRITER_H
+#define HEPGEN_YODA_WRITER_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace hepgen {
+
+class YodaObject {
+public:
+  explicit YodaObject(const std::string &pathIn) : objPath(pathIn) {}
+  virtual ~YodaObject() = default;
+  const std::string &path() const { return objPath; }
+  virtual void write(std::ostream &os) const = 0;
+
+protected:
+  std::string objPath;
+};
+
+// Histogram with variable bin edges. Bin 0 is the underflow and bin
+// nBins() + 1 the overflow, as in the YODA 2 file layout.
+class YodaHisto1D : public YodaObject {
+public:
+  struct Bin {
+    double sumW = 0., sumW2 = 0., sumWX = 0., sumWX2 = 0., numEntries = 0.;
+  };
+
+  YodaHisto1D(const std::string &pathIn, const std::vector<double> &edgesIn)
+      : YodaObject(pathIn), edges(edgesIn), bins(edgesIn.size() + 1) {}
+
+  // Bins are [lo, hi): a value on the upper edge of the last bin overflows
+  void fill(double x, double w = 1.) {
+    size_t i = std::upper_bound(edges.begin(), edges.end(), x) - edges.begin();
+    Bin &b = bins[i];
+    b.sumW += w;
+    b.sumW2 += w * w;
+    b.sumWX += w * x;
+    b.sumWX2 += w * x * x;
+    b.numEntries += 1.;
+  }
+
+  size_t nBins() const { return edges.size() - 1; }
+  const Bin &bin(size_t i) const { return bins[i]; }
+
+  void write(std::ostream &os) const override {
+    double sumW = 0., sumWX = 0.;
+    for (const Bin &b : bins) {
+      sumW += b.sumW;
+      sumWX += b.sumWX;
+    }
+    os << std::scientific << std::setprecision(6);
+    os << "BEGIN YODA_HISTO1D_V3 " << objPath << "\n";
+    os << "Path: " << objPath << "\n";
+    os << "Type: Histo1D\n";
+    os << "---\n";
+    os << "# Mean: " << (sumW != 0. ? sumWX / sumW : 0.) << "\n";
+    os << "# Integral: " << sumW << "\n";
+    os << "Edges(A1): [";
+    for (size_t i = 0; i < edges.size(); ++i)
+      os << (i ? ", " : "") << edges[i];
+    os << "]\n";
+    os << "# sumW\tsumW2\tsumW(A1)\tsumW2(A1)\tnumEntries\n";
+    for (const Bin &b : bins)
+      os << b.sumW << "\t" << b.sumW2 << "\t" << b.sumWX << "\t" << b.sumWX2
+         << "\t" << b.numEntries << "\n";
+    os << "END YODA_HISTO1D_V3\n\n";
+  }
+
+private:
+  std::vector<double> edges;
+  std::vector<Bin> bins;
+};
+
+class YodaCounter : public YodaObject {
+public:
+  explicit YodaCounter(const std::string &pathIn) : YodaObject(pathIn) {}
+
+  void fill(double w = 1.) {
+    sumW += w;
+    sumW2 += w * w;
+    numEntries += 1.;
+  }
+
+  void write(std::ostream &os) const override {
+    os << std::scientific << std::setprecision(6);
+    os << "BEGIN YODA_COUNTER_V3 " << objPath << "\n";
+    os << "Path: " << objPath << "\n";
+    os << "Type: Counter\n";
+    os << "---\n";
+    os << "# sumW\tsumW2\tnumEntries\n";
+    os << sumW << "\t" << sumW2 << "\t" << numEntries << "\n";
+    os << "END YODA_COUNTER_V3\n\n";
+  }
+
+  double sumW = 0., sumW2 = 0., numEntries = 0.;
+};
+
+inline bool writeYodaFile(const std::string &path,
+                          const std::vector<const YodaObject *> &objects) {
+  std::string part = path + ".part";
+  {
+    std::ofstream out(part);
+    if (!out) {
+      std::cerr << "Cannot open YODA output " << part << std::endl;
+      return false;
+    }
+    for (const YodaObject *obj : objects)
+      obj->write(out);
+    if (!out)
+      return false;
+  }
+  if (std::rename(part.c_str(), path.c_str()) != 0) {
+    std::cerr << "Cannot rename " << part << " to " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace hepgen
+
+#endif // HEPGEN_YODA_WRITER_H
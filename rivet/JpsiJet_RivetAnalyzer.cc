@@ -5,7 +5,12 @@
 #include "Rivet/Projections/FinalState.hh"
 #include "Rivet/Projections/MissingMomentum.hh"
 #include "Rivet/Projections/PromptFinalState.hh"
+#include <cctype>
 #include <cmath> // Inclure la bibliothèque cmath pour std::pow()
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
 
 #include "Rivet/Analysis.hh"
 #include "Rivet/Particle.hh"
@@ -18,11 +23,19 @@
 #include "fastjet/JetDefinition.hh"
 #include "fastjet/contrib/LundGenerator.hh"
 
-#define JpsiDEBUG
+// Trace of the selection steps, printed for every event and jet selection.
+// Off by default; build the plugin with -DJpsiDEBUG to enable it.
 
 namespace Rivet {
 
 /// @brief Add a short analysis description here
+///
+/// Besides the built-in jet selection, the analysis can fill further jet
+/// selections in the same pass: set JPSIJET_CONFIGS to a card such as
+/// runcards/jpsijet_configs.txt. The J/psi selection, the final state and
+/// the tagging of the J/psi decay products are shared; jets are clustered
+/// once per distinct radius, and each selection books its own histograms
+/// with the suffix _<name>.
 class JpsiJet_RivetAnalyzer : public Analysis {
 public:
   // Constructor
@@ -49,22 +62,46 @@ public:
 
     // I kept only the histogram related to the observable z in the first
     // instance
-    book(_njets, "_njets");
 
     // book(_hZ, "zJpsi", {0.16, 0.22, 0.376, 0.532,  0.688, 0.844, 1.0});
     book(_hnJpsi, "nJpsi", {0, 1, 2, 3, 4});
-    book(_hZ, "zJpsi",
-         {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766, 0.844,
-          0.922, 1.0});
-    book(_hZqqcc, "zJpsiFromqqbar",
-         {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766, 0.844,
-          0.922, 1.0});
-    book(_hZgcc, "zJpsiFromgtocc",
-         {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766, 0.844,
-          0.922, 1.0});
-
     book(_hJpsipT, "JpsipT", {5, 6, 8, 10, 15, 20, 25, 30});
-    book(_hJetpT, "JetpT", {5, 10, 15, 20, 30, 40, 50, 70, 100});
+
+    // Jet selections: the built-in one first, then those of the card
+    _selections.clear();
+    _radii.clear();
+    _radiusPtMin.clear();
+    _selections.push_back(JetSelection());
+    const char *card = std::getenv("JPSIJET_CONFIGS");
+    if (card && *card)
+      readSelections(card);
+    for (JetSelection &sel : _selections) {
+      // One clustering per distinct radius, down to the lowest jet pT cut
+      sel.iRadius = 0;
+      while (sel.iRadius < _radii.size() && _radii[sel.iRadius] != sel.R)
+        ++sel.iRadius;
+      if (sel.iRadius == _radii.size()) {
+        _radii.push_back(sel.R);
+        _radiusPtMin.push_back(sel.ptMin);
+      }
+      _radiusPtMin[sel.iRadius] =
+          std::min(_radiusPtMin[sel.iRadius], sel.ptMin);
+
+      const string tag = sel.name.empty() ? "" : "_" + sel.name;
+      book(sel.njets, "_njets" + tag);
+      book(sel.hZ, "zJpsi" + tag,
+           {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766,
+            0.844, 0.922, 1.0});
+      book(sel.hZqqcc, "zJpsiFromqqbar" + tag,
+           {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766,
+            0.844, 0.922, 1.0});
+      book(sel.hZgcc, "zJpsiFromgtocc" + tag,
+           {0.16, 0.22, 0.298, 0.376, 0.454, 0.532, 0.610, 0.688, 0.766,
+            0.844, 0.922, 1.0});
+      book(sel.hJetpT, "JetpT" + tag, {5, 10, 15, 20, 30, 40, 50, 70, 100});
+    }
+    MSG_INFO(_selections.size() << " jet selection(s), " << _radii.size()
+                                << " clustering(s) per event");
   }
 
   void analyze(const Event &event) {
@@ -122,99 +159,167 @@ public:
       particles.push_back(p);
     }
 
-    JetDefinition jetDefAKT_Sig(fastjet::antikt_algorithm,
-                                0.4); // jet distance parameter
-    ClusterSequence antikTjets(particles, jetDefAKT_Sig); // cluster anti-kT
-    vector<PseudoJet> jets = fastjet::sorted_by_pt(antikTjets.inclusive_jets(
-        30)); // Jet projection : we only keep jets with pT > 30 Gev
-
-    //  printf("Pseudo jet size : %d, Clustered jet size : %d\n", (int)
-    //  particles.size(), (int) jets.size());
-
-    if (jets.size() < 1)
-      vetoEvent; // at least 1 jet in the event
-    _hJetpT->fill(jets[0].pt());
-    printf("Pass Jet Veto!!\n");
-    if (jpsi_particles.size() != 1)
-      vetoEvent; // 1 Jpsi in the final state (do we allow the finalstate to
-                 // have more than 1 Jpsi ? Maybe it will be interesting to
-                 // modify the routine so that you can treat the case of
-                 // multiple Jpsi productions)
+    // Cluster once per distinct radius; the sequences must outlive the jets
+    // (constituents() refers back to them)
+    vector<std::unique_ptr<ClusterSequence>> sequences;
+    vector<vector<PseudoJet>> jetsByRadius;
+    for (size_t iR = 0; iR < _radii.size(); ++iR) {
+      JetDefinition jetDefAKT_Sig(fastjet::antikt_algorithm,
+                                  _radii[iR]); // jet distance parameter
+      sequences.emplace_back(
+          new ClusterSequence(particles, jetDefAKT_Sig)); // cluster anti-kT
+      jetsByRadius.push_back(fastjet::sorted_by_pt(
+          sequences.back()->inclusive_jets(_radiusPtMin[iR])));
+    }
+
+    int fromGtoCC = -1; // evaluated once, on the first matched jet
+    for (JetSelection &sel : _selections) {
+      vector<PseudoJet> jets;
+      for (const PseudoJet &jet : jetsByRadius[sel.iRadius])
+        if (jet.pt() >= sel.ptMin)
+          jets.push_back(jet); // Jet projection : we only keep jets with pT >
+                               // ptMin (30 GeV by default)
+
+      //  printf("Pseudo jet size : %d, Clustered jet size : %d\n", (int)
+      //  particles.size(), (int) jets.size());
+
+      if (jets.size() < 1)
+        continue; // at least 1 jet in the event
+      sel.hJetpT->fill(jets[0].pt());
 #ifdef JpsiDEBUG
-    printf("Pass Unique Onia Veto!!\n");
+      printf("Pass Jet Veto!!\n");
 #endif
-    int nJets = 0;
-    const double maxDeltaRsquare = 0.4; // Define the maximum value of deltaR
-                                        // for the Jpsi to be in the Jet
-    for (size_t i = 0; i < jets.size(); ++i) // loop over all jets
-    {
-      // Check if the Jpsi is in the jet (should be changed in case we allow
-      // more than 1 Jpsi since we have to check for all Jpsi in this case)
-      // Calcul de deltaR
-      double deltaPhi = std::pow(jets[i].phi() - jpsi_particles[0].phi(), 2);
-      double deltaEta = std::pow(jets[i].eta() - jpsi_particles[0].eta(), 2);
-      double deltaRsquare = deltaPhi + deltaEta;
-      std::vector<PseudoJet> constituents = jets[i].constituents();
-      int hasJpsi = 0;
-      for (const auto &constituent : constituents) {
-        if (constituent.user_index() == 1313)
-          hasJpsi += 1;
-      }
+      if (jpsi_particles.size() != 1)
+        continue; // 1 Jpsi in the final state (do we allow the finalstate to
+                  // have more than 1 Jpsi ? Maybe it will be interesting to
+                  // modify the routine so that you can treat the case of
+                  // multiple Jpsi productions)
 #ifdef JpsiDEBUG
-      printf("Matching muon size %d\n", hasJpsi);
+      printf("Pass Unique Onia Veto!!\n");
 #endif
-      if (hasJpsi < 2)
-        continue;
+      int nJets = 0;
+      const double maxDeltaRsquare =
+          sel.dR2Max; // Define the maximum value of deltaR
+                      // for the Jpsi to be in the Jet
+      for (size_t i = 0; i < jets.size(); ++i) // loop over all jets
+      {
+        // Check if the Jpsi is in the jet (should be changed in case we allow
+        // more than 1 Jpsi since we have to check for all Jpsi in this case)
+        // Calcul de deltaR
+        double deltaPhi = std::pow(jets[i].phi() - jpsi_particles[0].phi(), 2);
+        double deltaEta = std::pow(jets[i].eta() - jpsi_particles[0].eta(), 2);
+        double deltaRsquare = deltaPhi + deltaEta;
+        std::vector<PseudoJet> constituents = jets[i].constituents();
+        int hasJpsi = 0;
+        for (const auto &constituent : constituents) {
+          if (constituent.user_index() == 1313)
+            hasJpsi += 1;
+        }
 #ifdef JpsiDEBUG
-      printf("Pass Jet has onia!!\n");
+        printf("Matching muon size %d\n", hasJpsi);
 #endif
-      if (deltaRsquare > maxDeltaRsquare)
-        continue;
+        if (hasJpsi < 2)
+          continue;
 #ifdef JpsiDEBUG
-      printf("Pass Jet dR!!\n");
+        printf("Pass Jet has onia!!\n");
 #endif
-      if (fabs(jets[i].pt()) > 40)
-        continue;
+        if (deltaRsquare > maxDeltaRsquare)
+          continue;
 #ifdef JpsiDEBUG
-      printf("Pass Jet pt 30-40!!\n");
+        printf("Pass Jet dR!!\n");
 #endif
-      if (fabs(jets[i].pseudorapidity()) > 2.)
-        continue; // jet acceptance cut (in the CMS article, pseudo-rapidity
-                  // should be smaller than 2)
+        if (fabs(jets[i].pt()) > sel.ptMax)
+          continue;
 #ifdef JpsiDEBUG
-      printf("Pass Jet Match!!\n");
+        printf("Pass Jet pt window!!\n");
 #endif
-      if (nJets > 0)
-        continue;
+        if (fabs(jets[i].pseudorapidity()) > sel.etaMax)
+          continue; // jet acceptance cut (in the CMS article, pseudo-rapidity
+                    // should be smaller than 2)
+#ifdef JpsiDEBUG
+        printf("Pass Jet Match!!\n");
+#endif
+        if (nJets > 0)
+          continue;
 #ifdef JpsiDEBUG
-      printf("Only first jet!!\n");
+        printf("Only first jet!!\n");
 #endif
 
-      nJets++; // count jets : the previous condition ensures that there is only
-               // one jet where the Jpsi is sitting
-      double z = jpsi_particles[0].pt() / jets[i].pt();
-      printf("z value: %f\n", z);
-      assert(z > 0);
-      if (isFromGtoCC(jpsi_particles[0]))
-        _hZgcc->fill(z);
-      else
-        _hZqqcc->fill(z);
+        nJets++; // count jets : the previous condition ensures that there is
+                 // only one jet where the Jpsi is sitting
+        double z = jpsi_particles[0].pt() / jets[i].pt();
+#ifdef JpsiDEBUG
+        printf("z value: %f\n", z);
+#endif
+        assert(z > 0);
+        if (fromGtoCC < 0)
+          fromGtoCC = isFromGtoCC(jpsi_particles[0]) ? 1 : 0;
+        if (fromGtoCC)
+          sel.hZgcc->fill(z);
+        else
+          sel.hZqqcc->fill(z);
 
-      _hZ->fill(z);
+        sel.hZ->fill(z);
 
-      _njets->fill(nJets);
+        sel.njets->fill(nJets);
+      }
     }
   }
   // Finalize method was retired since there is no need to renormalize the
   // histogramm related to z
 private:
+  // One jet selection and its histograms. The defaults are the built-in
+  // cuts, booked without a name suffix.
+  struct JetSelection {
+    string name;
+    double R = 0.4;       // anti-kT radius
+    double ptMin = 30.;   // jet pT window [GeV]
+    double ptMax = 40.;
+    double etaMax = 2.;   // jet acceptance
+    double dR2Max = 0.4;  // J/psi-jet matching
+    size_t iRadius = 0;   // index into _radii
+    Histo1DPtr hZ, hZgcc, hZqqcc, hJetpT;
+    CounterPtr njets;
+  };
+
   Histo1DPtr _hnJpsi;
-  Histo1DPtr _hZ;
-  Histo1DPtr _hZgcc;
-  Histo1DPtr _hZqqcc;
   Histo1DPtr _hJpsipT;
-  Histo1DPtr _hJetpT;
-  CounterPtr _njets;
+  vector<JetSelection> _selections;
+  vector<double> _radii, _radiusPtMin;
+
+  // Card format: <name> <R> <pT min> <pT max> <|eta| max> <dR^2 max>,
+  // '#' starts a comment
+  void readSelections(const string &path) {
+    std::ifstream in(path);
+    if (!in)
+      throw UserError("Cannot open jet selection card " + path);
+    string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+      ++lineNo;
+      size_t hash = line.find('#');
+      if (hash != string::npos)
+        line.erase(hash);
+      std::istringstream is(line);
+      JetSelection sel;
+      if (!(is >> sel.name))
+        continue;
+      const string where = path + ":" + std::to_string(lineNo) + ": ";
+      if (!(is >> sel.R >> sel.ptMin >> sel.ptMax >> sel.etaMax >> sel.dR2Max))
+        throw UserError(where + "expected '<name> <R> <pT min> <pT max> "
+                                "<|eta| max> <dR^2 max>'");
+      for (char c : sel.name)
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+          throw UserError(where + "invalid selection name " + sel.name);
+      for (const JetSelection &other : _selections)
+        if (other.name == sel.name)
+          throw UserError(where + "duplicate selection name " + sel.name);
+      if (sel.R <= 0. || sel.ptMin < 0. || sel.ptMax <= sel.ptMin)
+        throw UserError(where + "invalid radius or pT window");
+      _selections.push_back(sel);
+    }
+  }
+
   bool isFromGtoCC(const Particle &p) const {
     // Start with the current particle
     std::vector<Particle> ancestors = {p};
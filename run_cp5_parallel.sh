@@ -2,16 +2,44 @@
 
 # =============================================================================
 # run_cp5_parallel.sh - Parallel D0 Producion with CMS CP5 Tune
-# Supports TOTAL_EVENTS and NUM_CORES environment variables
+# Supports TOTAL_EVENTS, NUM_CORES, CENTRALITY, EMBED_LIBRARY, PRECISION,
+# ADAPTIVE_BIAS and SEED environment variables
 # =============================================================================
 
 # Configuration (Use env vars if set, otherwise defaults)
 TOTAL_EVENTS=${TOTAL_EVENTS:-100000}
 NUM_CORES=${NUM_CORES:-$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 4)}
 EVENTS_PER_CORE=$((TOTAL_EVENTS / NUM_CORES))
+# Campaign seed: core i generates global events (i-1)*EVENTS_PER_CORE onward,
+# so the combined sample is the same for any NUM_CORES
+SEED=${SEED:-1234}
 IMAGE_NAME="cmsana-gen:py8313-evtgen200"
 OUTPUT_DIR="$(pwd)/output_cp5"
 FINAL_OUTPUT="output_cp5_combined.txt"
+CENTRALITY=${CENTRALITY:-} # e.g. "0-10,30-50" (empty = minimum bias)
+EMBED_LIBRARY=${EMBED_LIBRARY:-} # background library for pp-signal embedding
+CENT_ARGS=""
+if [ -n "$CENTRALITY" ]; then
+    CENT_ARGS="--centrality $CENTRALITY"
+fi
+if [ -n "$EMBED_LIBRARY" ]; then
+    CENT_ARGS="$CENT_ARGS --embed /work/$EMBED_LIBRARY"
+fi
+# Target precision of the merged sample, e.g. "rho00=0.02,v2=0.01". Each
+# core stops at sqrt(NUM_CORES) times the target; TOTAL_EVENTS is the limit.
+PRECISION=${PRECISION:-}
+ADAPTIVE_BIAS=${ADAPTIVE_BIAS:-} # pTHat bias power (with EMBED_LIBRARY)
+if [ -n "$PRECISION" ]; then
+    CORE_PRECISION=$(echo "$PRECISION" | awk -v n="$NUM_CORES" -F, '{
+        for (i = 1; i <= NF; i++) {
+            split($i, kv, "=")
+            printf "%s%s=%g", (i > 1 ? "," : ""), kv[1], kv[2] * sqrt(n)
+        } }')
+    CENT_ARGS="$CENT_ARGS --target-precision $CORE_PRECISION"
+    if [ -n "$ADAPTIVE_BIAS" ]; then
+        CENT_ARGS="$CENT_ARGS --adaptive-bias $ADAPTIVE_BIAS"
+    fi
+fi
 
 # Ensure we have the LHAPDF data directory or mount point
 LHAPDF_DIR="$(pwd)/lhapdf_data"
@@ -21,12 +49,15 @@ if [ ! -d "$LHAPDF_DIR/NNPDF31_nnlo_as_0118" ]; then
     # Attempt to continue if the user knows what they are doing
 fi
 
-mkdir -p "$OUTPUT_DIR"
+mkdir -p "$OUTPUT_DIR/snapshots"
 
 echo "=================================================="
 echo "Starting Parallel CP5 D0 Study"
 echo "Total Events: $TOTAL_EVENTS"
 echo "Cores: $NUM_CORES ($EVENTS_PER_CORE events/core)"
+echo "Centrality: ${CENTRALITY:-minimum bias}"
+echo "Embedding library: ${EMBED_LIBRARY:-none (full Angantyr events)}"
+echo "Target precision: ${PRECISION:-none (fixed event count)}${CORE_PRECISION:+, $CORE_PRECISION per core}"
 echo "Output Directory: $OUTPUT_DIR"
 echo "=================================================="
 
@@ -38,17 +69,21 @@ docker run --rm -v "$(pwd):/work" -v "$LHAPDF_DIR:/work/lhapdf_data" "$IMAGE_NAM
 # Launch parallel jobs
 pids=()
 for i in $(seq 1 $NUM_CORES); do
-    SEED=$((1234 + i))
+    FIRST_EVENT=$(((i - 1) * EVENTS_PER_CORE))
     CORE_OUT="/work/output_cp5/out_core_$i.txt"
-    echo "Launching Core $i (Seed: $SEED)..."
+    echo "Launching Core $i (Seed: $SEED, first event: $FIRST_EVENT)..."
     
     docker run --rm -v "$(pwd):/work" -v "$LHAPDF_DIR:/work/lhapdf_data" "$IMAGE_NAME" \
-        /work/build/gen_d0_study $EVENTS_PER_CORE $SEED "$CORE_OUT" > "$OUTPUT_DIR/log_core_$i.log" 2>&1 &
+        /work/build/gen_d0_study $EVENTS_PER_CORE $SEED "$CORE_OUT" $CENT_ARGS \
+        --first-event $FIRST_EVENT \
+        --snapshot "/work/output_cp5/snapshots/core_$i.acc" \
+        > "$OUTPUT_DIR/log_core_$i.log" 2>&1 &
     
     pids+=($!)
 done
 
 echo "Jobs running. Waiting for completion..."
+echo "Per-bin rho00 / v2 so far: python3 scripts/aggregate_results.py $OUTPUT_DIR/snapshots -o $OUTPUT_DIR/merged"
 
 # Wait for all jobs
 for pid in "${pids[@]}"; do
@@ -57,11 +92,11 @@ done
 
 echo "All jobs finished. Merging results..."
 
-# Merge and clean (ensure exactly 5 columns)
+# Merge and clean (ensure exactly 10 columns, drop per-class summary comments)
 rm -f "$FINAL_OUTPUT"
 for i in $(seq 1 $NUM_CORES); do
     if [ -f "$OUTPUT_DIR/out_core_$i.txt" ]; then
-        awk 'NF == 5' "$OUTPUT_DIR/out_core_$i.txt" >> "$FINAL_OUTPUT"
+        awk 'NF == 10 && $1 != "#"' "$OUTPUT_DIR/out_core_$i.txt" >> "$FINAL_OUTPUT"
     fi
 done
 
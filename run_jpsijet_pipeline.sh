@@ -6,23 +6,118 @@
 # Default settings
 EVENTS=${1:-5000}
 MODE=${2:-prompt} # prompt or nonprompt
+# Analysis engine:
+#   NATIVE=1          run the analysis inside the generator, no HepMC3/Rivet
+#   VALIDATE_NATIVE=1 run both on the same events and compare bin by bin
+NATIVE=${NATIVE:-0}
+VALIDATE_NATIVE=${VALIDATE_NATIVE:-0}
+# Systematics:
+#   VARIATIONS=1      add parton-shower scale variations as event weights;
+#                     every histogram is also filled once per variation
+VARIATIONS=${VARIATIONS:-0}
+VAR_ARGS=""
+if [ "$VARIATIONS" == "1" ]; then
+    VAR_ARGS="--variations /work/runcards/shower_variations.cmnd"
+fi
+# Cut studies:
+#   CONFIGS=<card>    extra jet selections (radius, pT window, acceptance)
+#                     filled in the same pass, e.g.
+#                     CONFIGS=runcards/jpsijet_configs.txt
+CONFIGS=${CONFIGS:-}
+CONFIG_ARGS=""
+if [ -n "$CONFIGS" ]; then
+    CONFIG_ARGS="--native-configs /work/$CONFIGS"
+fi
+# Detector level:
+#   DETECTOR=1        smear the final state with runcards/detector_cms.cmnd
+#                     (or DETECTOR=<card>) before output and analysis; the
+#                     results are written as results_<mode>_det*.yoda
+DETECTOR=${DETECTOR:-0}
+DET_ARGS=""
+DET_TAG=""
+if [ "$DETECTOR" == "1" ]; then
+    DET_ARGS="--detector /work/runcards/detector_cms.cmnd"
+    DET_TAG="_det"
+elif [ "$DETECTOR" != "0" ]; then
+    DET_ARGS="--detector /work/$DETECTOR"
+    DET_TAG="_det"
+fi
+# Parallel streaming:
+#   GENERATORS=N      N generator containers, the events are split between
+#                     them (prompt: seed SEED with disjoint event ranges, so
+#                     the sample does not depend on N; nonprompt counts
+#                     signal events, all with seed SEED and --job 0, 1, ...)
+#   SHARDS=K          K rivet consumer processes (RIVET_SHARD_MODE=load to
+#                     balance by consumer speed instead of round-robin)
+GENERATORS=${GENERATORS:-1}
+SHARDS=${SHARDS:-1}
+SEED=${SEED:-12345}
 IMAGE_GEN="cmsana-gen:py8313-evtgen200"
 IMAGE_RIVET="cmsana-rivet:latest"
 ANALYSIS_FILE="rivet/JpsiJet_RivetAnalyzer.cc"
 ANALYSIS_NAME="JpsiJet_RivetAnalyzer"
 FIFO_NAME="events.fifo"
-OUTPUT_YODA="results_${MODE}.yoda"
+OUTPUT_YODA="results_${MODE}${DET_TAG}.yoda"
+NATIVE_YODA="results_${MODE}${DET_TAG}_native.yoda"
 
 echo "=== Starting J/psi in Jets Pipeline ($MODE mode) ==="
 echo "Events: $EVENTS"
 
-# 1. Cleanup old files
-rm -f $FIFO_NAME
-mkfifo $FIFO_NAME
+# Native mode: the generator analyzes its own record, nothing is serialized
+if [ "$NATIVE" == "1" ]; then
+    if [ "$MODE" == "prompt" ]; then
+        GEN_EXEC="/work/build/gen_prompt_jpsi"
+        GEN_ARGS="--filter-card /work/runcards/jpsijet_filter.cmnd"
+    else
+        GEN_EXEC="/work/build/gen_bpkjpsi"
+        GEN_ARGS=""
+    fi
+    echo "Running native analysis: $GEN_EXEC"
+    docker run --rm \
+        -v "$(pwd):/work" \
+        -v "$(pwd)/lhapdf_data:/work/lhapdf_data" \
+        "$IMAGE_GEN" \
+        "$GEN_EXEC" "$EVENTS" /dev/null $GEN_ARGS $VAR_ARGS $DET_ARGS \
+        --native "/work/$NATIVE_YODA" $CONFIG_ARGS --no-hepmc --seed "$SEED"
+    echo "Pipeline Finished! Results in $NATIVE_YODA"
+    exit 0
+fi
+
+# gen_bpkjpsi analyzes its non-prompt J/psi natively, Rivet vetoes them
+if [ "$VALIDATE_NATIVE" == "1" ] && [ "$MODE" != "prompt" ]; then
+    echo "ERROR: VALIDATE_NATIVE=1 needs prompt mode (Rivet vetoes non-prompt J/psi)"
+    exit 1
+fi
+if [ "$VALIDATE_NATIVE" == "1" ] && [ "$GENERATORS" -gt 1 ]; then
+    echo "ERROR: VALIDATE_NATIVE=1 needs GENERATORS=1"
+    exit 1
+fi
+
+# 1. Cleanup old files (one FIFO per generator)
+FIFOS=()
+for ((g = 0; g < GENERATORS; g++)); do
+    if [ "$GENERATORS" -eq 1 ]; then
+        FIFOS+=("$FIFO_NAME")
+    else
+        FIFOS+=("events_g$g.fifo")
+    fi
+done
+rm -f "${FIFOS[@]}"
+mkfifo "${FIFOS[@]}"
+FIFO_LIST=$(IFS=,; echo "${FIFOS[*]}")
 
-# 2. Determine which generator to use
+# 2. Determine which generator to use; both format their HepMC3 output
+# directly from the pooled event (no GenEvent objects per event)
+GEN_ARGS="--pooled-hepmc"
+NATIVE_ARGS=""
+if [ "$VALIDATE_NATIVE" == "1" ]; then
+    # Same events go to Rivet (FIFO) and to the native analysis
+    NATIVE_ARGS="--native /work/$NATIVE_YODA $CONFIG_ARGS"
+fi
 if [ "$MODE" == "prompt" ]; then
     GEN_EXEC="/work/build/gen_prompt_jpsi"
+    # Drop events without an accepted J/psi before HepMC3 conversion
+    GEN_ARGS="$GEN_ARGS --filter-card /work/runcards/jpsijet_filter.cmnd"
 else
     GEN_EXEC="/work/build/gen_bpkjpsi"
 fi
@@ -31,21 +126,46 @@ fi
 echo "Starting Rivet Service Container..."
 docker run --rm -d \
     --name rivet_service \
+    -e RIVET_SHARDS="$SHARDS" \
+    -e RIVET_SHARD_MODE="${RIVET_SHARD_MODE:-roundrobin}" \
+    -e JPSIJET_CONFIGS="${CONFIGS:+/work/$CONFIGS}" \
     -v "$(pwd):/work" \
     "$IMAGE_RIVET" \
-    "$ANALYSIS_FILE" "$ANALYSIS_NAME" "$FIFO_NAME" "$OUTPUT_YODA"
+    "$ANALYSIS_FILE" "$ANALYSIS_NAME" "$FIFO_LIST" "$OUTPUT_YODA"
 
-# 4. Start Generator (Foreground)
-echo "Starting Generator: $GEN_EXEC"
-docker run --rm \
-    -v "$(pwd):/work" \
-    -v "$(pwd)/lhapdf_data:/work/lhapdf_data" \
-    "$IMAGE_GEN" \
-    "$GEN_EXEC" "$EVENTS" "/work/$FIFO_NAME"
+# 4. Start Generators (Foreground)
+echo "Starting Generator: $GEN_EXEC (x$GENERATORS)"
+GEN_PIDS=()
+FIRST=0
+for ((g = 0; g < GENERATORS; g++)); do
+    # Split the events; the first generator takes the remainder
+    N_GEN=$((EVENTS / GENERATORS))
+    [ "$g" -eq 0 ] && N_GEN=$((N_GEN + EVENTS % GENERATORS))
+    if [ "$MODE" == "prompt" ]; then
+        SEED_ARGS="--seed $SEED --first-event $FIRST"
+    else
+        SEED_ARGS="--seed $SEED --job $g"
+    fi
+    FIRST=$((FIRST + N_GEN))
+    docker run --rm \
+        -v "$(pwd):/work" \
+        -v "$(pwd)/lhapdf_data:/work/lhapdf_data" \
+        "$IMAGE_GEN" \
+        "$GEN_EXEC" "$N_GEN" "/work/${FIFOS[$g]}" $GEN_ARGS $NATIVE_ARGS $VAR_ARGS \
+        $DET_ARGS $SEED_ARGS &
+    GEN_PIDS+=($!)
+done
+wait "${GEN_PIDS[@]}"
 
 # 5. Wait for Rivet to finish
 echo "Waiting for Rivet to finalize..."
 docker wait rivet_service > /dev/null
 
 echo "Pipeline Finished! Results in $OUTPUT_YODA"
-rm -f $FIFO_NAME
+rm -f "${FIFOS[@]}"
+
+# 6. Validation: native result must match Rivet bin by bin
+if [ "$VALIDATE_NATIVE" == "1" ]; then
+    echo "Comparing $NATIVE_YODA against $OUTPUT_YODA..."
+    python3 scripts/compare_yoda.py "$OUTPUT_YODA" "$NATIVE_YODA" || exit 1
+fi
@@ -0,0 +1,462 @@
+#!/usr/bin/env python3
+"""Merge partial results of running jobs from a drop directory.
+
+    python3 scripts/aggregate_results.py /shared/snapshots -o merged/
+    python3 scripts/aggregate_results.py /shared/snapshots -o merged/ \\
+        --watch 60 --target rho00=0.01,v2=0.005 --on-converged "condor_rm 1234"
+    python3 scripts/aggregate_results.py snaps/ -o merged/ --watch 60 \\
+        --rel-error 0.05 --histos '/JpsiJet_RivetAnalyzer/zJpsi$'
+
+Jobs write snapshots of their results into a shared directory while they
+run. No network service is involved; files are the only interface:
+
+  *.yoda  YODA files rewritten as the job runs: --native with
+          --snapshot-every in gen_prompt_jpsi / gen_bpkjpsi, or the output
+          that rivet rewrites every --histo-interval events. Histo1D and
+          Counter objects are added bin by bin. Of Rivet files only the
+          /RAW/ objects are used, since finalized ones do not add.
+  *.acc   gen_d0_study --snapshot: per (prompt/non-prompt, pT bin) sums for
+          rho00 and v2 (include/precision_monitor.h)
+
+Snapshots are cumulative, so only the latest one of each job counts.
+A job is the file name for YODA files and (seed, first event) for
+accumulators. If a job appears twice, e.g. retried by condor under another
+name, the copy with more events is used. Identical YODA files count once.
+A file that cannot be parsed (being written by a writer that does not
+rename) keeps its previous version until the next pass.
+
+Every pass that sees a change rewrites, in the output directory:
+
+  merged.yoda      sum of the YODA snapshots (raw objects)
+  merged_d0.acc    sum of the accumulators, same format as the inputs
+  status.json      jobs, events, and statistics per bin: sumW, error and
+                   Neff for every histogram bin; rho00 and v2 with errors
+                   for the D0 bins
+
+With --target (accumulators) and/or --rel-error (histograms matched by
+--histos), the merged result is checked for convergence after each pass.
+Once it has converged, --on-converged runs, e.g. condor_rm of the cluster,
+and the watch ends.
+"""
+
+import argparse
+import hashlib
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import time
+
+ACC_MAGIC = "# hepgen accumulator d0_precision v1"
+ACC_SUMS = ("n", "sumW", "sumW2", "sumC2", "sumC4", "sumV", "sumV2")
+MIN_ENTRIES = 50  # as PrecisionMonitor::kMinEntries
+
+
+# -----------------------------------------------------------------------------
+# YODA
+# -----------------------------------------------------------------------------
+
+def parse_yoda(text):
+    """Histo1D and Counter objects of a YODA 2 text file as
+    {path: {"type", "annotations", "edges", "rows"}}. Raises ValueError
+    on an incomplete file."""
+    objects = {}
+    lines = text.splitlines()
+    i = 0
+    while i < len(lines):
+        line = lines[i]
+        if not line.startswith("BEGIN YODA_"):
+            i += 1
+            continue
+        kind, path = line.split()[1], line.split()[2]
+        end = f"END {kind}"
+        block = []
+        i += 1
+        while i < len(lines) and lines[i] != end:
+            block.append(lines[i])
+            i += 1
+        if i == len(lines):
+            raise ValueError(f"unterminated {kind} {path}")
+        i += 1
+        if kind not in ("YODA_HISTO1D_V3", "YODA_COUNTER_V3"):
+            continue
+        if "---" not in block:
+            raise ValueError(f"malformed {kind} {path}")
+        sep = block.index("---")
+        obj = {"type": kind, "annotations": block[:sep], "edges": None,
+               "rows": []}
+        for row in block[sep + 1:]:
+            if row.startswith("Edges(A1): "):
+                obj["edges"] = row[len("Edges(A1): "):]
+            elif row and not row.startswith("#"):
+                obj["rows"].append([float(x) for x in row.split()])
+        objects[path] = obj
+    if any(p.startswith("/RAW/") for p in objects):
+        objects = {p: o for p, o in objects.items() if p.startswith("/RAW/")}
+    return objects
+
+
+def merge_yoda(snapshots):
+    """Add the objects of several parsed files bin by bin."""
+    merged = {}
+    for objects in snapshots:
+        for path, obj in objects.items():
+            if path not in merged:
+                merged[path] = {**obj, "rows": [r[:] for r in obj["rows"]]}
+                continue
+            m = merged[path]
+            if m["edges"] != obj["edges"] or len(m["rows"]) != len(
+                    obj["rows"]):
+                print(f"Warning: binning of {path} differs between jobs, "
+                      "keeping the first", file=sys.stderr)
+                continue
+            for mr, r in zip(m["rows"], obj["rows"]):
+                for k in range(len(mr)):
+                    mr[k] += r[k]
+    return merged
+
+
+def format_yoda(objects):
+    """Text of merged objects, in the layout of include/yoda_writer.h."""
+    out = []
+    for path in sorted(objects):
+        obj = objects[path]
+        out.append(f"BEGIN {obj['type']} {path}")
+        out.extend(obj["annotations"])
+        out.append("---")
+        if obj["type"] == "YODA_HISTO1D_V3":
+            sum_w = sum(r[0] for r in obj["rows"])
+            sum_wx = sum(r[2] for r in obj["rows"])
+            out.append(f"# Mean: {sum_wx / sum_w if sum_w else 0.:.6e}")
+            out.append(f"# Integral: {sum_w:.6e}")
+            out.append(f"Edges(A1): {obj['edges']}")
+            out.append("# sumW\tsumW2\tsumW(A1)\tsumW2(A1)\tnumEntries")
+        else:
+            out.append("# sumW\tsumW2\tnumEntries")
+        for r in obj["rows"]:
+            out.append("\t".join(f"{x:.6e}" for x in r))
+        out.append(f"END {obj['type']}")
+        out.append("")
+    return "\n".join(out) + "\n"
+
+
+def yoda_events(objects):
+    """Entries of the event counter, if the file has one."""
+    for path, obj in objects.items():
+        if path.rstrip("/").endswith("_EVTCOUNT") and obj["rows"]:
+            return int(obj["rows"][0][-1])
+    return None
+
+
+def histo_stats(path, obj):
+    """Per-bin sumW, error and Neff of a Histo1D (underflow and overflow
+    excluded) or of a Counter."""
+    rows = obj["rows"]
+    if obj["type"] == "YODA_HISTO1D_V3":
+        rows = rows[1:-1]
+    bins = []
+    for r in rows:
+        sum_w, sum_w2, entries = r[0], r[1], r[-1]
+        err = math.sqrt(sum_w2)
+        bins.append({"sumW": sum_w, "err": err,
+                     "relErr": err / abs(sum_w) if sum_w else None,
+                     "nEff": sum_w * sum_w / sum_w2 if sum_w2 else 0.,
+                     "entries": entries})
+    return bins
+
+
+# -----------------------------------------------------------------------------
+# Accumulators (gen_d0_study --snapshot)
+# -----------------------------------------------------------------------------
+
+def parse_acc(text):
+    lines = text.splitlines()
+    if not lines or lines[0] != ACC_MAGIC:
+        raise ValueError("not an accumulator snapshot")
+    acc = {"bins": {}}
+    for line in lines[1:]:
+        f = line.split()
+        if not f:
+            continue
+        if f[0] == "job":
+            acc["job"] = (int(f[1]), int(f[2]))
+        elif f[0] == "events":
+            acc["events"], acc["final"] = int(f[1]), bool(int(f[3]))
+        elif f[0] == "ptEdges":
+            acc["ptEdges"] = [float(x) for x in f[1:]]
+        elif f[0] == "bin":
+            acc["bins"][(int(f[1]), int(f[2]))] = \
+                [int(f[3])] + [float(x) for x in f[4:]]
+    n_bins = 2 * (len(acc.get("ptEdges", [])) - 1)
+    if "job" not in acc or "events" not in acc or len(acc["bins"]) != n_bins:
+        raise ValueError("incomplete accumulator snapshot")
+    return acc
+
+
+def merge_acc(accs):
+    merged = None
+    for acc in accs:
+        if merged is None:
+            merged = {"ptEdges": acc["ptEdges"], "events": 0,
+                      "bins": {k: [0] * len(ACC_SUMS) for k in acc["bins"]}}
+        if acc["ptEdges"] != merged["ptEdges"]:
+            print(f"Warning: job {acc['job']} has other pT bins, skipped",
+                  file=sys.stderr)
+            continue
+        merged["events"] += acc["events"]
+        for key, sums in acc["bins"].items():
+            merged["bins"][key] = [a + b for a, b in
+                                   zip(merged["bins"][key], sums)]
+    return merged
+
+
+def format_acc(merged, n_jobs, final):
+    lines = [ACC_MAGIC, f"job merged {n_jobs}",
+             f"events {merged['events']} final {int(final)}",
+             "ptEdges " + " ".join(f"{e:g}" for e in merged["ptEdges"])]
+    for (t, i), s in sorted(merged["bins"].items()):
+        lines.append(f"bin {t} {i} {s[0]} " + " ".join(repr(x) for x in s[1:]))
+    return "\n".join(lines) + "\n"
+
+
+def acc_stats(merged):
+    """rho00 and v2 with errors per bin, as PrecisionBin."""
+    out = []
+    edges = merged["ptEdges"]
+    for (t, i), (n, sw, sw2, sc2, sc4, sv, sv2) in sorted(
+            merged["bins"].items()):
+        neff = sw * sw / sw2 if sw2 > 0 else 0.
+
+        def err(sx, sx2):
+            if neff <= 1.:
+                return math.inf
+            mean = sx / sw
+            return math.sqrt(max(sx2 / sw - mean * mean, 0.) / neff)
+        out.append({
+            "type": "non-prompt" if t else "prompt",
+            "ptMin": edges[i], "ptMax": edges[i + 1], "n": n, "nEff": neff,
+            "rho00": 0.5 * (5. * sc2 / sw - 1.) if sw > 0 else None,
+            "rho00Err": 2.5 * err(sc2, sc4),
+            "v2": sv / sw if sw > 0 else None,
+            "v2Err": err(sv, sv2),
+        })
+    return out
+
+
+# -----------------------------------------------------------------------------
+# Drop directory
+# -----------------------------------------------------------------------------
+
+class DropDirectory:
+    """Latest parsed snapshot of every file, re-read when it changes."""
+
+    def __init__(self, dirs):
+        self.dirs = dirs
+        self.files = {}  # path -> (stamp, kind, parsed, digest)
+
+    def scan(self):
+        """Re-read changed files; return True if anything changed."""
+        changed = False
+        seen = set()
+        for d in self.dirs:
+            try:
+                names = os.listdir(d)
+            except OSError as e:
+                print(f"Cannot list {d}: {e}", file=sys.stderr)
+                continue
+            for name in names:
+                kind = os.path.splitext(name)[1]
+                if kind not in (".yoda", ".acc"):
+                    continue
+                path = os.path.join(d, name)
+                seen.add(path)
+                try:
+                    st = os.stat(path)
+                except OSError:
+                    continue
+                stamp = (st.st_mtime_ns, st.st_size)
+                old = self.files.get(path)
+                if old and old[0] == stamp:
+                    continue
+                try:
+                    with open(path, "rb") as f:
+                        raw = f.read()
+                    text = raw.decode()
+                    parsed = parse_yoda(text) if kind == ".yoda" \
+                        else parse_acc(text)
+                except (OSError, UnicodeDecodeError, ValueError,
+                        IndexError) as e:
+                    # Probably being written: keep the previous version
+                    if not old:
+                        print(f"Skipping {path} for now: {e}",
+                              file=sys.stderr)
+                    continue
+                digest = hashlib.sha1(raw).hexdigest()
+                self.files[path] = (stamp, kind, parsed, digest)
+                changed = True
+        for path in set(self.files) - seen:
+            del self.files[path]
+            changed = True
+        return changed
+
+    def jobs(self):
+        """Deduplicated (yoda, acc) snapshots: {job: (path, parsed)}."""
+        yoda, acc, digests = {}, {}, set()
+        for path, (_, kind, parsed, digest) in sorted(self.files.items()):
+            if kind == ".yoda":
+                if digest in digests:
+                    continue
+                digests.add(digest)
+                yoda[os.path.basename(path)] = (path, parsed)
+            else:
+                key = parsed["job"]
+                if key not in acc or (parsed["final"], parsed["events"]) > (
+                        acc[key][1]["final"], acc[key][1]["events"]):
+                    acc[key] = (path, parsed)
+        return yoda, acc
+
+
+def write_atomic(path, text):
+    with open(path + ".part", "w") as f:
+        f.write(text)
+    os.replace(path + ".part", path)
+
+
+def parse_targets(spec):
+    targets = {}
+    for item in filter(None, spec.split(",")):
+        key, _, value = item.partition("=")
+        if key not in ("rho00", "v2"):
+            raise argparse.ArgumentTypeError(f"bad target '{item}'")
+        targets[key] = float(value)
+    return targets
+
+
+def aggregate(drop, args):
+    """Merge, write the outputs and return (status, converged)."""
+    yoda_jobs, acc_jobs = drop.jobs()
+    status = {"time": time.strftime("%Y-%m-%dT%H:%M:%S"), "jobs": []}
+    checks = []
+
+    if yoda_jobs:
+        merged = merge_yoda(parsed for _, parsed in yoda_jobs.values())
+        write_atomic(os.path.join(args.output, "merged.yoda"),
+                     format_yoda(merged))
+        pattern = re.compile(args.histos) if args.histos else None
+        histos = {}
+        for path, obj in merged.items():
+            bins = histo_stats(path, obj)
+            histos[path] = bins
+            if args.rel_error and (pattern is None or pattern.search(path)):
+                filled = [b for b in bins if b["entries"] > 0]
+                checks.append(bool(filled) and all(
+                    b["relErr"] is not None and b["relErr"] <= args.rel_error
+                    for b in filled))
+        events = [yoda_events(p) for _, p in yoda_jobs.values()]
+        status["yoda"] = {"files": len(yoda_jobs),
+                          "events": sum(e for e in events if e),
+                          "histograms": histos}
+        for name, (path, parsed) in sorted(yoda_jobs.items()):
+            status["jobs"].append({"file": path, "events":
+                                   yoda_events(parsed)})
+
+    if acc_jobs:
+        merged = merge_acc(parsed for _, parsed in acc_jobs.values())
+        n_final = sum(p["final"] for _, p in acc_jobs.values())
+        write_atomic(os.path.join(args.output, "merged_d0.acc"),
+                     format_acc(merged, len(acc_jobs),
+                                n_final == len(acc_jobs)))
+        bins = acc_stats(merged)
+        for b in bins:
+            b["converged"] = b["n"] >= MIN_ENTRIES and all(
+                b[f"{k}Err"] <= t for k, t in args.target.items())
+        if args.target:
+            checks.append(all(b["converged"] for b in bins))
+        status["d0"] = {"jobs": len(acc_jobs), "final": n_final,
+                        "events": merged["events"], "targets": args.target,
+                        "bins": bins}
+        for key, (path, parsed) in sorted(acc_jobs.items()):
+            status["jobs"].append({"file": path, "seed": key[0],
+                                   "firstEvent": key[1],
+                                   "events": parsed["events"],
+                                   "final": parsed["final"]})
+
+    converged = bool(checks) and all(checks)
+    status["converged"] = converged
+    write_atomic(os.path.join(args.output, "status.json"),
+                 json.dumps(status, indent=2, default=str))
+    return status, converged
+
+
+def report(status, args):
+    print(f"[{status['time']}] {len(status['jobs'])} snapshot(s)"
+          + (", converged" if status["converged"] else ""))
+    if "yoda" in status:
+        y = status["yoda"]
+        worst = [b["relErr"] for path, bins in y["histograms"].items()
+                 if not args.histos or re.search(args.histos, path)
+                 for b in bins if b["relErr"] is not None]
+        print(f"  YODA: {y['files']} file(s), {y['events']} events, "
+              f"{len(y['histograms'])} objects"
+              + (f", worst relative bin error {max(worst):.3g}"
+                 if worst else ""))
+    if "d0" in status:
+        d = status["d0"]
+        print(f"  D0: {d['jobs']} job(s) ({d['final']} finished), "
+              f"{d['events']} events")
+        for b in d["bins"]:
+            rho = "-" if b["rho00"] is None else \
+                f"{b['rho00']:6.3f} +- {b['rho00Err']:6.4f}"
+            v2 = "-" if b["v2"] is None else \
+                f"{b['v2']:7.4f} +- {b['v2Err']:6.4f}"
+            print(f"    {b['type']:10s} {b['ptMin']:5.1f}-{b['ptMax']:5.1f} "
+                  f"GeV  n {b['n']:8d}  rho00 {rho}  v2 {v2}  "
+                  + ("ok" if b["converged"] else "-"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dirs", nargs="+", help="snapshot directories")
+    parser.add_argument("-o", "--output", required=True,
+                        help="directory for merged results and status.json")
+    parser.add_argument("--watch", type=float, default=0,
+                        help="poll every N seconds (default: one pass)")
+    parser.add_argument("--target", type=parse_targets, default={},
+                        help="D0 precision of the merged sample, e.g. "
+                             "rho00=0.01,v2=0.005")
+    parser.add_argument("--rel-error", type=float, default=0,
+                        help="largest relative error of filled histogram "
+                             "bins")
+    parser.add_argument("--histos", default="",
+                        help="regex of the histogram paths --rel-error "
+                             "applies to (default: all)")
+    parser.add_argument("--on-converged", default="",
+                        help="shell command to run once converged, e.g. "
+                             "'condor_rm <cluster>'")
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+    drop = DropDirectory(args.dirs)
+    try:
+        while True:
+            if drop.scan():
+                status, converged = aggregate(drop, args)
+                report(status, args)
+                if converged:
+                    if args.on_converged:
+                        print(f"Converged, running: {args.on_converged}")
+                        subprocess.run(args.on_converged, shell=True)
+                    return 0
+            if not args.watch:
+                if not drop.files:
+                    print(f"No snapshots in {', '.join(args.dirs)}")
+                return 0
+            time.sleep(args.watch)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,364 @@
+#!/usr/bin/env python3
+"""Throughput and scaling benchmark for the generators and the Rivet pipeline.
+
+    python3 scripts/benchmark_pipeline.py -o bench.json
+    python3 scripts/benchmark_pipeline.py --baseline bench_ref.json
+
+Runs every generator with fixed seeds and fixed event counts, each process
+pinned to its own CPU, in these output configurations:
+
+  none        no event output (--no-hepmc; gen_d0_study writes to /dev/null)
+  text        the generator's text output: gen_d0_study's candidate file,
+              HepMC3 Asciiv3 to /dev/null for the J/psi generators
+  hepmc       HepMC3 Asciiv3 to a file on disk
+  fifo_rivet  HepMC3 through a FIFO into a Rivet consumer (--rivet-cmd)
+
+For each configuration and copy count N (--cores) it records the init time
+(a 0-event run), event throughput excluding init, peak RSS and the parallel
+efficiency thr(N) / (N * thr(1)). Results are written as JSON; with
+--baseline they are compared against a stored result and the exit code is 1
+if throughput, init time or RSS regressed beyond the tolerances.
+
+Run it where the generators run, e.g. inside the gen image:
+
+    docker run --rm -v $(pwd):/work cmsana-gen:py8313-evtgen200 \\
+        python3 scripts/benchmark_pipeline.py -o bench.json
+"""
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import shlex
+import shutil
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+GENERATORS = {
+    # mode: (executable, default events, supported outputs)
+    "prompt": ("gen_prompt_jpsi", 2000, ("none", "text", "hepmc",
+                                         "fifo_rivet")),
+    "nonprompt": ("gen_bpkjpsi", 200, ("none", "text", "hepmc",
+                                       "fifo_rivet")),
+    "d0": ("gen_d0_study", 20, ("none", "text")),
+}
+OUTPUTS = ("none", "text", "hepmc", "fifo_rivet")
+DEFAULT_RIVET_CMD = "rivet -q -a {analysis} {fifo} -o {yoda}"
+
+
+def generator_cmd(exe, mode, output, n_events, seed, path):
+    """Command line for one generator process writing to path."""
+    if mode == "d0":
+        out = "/dev/null" if output == "none" else path
+        return [exe, str(n_events), str(seed), out]
+    cmd = [exe, str(n_events)]
+    if output == "none":
+        cmd += ["/dev/null", "--no-hepmc"]
+    elif output == "text":
+        cmd += ["/dev/null"]
+    else:
+        cmd += [path]
+    return cmd + ["--seed", str(seed)]
+
+
+def spawn(cmd, cpu, log):
+    def pin():
+        if cpu is not None:
+            os.sched_setaffinity(0, {cpu})
+    return subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT,
+                            preexec_fn=pin)
+
+
+def wait_all(procs):
+    """Wait for all processes; return {pid: (seconds since start, status,
+    peak RSS in MB)} using the rusage of each child."""
+    results = {}
+    pending = {p.pid for p in procs}
+    while pending:
+        pid, status, usage = os.wait4(-1, 0)
+        if pid in pending:
+            pending.discard(pid)
+            results[pid] = (time.perf_counter(),
+                            os.waitstatus_to_exitcode(status),
+                            usage.ru_maxrss / 1024.)
+    for p in procs:
+        p.returncode = results[p.pid][1]
+    return results
+
+
+def run_once(args, mode, output, n_events, copies, workdir, log):
+    """Run `copies` pinned generator processes (plus consumers) at once.
+    Returns per-process wall times, exit codes and peak RSS."""
+    exe = os.path.join(args.build_dir, GENERATORS[mode][0])
+    gens, consumers = [], []
+    cpus = args.cpus[:copies]
+    start = time.perf_counter()
+    for i in range(copies):
+        base = os.path.join(workdir, f"{mode}_{output}_{i}")
+        path = base + (".txt" if mode == "d0" else ".hepmc3")
+        if output == "fifo_rivet":
+            path = base + ".fifo"
+            os.mkfifo(path)
+            consumer = shlex.split(args.rivet_cmd.format(
+                analysis=args.analysis, fifo=path, yoda=base + ".yoda"))
+            # The consumer gets the CPU next to the generator when available
+            ccpu = args.cpus[copies + i] if copies + i < len(args.cpus) \
+                else None
+            consumers.append(spawn(consumer, ccpu, log))
+        cmd = generator_cmd(exe, mode, output, n_events, args.seed + i, path)
+        cmd += shlex.split(args.gen_args)
+        gens.append(spawn(cmd, cpus[i], log))
+    done = wait_all(gens + consumers)
+    runs = []
+    for i, p in enumerate(gens):
+        end, code, rss = done[p.pid]
+        consumer_rss = done[consumers[i].pid][2] if consumers else None
+        if consumers:
+            end = max(end, done[consumers[i].pid][0])
+            code = code or consumers[i].returncode
+        runs.append({"wall": end - start, "exit": code, "rss_mb": rss,
+                     "consumer_rss_mb": consumer_rss})
+    for name in os.listdir(workdir):
+        os.remove(os.path.join(workdir, name))
+    return runs
+
+
+def measure(args, mode, output, copies, init_time, workdir, log):
+    n_events = args.events[mode]
+    repeats = []
+    for _ in range(args.repeat):
+        runs = run_once(args, mode, output, n_events, copies, workdir, log)
+        if any(r["exit"] != 0 for r in runs):
+            return {"error": "non-zero exit code, see " + args.log}
+        repeats.append(runs)
+
+    # Median over repeats of the aggregate rate; init is subtracted per copy
+    def rate(runs):
+        return sum(n_events / max(r["wall"] - init_time, 1e-9) for r in runs)
+    rates = [rate(runs) for runs in repeats]
+    walls = [max(r["wall"] for r in runs) for runs in repeats]
+    rss = [max(r["rss_mb"] for r in runs) for runs in repeats]
+    entry = {
+        "mode": mode, "output": output, "copies": copies,
+        "events_per_copy": n_events,
+        "init_s": init_time,
+        "wall_s": statistics.median(walls),
+        "events_per_s": statistics.median(rates),
+        "events_per_s_per_copy": statistics.median(rates) / copies,
+        "peak_rss_mb": max(rss),
+        "repeats": [rate(runs) for runs in repeats],
+    }
+    consumer = [r["consumer_rss_mb"] for runs in repeats for r in runs
+                if r["consumer_rss_mb"] is not None]
+    if consumer:
+        entry["consumer_peak_rss_mb"] = max(consumer)
+    return entry
+
+
+def measure_init(args, mode, workdir, log):
+    """Median wall time of a 0-event run (initialization only)."""
+    times = []
+    for _ in range(args.repeat):
+        runs = run_once(args, mode, "none", 0, 1, workdir, log)
+        if runs[0]["exit"] != 0:
+            return None
+        times.append(runs[0]["wall"])
+    return statistics.median(times)
+
+
+def machine_info():
+    info = {"host": socket.gethostname(), "platform": platform.platform(),
+            "nproc": os.cpu_count(), "python": platform.python_version(),
+            "date": datetime.datetime.now().isoformat(timespec="seconds")}
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    info["cpu"] = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    try:
+        info["commit"] = subprocess.run(
+            ["git", "rev-parse", "--short", "HEAD"], capture_output=True,
+            text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        pass
+    return info
+
+
+def compare(results, baseline, args):
+    """Print a comparison table; return the number of regressions."""
+    def key(e):
+        return (e["mode"], e["output"], e["copies"])
+    ref = {key(e): e for e in baseline.get("results", []) if "error" not in e}
+    n_bad = 0
+    print(f"\n{'configuration':28s} {'ev/s':>10s} {'base':>10s} "
+          f"{'init':>7s} {'base':>7s} {'RSS MB':>8s} {'base':>8s}")
+    for e in results:
+        name = f"{e['mode']}/{e['output']}/x{e['copies']}"
+        if "error" in e:
+            print(f"{name:28s} ERROR {e['error']}")
+            n_bad += 1
+            continue
+        b = ref.get(key(e))
+        if b is None:
+            print(f"{name:28s} {e['events_per_s']:10.2f} {'-':>10s}  "
+                  "(not in baseline)")
+            continue
+        problems = []
+        if e["events_per_s"] < b["events_per_s"] * (1 - args.tolerance):
+            problems.append("throughput")
+        if e["init_s"] > b["init_s"] * (1 + args.init_tolerance):
+            problems.append("init")
+        if e["peak_rss_mb"] > b["peak_rss_mb"] * (1 + args.rss_tolerance):
+            problems.append("rss")
+        n_bad += bool(problems)
+        print(f"{name:28s} {e['events_per_s']:10.2f} {b['events_per_s']:10.2f} "
+              f"{e['init_s']:7.2f} {b['init_s']:7.2f} "
+              f"{e['peak_rss_mb']:8.1f} {b['peak_rss_mb']:8.1f}  "
+              + ("REGRESSION: " + ", ".join(problems) if problems else "OK"))
+    return n_bad
+
+
+def parse_events(spec):
+    events = {m: GENERATORS[m][1] for m in GENERATORS}
+    for item in filter(None, spec.split(",")):
+        mode, _, n = item.partition("=")
+        if mode not in events or not n.isdigit():
+            raise argparse.ArgumentTypeError(f"bad event count '{item}'")
+        events[mode] = int(n)
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--modes", default="prompt,nonprompt,d0",
+                        help="generators to run (prompt, nonprompt, d0)")
+    parser.add_argument("--outputs", default=",".join(OUTPUTS),
+                        help="output configurations to run")
+    parser.add_argument("--cores", default="1,2,4",
+                        help="numbers of concurrent pinned copies")
+    parser.add_argument("--events", type=parse_events, default="",
+                        help="events per copy, e.g. prompt=5000,d0=50")
+    parser.add_argument("--seed", type=int, default=1000,
+                        help="seed of copy 0; copy i uses seed + i")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="repetitions per configuration (median taken)")
+    parser.add_argument("--cpus", default="",
+                        help="CPU list to pin to (default: the CPUs this "
+                             "process may run on)")
+    parser.add_argument("--gen-args", default="",
+                        help="extra generator options, e.g. "
+                             "'--pdf-table memo'")
+    parser.add_argument("--build-dir", default="build",
+                        help="directory with the generator executables")
+    parser.add_argument("--rivet-cmd", default=DEFAULT_RIVET_CMD,
+                        help="consumer for fifo_rivet; {analysis}, {fifo} "
+                             "and {yoda} are substituted")
+    parser.add_argument("--analysis", default="JpsiJet_RivetAnalyzer")
+    parser.add_argument("--workdir", default=None,
+                        help="scratch directory for outputs and FIFOs")
+    parser.add_argument("--log", default="benchmark.log",
+                        help="generator and consumer output")
+    parser.add_argument("-o", "--output", default="benchmark.json",
+                        help="JSON result file")
+    parser.add_argument("--baseline", help="JSON result to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed relative throughput loss")
+    parser.add_argument("--init-tolerance", type=float, default=0.25,
+                        help="allowed relative init time increase")
+    parser.add_argument("--rss-tolerance", type=float, default=0.15,
+                        help="allowed relative peak RSS increase")
+    args = parser.parse_args()
+
+    modes = [m for m in args.modes.split(",") if m]
+    outputs = [o for o in args.outputs.split(",") if o]
+    for m in modes:
+        if m not in GENERATORS:
+            print(f"Unknown mode: {m}")
+            return 1
+    for o in outputs:
+        if o not in OUTPUTS:
+            print(f"Unknown output: {o}")
+            return 1
+    cores = sorted({int(c) for c in args.cores.split(",") if c})
+    args.cpus = ([int(c) for c in args.cpus.split(",") if c] if args.cpus
+                 else sorted(os.sched_getaffinity(0)))
+    if cores[-1] > len(args.cpus):
+        print(f"Need {cores[-1]} CPUs for --cores, have {len(args.cpus)}")
+        return 1
+    if "fifo_rivet" in outputs and not shutil.which(
+            shlex.split(args.rivet_cmd)[0]):
+        print(f"'{shlex.split(args.rivet_cmd)[0]}' not found, "
+              "skipping fifo_rivet")
+        outputs.remove("fifo_rivet")
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="hepgen-bench-")
+    os.makedirs(workdir, exist_ok=True)
+    results = []
+    with open(args.log, "w") as log:
+        for mode in modes:
+            exe = os.path.join(args.build_dir, GENERATORS[mode][0])
+            if not os.access(exe, os.X_OK):
+                print(f"Missing executable {exe}, skipping {mode}")
+                continue
+            init_time = measure_init(args, mode, workdir, log)
+            if init_time is None:
+                print(f"{mode}: init run failed, see {args.log}")
+                return 1
+            print(f"{mode}: init {init_time:.2f} s")
+            for output in outputs:
+                if output not in GENERATORS[mode][2]:
+                    continue
+                single = None
+                for n in cores:
+                    entry = measure(args, mode, output, n, init_time,
+                                    workdir, log)
+                    if "error" not in entry:
+                        if n == 1:
+                            single = entry["events_per_s"]
+                        if single:
+                            entry["parallel_efficiency"] = \
+                                entry["events_per_s"] / (n * single)
+                        print(f"{mode}/{output}/x{n}: "
+                              f"{entry['events_per_s']:.2f} ev/s, "
+                              f"peak RSS {entry['peak_rss_mb']:.0f} MB"
+                              + (f", efficiency "
+                                 f"{entry['parallel_efficiency']:.2f}"
+                                 if "parallel_efficiency" in entry else ""))
+                    else:
+                        entry.update(mode=mode, output=output, copies=n)
+                        print(f"{mode}/{output}/x{n}: {entry['error']}")
+                    results.append(entry)
+    if not args.workdir:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    report = {"meta": machine_info(),
+              "config": {"events": args.events, "seed": args.seed,
+                         "repeat": args.repeat, "cpus": args.cpus,
+                         "gen_args": args.gen_args},
+              "results": results}
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=2)
+    print(f"Results written to {args.output}")
+
+    n_bad = sum("error" in e for e in results)
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("meta", {}).get("cpu") != report["meta"].get("cpu"):
+            print("Warning: baseline was recorded on a different CPU ("
+                  f"{baseline.get('meta', {}).get('cpu', 'unknown')})")
+        n_bad = compare(results, baseline, args)
+        print(f"\n{n_bad} regression(s)" if n_bad else "\nNo regressions")
+    return 1 if n_bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Read the columnar particle output of the generators (--columnar).
+
+    columnar.py info   prompt_jpsi.col
+    columnar.py head   prompt_jpsi.col -n 2
+    columnar.py npz    prompt_jpsi.col -o prompt_jpsi.npz
+
+Or from Python:
+
+    from columnar import ColumnarFile
+    f = ColumnarFile("prompt_jpsi.col")
+    for b in f.batches():            # dict of numpy arrays per batch
+        pt = np.hypot(b["px"], b["py"])
+        n = np.diff(b["offsets"])    # particles per event
+    pid = f.column("pid")            # whole file, concatenated
+
+The file layout is described in include/columnar_writer.h. Uncompressed
+chunks are numpy views into the memory-mapped file (no copy); compressed
+chunks are inflated and un-shuffled batch by batch. column("offsets")
+returns int64 offsets over the whole file, usable with the concatenated
+particle columns.
+"""
+
+import argparse
+import mmap
+import struct
+import sys
+import zlib
+
+import numpy as np
+
+MAGIC = b"HEPGCOL1"
+HEADER = struct.Struct("<8sIIIIQQQQII")
+COLUMN = struct.Struct("<16s4sIII")
+BATCH = struct.Struct("<QII")
+CHUNK = struct.Struct("<QQQII")
+CODEC_NONE, CODEC_SHUFFLE_DEFLATE = 0, 1
+LEVEL_EVENT, LEVEL_OFFSETS, LEVEL_PARTICLE = 0, 1, 2
+
+
+class ColumnarFile:
+    """Memory-mapped columnar file."""
+
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        (magic, n_columns, column_size, batch_size, chunk_size, self.n_events,
+         self.n_particles, n_batches, footer, self.codec,
+         _) = HEADER.unpack_from(self._map)
+        if magic != MAGIC or column_size != COLUMN.size or \
+                batch_size != BATCH.size or chunk_size != CHUNK.size:
+            raise ValueError(f"{path}: not a columnar particle file")
+        if footer == 0:
+            raise ValueError(f"{path}: incomplete (writer not closed)")
+        self.columns = []
+        for i in range(n_columns):
+            name, dtype, level, _, _ = COLUMN.unpack_from(
+                self._map, HEADER.size + i * COLUMN.size)
+            self.columns.append((name.rstrip(b"\0").decode(),
+                                 np.dtype(dtype.rstrip(b"\0").decode()),
+                                 level))
+        self._batches = [BATCH.unpack_from(self._map, footer + i * BATCH.size)
+                         for i in range(n_batches)]
+        base = footer + n_batches * BATCH.size
+        self._chunks = [CHUNK.unpack_from(self._map, base + i * CHUNK.size)
+                        for i in range(n_batches * n_columns)]
+
+    @property
+    def names(self):
+        return [c[0] for c in self.columns]
+
+    def __len__(self):
+        return len(self._batches)
+
+    def _chunk(self, i_batch, i_column):
+        offset, stored, raw, codec, _ = \
+            self._chunks[i_batch * len(self.columns) + i_column]
+        dtype = self.columns[i_column][1]
+        if codec == CODEC_NONE:
+            return np.frombuffer(self._map, dtype=dtype,
+                                 count=raw // dtype.itemsize, offset=offset)
+        if codec != CODEC_SHUFFLE_DEFLATE:
+            raise ValueError(f"{self.path}: unknown codec {codec}")
+        data = zlib.decompress(self._map[offset:offset + stored])
+        shuffled = np.frombuffer(data, dtype=np.uint8)
+        n = raw // dtype.itemsize
+        return np.ascontiguousarray(
+            shuffled.reshape(dtype.itemsize, n).T).view(dtype).reshape(n)
+
+    def batch(self, i, names=None):
+        """Columns of batch i as a dict of numpy arrays."""
+        return {name: self._chunk(i, k)
+                for k, (name, _, _) in enumerate(self.columns)
+                if names is None or name in names}
+
+    def batches(self, names=None):
+        for i in range(len(self)):
+            yield self.batch(i, names)
+
+    def column(self, name):
+        """One column over the whole file (a copy when there are several
+        batches). Offsets are made global and returned as int64."""
+        k = self.names.index(name)
+        level = self.columns[k][2]
+        parts = [self._chunk(i, k) for i in range(len(self))]
+        if level != LEVEL_OFFSETS:
+            if not parts:
+                return np.zeros(0, dtype=self.columns[k][1])
+            return parts[0] if len(parts) == 1 else np.concatenate(parts)
+        out = [np.zeros(1, dtype=np.int64)]
+        start = 0
+        for part in parts:
+            out.append(part[1:].astype(np.int64) + start)
+            start += int(part[-1])
+        return np.concatenate(out)
+
+    def close(self):
+        self._map.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p_info = sub.add_parser("info", help="events, particles, compression")
+    p_info.add_argument("input")
+    p_head = sub.add_parser("head", help="print the first events")
+    p_head.add_argument("input")
+    p_head.add_argument("-n", type=int, default=1)
+    p_npz = sub.add_parser("npz", help="export all columns to .npz")
+    p_npz.add_argument("input")
+    p_npz.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    try:
+        f = ColumnarFile(args.input)
+    except (OSError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    if args.command == "info":
+        stored = sum(c[1] for c in f._chunks)
+        raw = sum(c[2] for c in f._chunks)
+        print(f"{args.input}: {f.n_events} events, {f.n_particles} "
+              f"particles in {len(f)} batches")
+        print(f"  columns: {', '.join(f.names)}")
+        print(f"  data: {raw / 1e6:.1f} MB, stored {stored / 1e6:.1f} MB"
+              + (f" (x{raw / stored:.2f})" if stored else ""))
+        if f.n_events:
+            print(f"  particles per event: {f.n_particles / f.n_events:.1f}")
+        return 0
+
+    if args.command == "head":
+        shown = 0
+        for b in f.batches():
+            for j in range(len(b["event"])):
+                if shown >= args.n:
+                    return 0
+                lo, hi = b["offsets"][j], b["offsets"][j + 1]
+                print(f"event {b['event'][j]}  weight {b['weight'][j]:g}  "
+                      f"{hi - lo} particles")
+                print(f"  {'#':>5} {'pid':>8} {'status':>6} {'mother':>6} "
+                      f"{'px':>10} {'py':>10} {'pz':>10} {'e':>10}")
+                for k in range(lo, hi):
+                    print(f"  {k - lo:5d} {b['pid'][k]:8d} "
+                          f"{b['status'][k]:6d} {b['mother'][k]:6d} "
+                          f"{b['px'][k]:10.4g} {b['py'][k]:10.4g} "
+                          f"{b['pz'][k]:10.4g} {b['e'][k]:10.4g}")
+                shown += 1
+        return 0
+
+    if args.command == "npz":
+        np.savez(args.output, **{name: f.column(name) for name in f.names})
+        print(f"{args.output}: {f.n_events} events, {f.n_particles} particles")
+        return 0
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Bin-by-bin comparison of two YODA files.
+
+Used to validate the native J/psi-in-jet analysis against Rivet:
+
+    python3 scripts/compare_yoda.py results_prompt.yoda results_prompt_native.yoda
+
+Every histogram and counter of the first file under the analysis path (and
+/_EVTCOUNT), including the per-weight copies "path[variation]", must exist in the second with the same binning and the same
+sumW, sumW2 and numEntries per bin, within a relative tolerance that allows
+for the 6-digit text precision. Reads the YODA 1 (V2) and YODA 2 (V3) text
+formats without needing the yoda module. Exit code 1 on any mismatch.
+"""
+
+import argparse
+import math
+import sys
+
+
+def parse_yoda(path):
+    """Return {path: {"type", "edges", "bins": [(sumW, sumW2, n), ...]}}.
+    Histogram bins include underflow and overflow, in that order first/last."""
+    objects = {}
+    current = None
+    with open(path) as f:
+        for raw in f:
+            line = raw.strip()
+            if line.startswith("BEGIN "):
+                _, kind, obj_path = line.split(None, 2)
+                current = {"kind": kind, "edges": [], "bins": [],
+                           "v2": {}, "data": False}
+                objects[obj_path] = current
+                continue
+            if current is None or not line:
+                continue
+            if line.startswith("END "):
+                finish(current)
+                current = None
+                continue
+            if line == "---":
+                current["data"] = True
+                continue
+            if not current["data"]:
+                continue
+            if line.startswith("Edges(A1):"):
+                body = line.split(":", 1)[1].strip().strip("[]")
+                current["edges"] = [float(x) for x in body.split(",") if x.strip()]
+                continue
+            if line.startswith("#"):
+                continue
+            cols = line.split()
+            kind = current["kind"]
+            if kind.startswith("YODA_HISTO1D_V2"):
+                # Total/Underflow/Overflow rows, then xlow xhigh sumw ...
+                if cols[0] in ("Total", "Underflow", "Overflow"):
+                    current["v2"][cols[0]] = (float(cols[2]), float(cols[3]),
+                                              float(cols[6]))
+                else:
+                    lo, hi = float(cols[0]), float(cols[1])
+                    if not current["edges"]:
+                        current["edges"].append(lo)
+                    current["edges"].append(hi)
+                    current["bins"].append((float(cols[2]), float(cols[3]),
+                                            float(cols[6])))
+            elif kind.startswith("YODA_HISTO1D"):
+                current["bins"].append((float(cols[0]), float(cols[1]),
+                                        float(cols[4])))
+            elif kind.startswith("YODA_COUNTER"):
+                current["bins"].append((float(cols[0]), float(cols[1]),
+                                        float(cols[2])))
+    return objects
+
+
+def finish(obj):
+    """Bring V2 histograms to the V3 layout: underflow, bins..., overflow."""
+    if obj["kind"].startswith("YODA_HISTO1D_V2"):
+        under = obj["v2"].get("Underflow", (0.0, 0.0, 0.0))
+        over = obj["v2"].get("Overflow", (0.0, 0.0, 0.0))
+        obj["bins"] = [under] + obj["bins"] + [over]
+    obj["type"] = "Counter" if "COUNTER" in obj["kind"] else (
+        "Histo1D" if "HISTO1D" in obj["kind"] else "Other")
+
+
+def close(a, b, rtol, atol):
+    return math.isclose(a, b, rel_tol=rtol, abs_tol=atol)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("reference", help="YODA file from Rivet")
+    parser.add_argument("test", help="YODA file from the native analysis")
+    parser.add_argument("--analysis", default="JpsiJet_RivetAnalyzer",
+                        help="analysis name (path prefix) to compare")
+    parser.add_argument("--rtol", type=float, default=2e-6,
+                        help="relative tolerance per bin")
+    args = parser.parse_args()
+
+    ref = parse_yoda(args.reference)
+    test = parse_yoda(args.test)
+    prefix = "/" + args.analysis + "/"
+    paths = sorted(p for p in ref
+                   if (p.startswith(prefix) or p.split("[")[0] == "/_EVTCOUNT")
+                   and ref[p]["type"] in ("Histo1D", "Counter"))
+    if not paths:
+        print(f"No objects under {prefix} in {args.reference}")
+        return 1
+
+    n_bad = 0
+    for path in paths:
+        r = ref[path]
+        t = test.get(path)
+        if t is None:
+            print(f"MISSING  {path}")
+            n_bad += 1
+            continue
+        if r["type"] != t["type"] or len(r["bins"]) != len(t["bins"]) or any(
+                not close(a, b, 1e-9, 1e-12)
+                for a, b in zip(r["edges"], t["edges"])):
+            print(f"BINNING  {path}")
+            n_bad += 1
+            continue
+        bad_bins = []
+        for i, (rb, tb) in enumerate(zip(r["bins"], t["bins"])):
+            if not all(close(x, y, args.rtol, 1e-12) for x, y in zip(rb, tb)):
+                bad_bins.append((i, rb, tb))
+        if bad_bins:
+            n_bad += 1
+            print(f"DIFFER   {path}")
+            for i, rb, tb in bad_bins:
+                label = ("underflow" if i == 0 else "overflow"
+                         if i == len(r["bins"]) - 1 and r["type"] == "Histo1D"
+                         else f"bin {i}")
+                if r["type"] == "Counter":
+                    label = "counter"
+                print(f"    {label}: sumW {rb[0]:.6e} vs {tb[0]:.6e}, "
+                      f"entries {rb[2]:.0f} vs {tb[2]:.0f}")
+        else:
+            print(f"OK       {path}")
+
+    print(f"\n{len(paths) - n_bad}/{len(paths)} objects agree")
+    return 1 if n_bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
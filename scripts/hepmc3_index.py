@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Inspect, select from and split HepMC3 files through their sidecar index.
+
+    hepmc3_index.py info   prompt_jpsi.hepmc3
+    hepmc3_index.py select prompt_jpsi.hepmc3 -o sel.hepmc3 \\
+        --where "n_jpsi > 0 and jet_pt > 30"
+    hepmc3_index.py split  angantyr_test.hepmc3 -n 8 -o part
+    hepmc3_index.py build  old_sample.hepmc3
+
+The generators write "<file>.idx" next to every HepMC3 file (see
+include/event_index.h): per event its byte offset and length plus summary
+fields. select and split copy the byte ranges of the chosen events into new,
+complete Asciiv3 files (with their own index) without parsing the events, so
+re-running an analysis on a selected subset only reads that subset.
+
+Fields usable in --where: index, event, weight, jet_pt (leading anti-kT 0.4
+jet, 0 if none above 5 GeV, -1 if unknown), b (fm, -1 for pp), n_jpsi,
+n_dstar. build indexes an existing file by scanning it; it cannot cluster
+jets, so jet_pt is -1 there.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"HEPGIDX1"
+HEADER = struct.Struct("<8sIIQQ")
+RECORD = struct.Struct("<QQqdffHHI")
+FIELDS = ("offset", "length", "event", "weight", "jet_pt", "b", "n_jpsi",
+          "n_dstar")
+FOOTER = b"HepMC::Asciiv3-END_EVENT_LISTING\n\n"
+
+
+def read_index(hepmc_path):
+    """Records of the index of hepmc_path as a list of dicts."""
+    path = hepmc_path + ".idx"
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError(f"{path}: truncated index")
+    magic, record_size, _, n_events, hepmc_bytes = HEADER.unpack_from(data)
+    if magic != MAGIC or record_size != RECORD.size:
+        raise ValueError(f"{path}: not an event index")
+    n = (len(data) - HEADER.size) // RECORD.size
+    if n_events:
+        n = min(n, n_events)
+        if os.path.getsize(hepmc_path) != hepmc_bytes:
+            raise ValueError(f"{path}: {hepmc_path} changed since it was "
+                             "indexed (rebuild with 'build')")
+    records = []
+    for i in range(n):
+        values = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+        rec = dict(zip(FIELDS, values))
+        rec["index"] = i
+        records.append(rec)
+    return records, bool(n_events)
+
+
+def write_index(path, records, hepmc_bytes):
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, RECORD.size, 0, len(records), hepmc_bytes))
+        for r in records:
+            f.write(RECORD.pack(*(r[k] for k in FIELDS), 0))
+
+
+def write_subset(src_path, records, out_path):
+    """Copy the header and the given events of src_path into a new file and
+    index it."""
+    out_records = []
+    with open(src_path, "rb") as src, open(out_path, "wb") as out:
+        out.write(header_bytes(src))
+        for r in records:
+            src.seek(r["offset"])
+            chunk = src.read(r["length"])
+            new = dict(r, offset=out.tell())
+            out.write(chunk)
+            out_records.append(new)
+        out.write(FOOTER)
+        size = out.tell()
+    write_index(out_path + ".idx", out_records, size)
+    return len(out_records)
+
+
+def header_bytes(f):
+    """Preamble of a HepMC3 file (version line and run info): up to the
+    first event or the footer."""
+    data = b""
+    for line in f:
+        if line.startswith(b"E ") or line.startswith(FOOTER[:20]):
+            break
+        data += line
+    return data
+
+
+def build(hepmc_path):
+    """Index an existing file by scanning its text."""
+    records = []
+
+    def finish(ev):
+        if ev is None:
+            return
+        pids, parents, vertices = ev["pids"], ev["parents"], ev["vertices"]
+        counts = {443: 0, 413: 0}
+        for pid_id, pid in pids.items():
+            apid = abs(pid)
+            if apid not in counts:
+                continue
+            parent = parents[pid_id]
+            mothers = [parent] if parent > 0 else vertices.get(parent, [])
+            # Count each copy chain once (its first entry)
+            if not any(pids.get(m) == pid for m in mothers):
+                counts[apid] += 1
+        records.append({"offset": ev["offset"], "length": ev["length"],
+                        "event": ev["event"], "weight": ev["weight"],
+                        "jet_pt": -1.0, "b": ev["b"],
+                        "n_jpsi": min(counts[443], 65535),
+                        "n_dstar": min(counts[413], 65535)})
+
+    ev = None
+    pos = 0
+    with open(hepmc_path, "rb") as f:
+        for line in f:
+            start, pos = pos, pos + len(line)
+            if line.startswith(b"E ") or line.startswith(b"HepMC::"):
+                if ev is not None:
+                    ev["length"] = start - ev["offset"]
+                finish(ev)
+                ev = None
+                if line.startswith(b"E "):
+                    ev = {"offset": start, "event": int(line.split()[1]),
+                          "weight": 1.0, "b": -1.0, "pids": {},
+                          "parents": {}, "vertices": {}}
+                continue
+            if ev is None:
+                continue
+            tag = line[:2]
+            if tag == b"P ":
+                fields = line.split(None, 4)
+                pid_id = int(fields[1])
+                ev["parents"][pid_id] = int(fields[2])
+                ev["pids"][pid_id] = int(fields[3])
+            elif tag == b"V ":
+                fields = line.split()
+                inc = fields[3].strip(b"[]")
+                ev["vertices"][int(fields[1])] = \
+                    [int(x) for x in inc.split(b",") if x]
+            elif tag == b"W " and len(line.split()) > 1:
+                ev["weight"] = float(line.split()[1])
+            elif line.startswith(b"A 0 impact_parameter "):
+                ev["b"] = float(line.split()[3])
+        if ev is not None:
+            ev["length"] = pos - ev["offset"]
+        finish(ev)
+        size = pos
+    write_index(hepmc_path + ".idx", records, size)
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p_info = sub.add_parser("info", help="summary of an indexed file")
+    p_info.add_argument("input")
+    p_sel = sub.add_parser("select", help="copy selected events")
+    p_sel.add_argument("input")
+    p_sel.add_argument("-o", "--output", required=True)
+    p_sel.add_argument("--where", default="True",
+                       help="Python expression over the index fields")
+    p_sel.add_argument("--range", default=None, metavar="FIRST:COUNT",
+                       help="events FIRST ... FIRST + COUNT - 1 only")
+    p_split = sub.add_parser("split", help="split into N files")
+    p_split.add_argument("input")
+    p_split.add_argument("-n", type=int, required=True)
+    p_split.add_argument("-o", "--prefix", required=True,
+                         help="output PREFIX_<k>.hepmc3")
+    p_build = sub.add_parser("build", help="index an existing file")
+    p_build.add_argument("input")
+    args = parser.parse_args()
+
+    if args.command == "build":
+        records = build(args.input)
+        print(f"{args.input}.idx: {len(records)} events")
+        return 0
+
+    try:
+        records, complete = read_index(args.input)
+    except (OSError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    if args.command == "info":
+        n = len(records)
+        print(f"{args.input}: {n} events"
+              + ("" if complete else " (index not finalized)"))
+        if n:
+            print(f"  sum of weights: {sum(r['weight'] for r in records):g}")
+            print(f"  with J/psi: {sum(r['n_jpsi'] > 0 for r in records)}")
+            print(f"  with D*: {sum(r['n_dstar'] > 0 for r in records)}")
+            print("  leading jet pT > 30 GeV: "
+                  f"{sum(r['jet_pt'] > 30 for r in records)}")
+            if records[0]["b"] >= 0:
+                bs = [r["b"] for r in records]
+                print(f"  b: {min(bs):.2f} - {max(bs):.2f} fm")
+        return 0
+
+    if args.command == "select":
+        if args.range:
+            first, _, count = args.range.partition(":")
+            first = int(first)
+            records = records[first:first + int(count) if count else None]
+        try:
+            code = compile(args.where, "--where", "eval")
+            chosen = [r for r in records
+                      if eval(code, {"__builtins__": {}}, r)]
+        except Exception as e:
+            print(f"--where: {e}", file=sys.stderr)
+            return 1
+        n = write_subset(args.input, chosen, args.output)
+        print(f"{args.output}: {n} / {len(records)} events")
+        return 0
+
+    if args.command == "split":
+        if args.n < 1:
+            print("-n must be positive", file=sys.stderr)
+            return 1
+        per = -(-len(records) // args.n)
+        for k in range(args.n):
+            part = records[k * per:(k + 1) * per]
+            out = f"{args.prefix}_{k}.hepmc3"
+            write_subset(args.input, part, out)
+            print(f"{out}: {len(part)} events")
+        return 0
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -7,12 +7,12 @@ def spin_dist(cos_theta, norm, rho00):
     """Spin density distribution: W(θ) ∝ (1-ρ00) + (3ρ00-1)cos²θ"""
     return norm * ( (1 - rho00) + (3 * rho00 - 1) * cos_theta**2 )
 
-def fit_rho00(cos_thetas):
+def fit_rho00(cos_thetas, weights):
     if len(cos_thetas) < 50:
         return None, None
-    counts, bin_edges = np.histogram(cos_thetas, bins=20, range=(-1, 1))
+    counts, bin_edges = np.histogram(cos_thetas, bins=20, range=(-1, 1), weights=weights)
     bin_centers = (bin_edges[:-1] + bin_edges[1:]) / 2
-    yerr = np.sqrt(counts)
+    yerr = np.sqrt(np.histogram(cos_thetas, bins=20, range=(-1, 1), weights=weights**2)[0])
     yerr[yerr == 0] = 1
     try:
         popt, pcov = curve_fit(spin_dist, bin_centers, counts, p0=[max(counts), 0.33], sigma=yerr)
@@ -20,13 +20,15 @@ def fit_rho00(cos_thetas):
     except:
         return None, None
 
-def calculate_v2(cos2_delta_phi):
+def calculate_v2(cos2_delta_phi, weights):
     """v2 = <cos(2ΔΦ)>"""
     if len(cos2_delta_phi) < 50:
         return None, None
-    v2 = np.mean(cos2_delta_phi)
-    # Statistical error: σ/√N
-    err = np.std(cos2_delta_phi) / np.sqrt(len(cos2_delta_phi))
+    v2 = np.average(cos2_delta_phi, weights=weights)
+    # Statistical error: σ/√Neff, Neff = (Σw)²/Σw² (N for unit weights)
+    var = np.average((cos2_delta_phi - v2)**2, weights=weights)
+    n_eff = weights.sum()**2 / (weights**2).sum()
+    err = np.sqrt(var / n_eff)
     return v2, err
 
 def main():
@@ -35,12 +37,14 @@ def main():
         input_file = sys.argv[1]
     
     try:
-        # Load: type pT rapidity cosTheta cos2DeltaPhi
-        data = np.loadtxt(input_file, usecols=(0, 1, 2, 3, 4))
+        # Load: type pT rapidity cosTheta cos2DeltaPhi [b nColl weight ...]
+        data = np.loadtxt(input_file, ndmin=2)
     except Exception as e:
         print(f"Error loading data: {e}")
         print("Expected columns: type pT rapidity cosTheta cos2DeltaPhi")
         return
+    # Event weights (column 8) are not unity with gen_d0_study --adaptive-bias
+    weights = data[:, 7] if data.shape[1] > 7 else np.ones(len(data))
 
     pt_bins = [3, 5, 7, 10, 15, 20, 30]
     
@@ -50,15 +54,18 @@ def main():
     
     for category in [0, 1]:
         cat_data = data[data[:, 0] == category]
+        cat_weights = weights[data[:, 0] == category]
         for i in range(len(pt_bins) - 1):
             pt_min, pt_max = pt_bins[i], pt_bins[i+1]
-            bin_data = cat_data[(cat_data[:, 1] >= pt_min) & (cat_data[:, 1] < pt_max)]
+            in_bin = (cat_data[:, 1] >= pt_min) & (cat_data[:, 1] < pt_max)
+            bin_data = cat_data[in_bin]
+            bin_weights = cat_weights[in_bin]
             
             if len(bin_data) == 0:
                 continue
             
             # Spin alignment (ρ00)
-            rho, rho_err = fit_rho00(bin_data[:, 3])
+            rho, rho_err = fit_rho00(bin_data[:, 3], bin_weights)
             if rho is not None:
                 results_rho00[category].append({
                     'pt_mid': (pt_min + pt_max) / 2,
@@ -68,7 +75,7 @@ def main():
                 })
             
             # v2 flow
-            v2, v2_err = calculate_v2(bin_data[:, 4])
+            v2, v2_err = calculate_v2(bin_data[:, 4], bin_weights)
             if v2 is not None:
                 results_v2[category].append({
                     'pt_mid': (pt_min + pt_max) / 2,
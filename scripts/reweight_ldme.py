@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Reweight prompt onium HepMC3 samples to other NRQCD LDME sets.
+
+    reweight_ldme.py -i prompt.hepmc3 -o prompt_ldme.hepmc3 \\
+        --set ldme_chao=runcards/ldme/chao2012.txt \\
+        --set ldme_bk=runcards/ldme/butenschoen_kniehl2011.txt
+
+gen_prompt_jpsi stores the hard onium subprocess of every event as the
+attributes onium_state, onium_channel and onium_ldme (the LDME it was
+generated with). The cross section of a subprocess is proportional to its
+LDME, so the event weight for another set is w * O_new / O_gen.
+
+By default every set is appended as a named weight, so Rivet fills one
+histogram copy per set ("zJpsi[ldme_chao]") in a single pass. With --scale
+NAME all weights are multiplied by the factor of that set instead, for
+consumers that only read the nominal weight. Input and output may be FIFOs,
+so the tool can sit between the generator and Rivet.
+
+Card format: "<state PDG code> <channel> <LDME>" per line, '#' comments.
+States or channels not in a card keep factor 1.
+"""
+
+import argparse
+import sys
+
+
+def read_card(path):
+    values = {}
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].split()
+            if not line:
+                continue
+            if len(line) != 3:
+                raise ValueError(f"{path}:{n}: expected '<pid> <channel> "
+                                 "<value>'")
+            values[(int(line[0]), line[1])] = float(line[2])
+    return values
+
+
+def factor(card, state, channel, ldme):
+    if state is None or not ldme:
+        return 1.0
+    value = card.get((state, channel))
+    return 1.0 if value is None else value / ldme
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-i", "--input", required=True,
+                        help="HepMC3 Asciiv3 input (file or FIFO)")
+    parser.add_argument("-o", "--output", required=True,
+                        help="HepMC3 Asciiv3 output (file or FIFO)")
+    parser.add_argument("--set", action="append", default=[],
+                        metavar="NAME=CARD", help="LDME set (repeatable)")
+    parser.add_argument("--scale", metavar="NAME",
+                        help="rescale all weights by this set instead of "
+                             "adding weights")
+    args = parser.parse_args()
+
+    sets = []
+    for spec in args.set:
+        name, sep, path = spec.partition("=")
+        if not sep or not name:
+            print(f"--set expects NAME=CARD, got '{spec}'", file=sys.stderr)
+            return 1
+        sets.append((name, read_card(path)))
+    if not sets:
+        print("No LDME set given", file=sys.stderr)
+        return 1
+    if args.scale and args.scale not in dict(sets):
+        print(f"--scale {args.scale}: no such set", file=sys.stderr)
+        return 1
+
+    n_events = n_unknown = 0
+    sum_factor = {name: 0.0 for name, _ in sets}
+
+    def flush(event, out):
+        """Rewrite the W line of one buffered event and write it out."""
+        nonlocal n_events, n_unknown
+        if not event:
+            return
+        attrs = {}
+        for line in event:
+            if line.startswith("A 0 onium_"):
+                _, _, key, value = line.rstrip("\n").split(" ", 3)
+                attrs[key] = value
+        state = int(attrs["onium_state"]) if "onium_state" in attrs else None
+        ldme = float(attrs.get("onium_ldme", 0.0))
+        channel = attrs.get("onium_channel", "")
+        if state is None or not ldme:
+            n_unknown += 1
+        factors = [factor(card, state, channel, ldme) for _, card in sets]
+        for (name, _), f in zip(sets, factors):
+            sum_factor[name] += f
+        for k, line in enumerate(event):
+            if line.startswith("W "):
+                weights = [float(x) for x in line.split()[1:]]
+                break
+        else:
+            k, weights = 1, None
+            event.insert(1, "")
+        if weights is None:
+            weights = [1.0]
+        if args.scale:
+            f = factors[[name for name, _ in sets].index(args.scale)]
+            weights = [w * f for w in weights]
+        else:
+            weights += [weights[0] * f for f in factors]
+        event[k] = "W " + " ".join(f"{w:.16e}" for w in weights) + "\n"
+        out.writelines(event)
+        n_events += 1
+
+    with open(args.input) as inp, open(args.output, "w") as out:
+        event = []
+        in_header = True
+        for line in inp:
+            if in_header:
+                if line.startswith("W ") and not args.scale:
+                    line = line.rstrip("\n") + "".join(
+                        " " + name for name, _ in sets) + "\n"
+                if line.startswith("E "):
+                    in_header = False
+                else:
+                    out.write(line)
+                    continue
+            if line.startswith("E ") or line.startswith("HepMC::"):
+                flush(event, out)
+                event = []
+                if line.startswith("HepMC::"):
+                    out.write(line)
+                    in_header = True  # footer: copy the rest as is
+                    continue
+            event.append(line)
+        flush(event, out)
+
+    print(f"reweight_ldme: {n_events} events, {n_unknown} without onium "
+          "subprocess information (factor 1)", file=sys.stderr)
+    for name, _ in sets:
+        mean = sum_factor[name] / n_events if n_events else 0.0
+        print(f"  {name}: mean weight factor {mean:.4f} (= sigma_new / "
+              "sigma_gen for unweighted input)", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
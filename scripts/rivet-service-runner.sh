@@ -4,9 +4,15 @@
 # =============================================================================
 
 # Usage: ./rivet-service-runner.sh <AnalysisSource.cc> <AnalysisName> <InputFIFO> <OutputYoda>
+#
+# InputFIFO may be a comma-separated list (one FIFO per generator). With
+# RIVET_SHARDS=K > 1 the events are spread over K rivet processes and the
+# partial results are merged into OutputYoda at the end.
+#   RIVET_SHARDS       number of rivet consumer processes (default: 1)
+#   RIVET_SHARD_MODE   roundrobin (default) or load
 
 # Check if we are running the service pipeline OR a standard command
-if [[ "$1" == "yodals" || "$1" == "rivet-mkhtml" || "$1" == "yodadiff" || "$1" == "rivet" || "$1" == "bash" ]]; then
+if [[ "$1" == "yodals" || "$1" == "rivet-mkhtml" || "$1" == "yodadiff" || "$1" == "rivet" || "$1" == "rivet-merge" || "$1" == "yodamerge" || "$1" == "bash" ]]; then
     exec "$@"
 fi
 
@@ -15,28 +21,143 @@ ANALYSIS_NAME=$2
 INPUT_FIFO=$3
 OUTPUT_YODA=$4
 
+# Compiled plugins are cached by content hash, so only the first job after a
+# change to the source, the build flags or the Rivet installation compiles.
+#   RIVET_PLUGIN_CACHE   cache directory (default: $PWD/.rivet-plugins;
+#                        point it at shared storage for batch jobs)
+#   RIVET_BUILD_FLAGS    extra compiler flags passed to rivet-build
+#   RIVET_PLUGIN_REBUILD set to 1 to ignore a cached plugin
+PLUGIN_CACHE=${RIVET_PLUGIN_CACHE:-$PWD/.rivet-plugins}
+
 echo "=== Rivet Service Started ==="
-echo "Building analysis plugin: $SOURCE_CC..."
 
-# 1. Compile the user analysis code at runtime
-if rivet-build RivetAnalysis.so "$SOURCE_CC"; then
-    echo "Build Successful: RivetAnalysis.so created."
-else
-    echo "ERROR: Compilation failed!"
+if [ ! -f "$SOURCE_CC" ]; then
+    echo "ERROR: Analysis source $SOURCE_CC not found!"
     exit 1
 fi
+SOURCE_ABS=$(cd "$(dirname "$SOURCE_CC")" && pwd)/$(basename "$SOURCE_CC")
+
+# 1. Look up the plugin in the cache, compiling it on a miss
+PLUGIN_KEY=$( {
+    cat "$SOURCE_ABS"
+    echo "flags: $RIVET_BUILD_FLAGS"
+    rivet-config --version
+    rivet-config --cxxflags --ldflags
+    "${CXX:-g++}" --version | head -n 1
+} | sha256sum | cut -c1-16 )
+PLUGIN_DIR="$PLUGIN_CACHE/${ANALYSIS_NAME}-${PLUGIN_KEY}"
+
+mkdir -p "$PLUGIN_CACHE" || exit 1
+if [ -f "$PLUGIN_DIR/RivetAnalysis.so" ] && [ "$RIVET_PLUGIN_REBUILD" != "1" ]; then
+    echo "Using cached analysis plugin: $PLUGIN_DIR"
+else
+    # Concurrent jobs with the same key wait for one build instead of racing
+    (
+        flock 9
+        if [ -f "$PLUGIN_DIR/RivetAnalysis.so" ] && [ "$RIVET_PLUGIN_REBUILD" != "1" ]; then
+            echo "Analysis plugin built by another job: $PLUGIN_DIR"
+            exit 0
+        fi
+        echo "Building analysis plugin: $SOURCE_CC (key $PLUGIN_KEY)..."
+        # Each build gets its own directory next to PLUGIN_DIR, which is a
+        # symlink to the current one
+        BUILD_DIR=$(mktemp -d "$PLUGIN_DIR.build-XXXXXX") && chmod 755 "$BUILD_DIR" || exit 1
+        # shellcheck disable=SC2086
+        if ! (cd "$BUILD_DIR" && rivet-build RivetAnalysis.so "$SOURCE_ABS" $RIVET_BUILD_FLAGS); then
+            rm -rf "$BUILD_DIR"
+            echo "ERROR: Compilation failed!"
+            exit 1
+        fi
+        # Publish by renaming a new symlink over the old one: jobs already
+        # running keep a complete plugin, new ones see the rebuilt one
+        PREVIOUS=$(readlink "$PLUGIN_DIR" 2>/dev/null)
+        if [ -d "$PLUGIN_DIR" ] && [ ! -L "$PLUGIN_DIR" ]; then
+            # Cache entry from before builds were symlinked
+            PREVIOUS="$PLUGIN_DIR.build-legacy$$"
+            mv -T "$PLUGIN_DIR" "$PREVIOUS" || exit 1
+            PREVIOUS=$(basename "$PREVIOUS")
+        fi
+        ln -s "$(basename "$BUILD_DIR")" "$BUILD_DIR.link" &&
+            mv -T "$BUILD_DIR.link" "$PLUGIN_DIR" || exit 1
+        # Keep the build just replaced for jobs that may still be loading
+        # it; older ones are no longer referenced
+        for OLD in "$PLUGIN_DIR".build-*; do
+            case "$(basename "$OLD")" in
+                "$(basename "$BUILD_DIR")"|"$PREVIOUS") ;;
+                *) rm -rf "$OLD" ;;
+            esac
+        done
+        echo "Build Successful: $PLUGIN_DIR/RivetAnalysis.so created."
+    ) 9>"$PLUGIN_CACHE/.lock-$PLUGIN_KEY" || exit 1
+fi
+
+# 2. Tell Rivet to look in the cache entry for the plugin
+export RIVET_ANALYSIS_PATH=$PLUGIN_DIR
 
-# 2. Tell Rivet to look in the current directory for the new plugin
-export RIVET_ANALYSIS_PATH=$PWD
+RIVET_SHARDS=${RIVET_SHARDS:-1}
+RIVET_SHARD_MODE=${RIVET_SHARD_MODE:-roundrobin}
+IFS=',' read -r -a INPUTS <<< "$INPUT_FIFO"
 
-# 3. Wait for the FIFO to exist (blocking wait)
+# 3. Wait for the FIFOs to exist (blocking wait)
 echo "Waiting for data stream on $INPUT_FIFO..."
-while [ ! -p "$INPUT_FIFO" ]; do
-    sleep 1
+for IN in "${INPUTS[@]}"; do
+    while [ ! -p "$IN" ]; do
+        sleep 1
+    done
 done
 
 # 4. Run the analysis
-echo "Starting analysis $ANALYSIS_NAME..."
-rivet -a "$ANALYSIS_NAME" "$INPUT_FIFO" -o "$OUTPUT_YODA"
+if [ "${#INPUTS[@]}" -eq 1 ] && [ "$RIVET_SHARDS" -le 1 ]; then
+    echo "Starting analysis $ANALYSIS_NAME..."
+    rivet -a "$ANALYSIS_NAME" "$INPUT_FIFO" -o "$OUTPUT_YODA"
+else
+    # Sharded: splitter -> K shard FIFOs -> K rivet processes -> merge
+    [ "$RIVET_SHARDS" -ge 1 ] || RIVET_SHARDS=1
+    SHARD_TOOL=$(command -v shard-hepmc3 || echo "$(dirname "$0")/shard_hepmc3.py")
+    SHARD_DIR=$(mktemp -d "${OUTPUT_YODA%.yoda}.shards.XXXXXX") || exit 1
+    echo "Starting analysis $ANALYSIS_NAME on $RIVET_SHARDS shards ($RIVET_SHARD_MODE)..."
+
+    SHARD_FIFOS=()
+    SHARD_YODAS=()
+    RIVET_PIDS=()
+    for ((k = 0; k < RIVET_SHARDS; k++)); do
+        mkfifo "$SHARD_DIR/shard$k.fifo"
+        SHARD_FIFOS+=("$SHARD_DIR/shard$k.fifo")
+        SHARD_YODAS+=("$SHARD_DIR/shard$k.yoda")
+        rivet -a "$ANALYSIS_NAME" "$SHARD_DIR/shard$k.fifo" \
+            -o "$SHARD_DIR/shard$k.yoda" > "$SHARD_DIR/shard$k.log" 2>&1 &
+        RIVET_PIDS+=($!)
+    done
+
+    SPLIT_ARGS=()
+    for IN in "${INPUTS[@]}"; do
+        SPLIT_ARGS+=(-i "$IN")
+    done
+    # Exits non-zero when a shard's rivet died and its FIFO broke
+    FAILED=0
+    if ! python3 "$SHARD_TOOL" --mode "$RIVET_SHARD_MODE" "${SPLIT_ARGS[@]}" \
+        "${SHARD_FIFOS[@]}"; then
+        echo "ERROR: event splitter aborted"
+        FAILED=1
+    fi
+
+    for k in "${!RIVET_PIDS[@]}"; do
+        if ! wait "${RIVET_PIDS[$k]}"; then
+            echo "ERROR: rivet shard $k failed, see $SHARD_DIR/shard$k.log"
+            FAILED=1
+        fi
+    done
+    [ "$FAILED" -eq 0 ] || exit 1
+
+    # Shards are statistically equivalent parts of one sample: rivet-merge -e
+    # adds the raw histograms and sums of weights, combines the cross
+    # sections, and re-runs finalize()
+    echo "Merging ${#SHARD_YODAS[@]} shard results..."
+    if ! rivet-merge -e -o "$OUTPUT_YODA" "${SHARD_YODAS[@]}"; then
+        echo "WARNING: rivet-merge failed, adding histograms with yodamerge"
+        yodamerge --add -o "$OUTPUT_YODA" "${SHARD_YODAS[@]}" || exit 1
+    fi
+    rm -rf "$SHARD_DIR"
+fi
 
 echo "=== Analysis Complete! Results saved to $OUTPUT_YODA ==="
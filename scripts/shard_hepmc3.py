@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Distribute HepMC3 Asciiv3 event streams over several output shards.
+
+    shard_hepmc3.py [--mode roundrobin|load] -i in1.fifo [-i in2.fifo ...]
+                    shard0.fifo shard1.fifo ...
+
+Every shard is a complete Asciiv3 stream: it gets the header and run info
+of the first input that has run info (or a bare start line if none has),
+then whole events, then the end-of-listing footer, so each one can be read
+by its own Rivet process.
+
+  roundrobin  event n of the merged input goes to shard n % K
+  load        shards pull events from a shared queue; a consumer that is
+              slower (blocking on its FIFO) simply takes fewer events
+
+Events are located by searching the raw byte stream for event lines, so the
+splitter does not parse particles and stays far ahead of the consumers.
+
+If a shard cannot be written (its consumer died), the splitter aborts: the
+other shards are closed, the inputs are no longer read, so the generators
+fail on their FIFOs instead of blocking, and the exit status is 1.
+"""
+
+import argparse
+import queue
+import sys
+import threading
+
+START = b"HepMC::Asciiv3-START_EVENT_LISTING"
+FOOTER = b"HepMC::Asciiv3-END_EVENT_LISTING"
+CHUNK = 1 << 20
+QUEUE_DEPTH = 64  # events buffered per queue
+POLL = 0.5  # seconds between checks of the abort flag while blocked
+DONE = None
+
+
+class Aborted(Exception):
+    """Raised in a reader once a shard has failed."""
+
+
+def read_events(path, on_header, on_event):
+    """Stream one input; call on_header(bytes) once, then on_event(bytes)
+    for every complete event (starting at its 'E ' line)."""
+    with open(path, "rb") as f:
+        buf = b""
+        header_done = False
+        while True:
+            data = f.read(CHUNK)
+            buf += data
+            if not header_done:
+                pos = first_event(buf)
+                if pos < 0:
+                    if not data:
+                        on_header(strip_footer(buf))
+                        return
+                    continue
+                on_header(buf[:pos])
+                buf = buf[pos:]
+                header_done = True
+            # Emit every event followed by the start of the next one
+            start = 0
+            while True:
+                nxt = buf.find(b"\nE ", start + 1)
+                if nxt < 0:
+                    break
+                on_event(buf[start:nxt + 1])
+                start = nxt + 1
+            buf = buf[start:]
+            if not data:
+                break
+        last = strip_footer(buf)
+        if last.startswith(b"E "):
+            on_event(last)
+
+
+def has_run_info(header):
+    """True if a header has lines beyond HepMC::Version / START (W, A, T)."""
+    return any(line.strip() and not line.startswith(b"HepMC::")
+               for line in header.splitlines())
+
+
+def first_event(buf):
+    if buf.startswith(b"E "):
+        return 0
+    pos = buf.find(b"\nE ")
+    return pos + 1 if pos >= 0 else -1
+
+
+def strip_footer(buf):
+    pos = buf.find(FOOTER)
+    return buf if pos < 0 else buf[:pos]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-i", "--input", action="append", required=True,
+                        help="input HepMC3 stream (repeat for several "
+                             "generators)")
+    parser.add_argument("--mode", choices=("roundrobin", "load"),
+                        default="roundrobin")
+    parser.add_argument("shards", nargs="+", help="output streams")
+    args = parser.parse_args()
+
+    n_shards = len(args.shards)
+    header = {"inputs": 0}
+    header_ready = threading.Event()
+    header_lock = threading.Lock()
+
+    # One queue per shard for round-robin, one shared queue for load mode
+    if args.mode == "load":
+        shared = queue.Queue(QUEUE_DEPTH * n_shards)
+        queues = [shared] * n_shards
+    else:
+        queues = [queue.Queue(QUEUE_DEPTH) for _ in range(n_shards)]
+    counter = {"n": 0}
+    counter_lock = threading.Lock()
+    written = [0] * n_shards
+    abort = threading.Event()
+
+    def put(q, item):
+        """Queue an item, giving up once the splitter has been aborted."""
+        while not abort.is_set():
+            try:
+                q.put(item, timeout=POLL)
+                return True
+            except queue.Full:
+                pass
+        return False
+
+    def get(q):
+        """Next item of a queue, or DONE once the splitter has been aborted."""
+        while not abort.is_set():
+            try:
+                return q.get(timeout=POLL)
+            except queue.Empty:
+                pass
+        return DONE
+
+    def drain(q):
+        try:
+            while True:
+                q.get_nowait()
+        except queue.Empty:
+            pass
+
+    def on_header(data):
+        """Header of one input (once per input). The first one with run info
+        goes to the shards; an empty or failed input must not set it, so the
+        bare start line is used only once every input reported none."""
+        with header_lock:
+            header["inputs"] += 1
+            if "data" in header:
+                return
+            if has_run_info(data):
+                if START not in data:
+                    data = b"HepMC::Version 3\n" + START + b"\n" + data
+            elif header["inputs"] < len(args.input):
+                return
+            else:
+                data = b"HepMC::Version 3\n" + START + b"\n"
+            header["data"] = data
+            header_ready.set()
+
+    def on_event(data):
+        if args.mode == "load":
+            k = 0
+        else:
+            with counter_lock:
+                k = counter["n"] % n_shards
+                counter["n"] += 1
+        if not put(queues[k], data):
+            raise Aborted()
+
+    def reader(path):
+        reported = []
+
+        def report(data):
+            if not reported:
+                reported.append(True)
+                on_header(data)
+
+        try:
+            read_events(path, report, on_event)
+        except Aborted:
+            pass
+        except OSError as err:
+            print(f"shard_hepmc3: cannot read {path}: {err}", file=sys.stderr)
+        # An input without any content still counts as reported
+        report(b"")
+
+    def writer(k):
+        q = queues[k]
+        try:
+            with open(args.shards[k], "wb", buffering=CHUNK) as out:
+                while not header_ready.wait(POLL):
+                    if abort.is_set():
+                        return
+                out.write(header["data"])
+                while True:
+                    item = get(q)
+                    if item is DONE:
+                        break
+                    out.write(item)
+                    written[k] += 1
+                if not abort.is_set():
+                    out.write(FOOTER + b"\n\n")
+        except OSError as err:  # BrokenPipeError: the consumer is gone
+            if not abort.is_set():
+                print(f"shard_hepmc3: cannot write {args.shards[k]}: {err}; "
+                      "aborting", file=sys.stderr)
+            abort.set()
+        if abort.is_set():
+            drain(q)
+
+    writers = [threading.Thread(target=writer, args=(k,))
+               for k in range(n_shards)]
+    readers = [threading.Thread(target=reader, args=(p,))
+               for p in args.input]
+    for t in writers + readers:
+        t.start()
+    for t in readers:
+        t.join()
+    # One end marker per writer; in load mode they share the queue
+    for k in range(n_shards):
+        put(queues[k], DONE)
+    for t in writers:
+        t.join()
+
+    print("shard_hepmc3: events per shard: "
+          + " ".join(str(n) for n in written), file=sys.stderr)
+    return 1 if abort.is_set() else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -44,10 +44,10 @@ if ! docker images | grep -q "cmsana-gen"; then
     fi
 fi
 
-# 4. Compile Executables
+# 4. Compile Executables and run the file-format tests
 echo "Compiling generators..."
 docker run --rm -v "$(pwd):/work" -v "$(pwd)/lhapdf_data:/work/lhapdf_data" $IMAGE_NAME \
-    bash -c "mkdir -p build && cd build && cmake .. && make -j$(nproc)"
+    bash -c "mkdir -p build && cd build && cmake .. && make -j$(nproc) && ctest --output-on-failure"
 
 echo ""
 echo "=== Setup Complete! ==="
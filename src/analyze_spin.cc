@@ -4,9 +4,14 @@
 #include "HepMC3/GenParticle.h"
 #include "HepMC3/GenVertex.h"
 #include "HepMC3/ReaderAscii.h"
+#include "alloc_counter.h"
+#include "event_index.h"
+#include "hepmc3_skim.h"
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -65,32 +70,87 @@ bool isNonPrompt(const GenParticlePtr &p) {
 int main(int argc, char *argv[]) {
   if (argc < 2) {
     std::cerr << "Usage: " << argv[0] << " <input.hepmc3> [output.txt]"
-              << std::endl;
+              << " [--full-read]" << std::endl;
     return 1;
   }
 
   std::string inputFile = argv[1];
-  std::string outputFile = (argc > 2) ? argv[2] : "cos_theta_pt_bins.txt";
+  std::string outputFile = "cos_theta_pt_bins.txt";
+  int iArg = 2;
+  if (argc > 2 && argv[2][0] != '-')
+    outputFile = argv[iArg++];
+
+  // By default events are skimmed: only events with a D* are built, and of
+  // those only the D*, its decay products and its ancestors. With a sidecar
+  // index (input.idx) events without a D* are not even read.
+  //   --full-read   build every complete event with HepMC3::ReaderAscii
+  bool fullRead = false;
+  for (; iArg < argc; ++iArg) {
+    std::string arg = argv[iArg];
+    if (arg == "--full-read") {
+      fullRead = true;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
 
-  ReaderAscii reader(inputFile);
+  std::unique_ptr<ReaderAscii> reader;
+  std::unique_ptr<hepgen::SkimReaderAscii> skim;
+  std::unique_ptr<hepgen::EventIndex> index;
+  if (fullRead) {
+    reader = std::make_unique<ReaderAscii>(inputFile);
+  } else {
+    skim = std::make_unique<hepgen::SkimReaderAscii>(
+        inputFile, std::vector<int>{413});
+    if (!skim->ok())
+      return 1;
+    index = std::make_unique<hepgen::EventIndex>(
+        hepgen::eventIndexPath(inputFile));
+    if (!index->ok()) {
+      index.reset();
+    } else if (!index->matches(inputFile)) {
+      std::cout << "Event index is out of date, scanning the whole file"
+                << std::endl;
+      index.reset();
+    }
+  }
   std::ofstream fout(outputFile);
 
   int countPrompt = 0;
   int countNonPrompt = 0;
-
-  while (!reader.failed()) {
-    auto evt = std::make_shared<GenEvent>();
-    if (!reader.read_event(*evt))
-      break;
-
+  long nEvents = 0;
+  long allocStart = hepgen::allocCount();
+
+  // One event object for the whole file: read_event() clears it and the
+  // particle/vertex containers keep their capacity between events
+  GenEvent event;
+  size_t iRecord = 0;
+  auto nextEvent = [&]() {
+    if (index) {
+      while (iRecord < index->size()) {
+        const hepgen::EventIndexRecord &rec = index->record(iRecord++);
+        if (rec.nDstar > 0 && skim->readEventAt(rec.offset, event))
+          return true;
+      }
+      return false;
+    }
+    if (skim)
+      return skim->readEvent(event);
+    return !reader->failed() && reader->read_event(event);
+  };
+  while (nextEvent()) {
+    ++nEvents;
+
+    // Read as string: the skimming reader keeps attributes unparsed
     double psi_RP = 0;
-    auto attr = evt->attribute<DoubleAttribute>("psi_RP");
-    if (attr)
-      psi_RP = attr->value();
+    std::string psiAttr = event.attribute_as_string("psi_RP");
+    if (!psiAttr.empty())
+      psi_RP = std::atof(psiAttr.c_str());
 
     FourVector nLab(-std::sin(psi_RP), std::cos(psi_RP), 0.0, 0.0);
 
-    for (auto const &p : evt->particles()) {
+    for (auto const &p : event.particles()) {
       if (std::abs(p->pid()) == 413) { // D*+
         auto endVtx = p->end_vertex();
         if (!endVtx)
@@ -141,6 +201,20 @@ int main(int argc, char *argv[]) {
   std::cout << "Analysis complete." << std::endl;
   std::cout << "  Prompt D*: " << countPrompt << std::endl;
   std::cout << "  Non-prompt D*: " << countNonPrompt << std::endl;
+  if (index)
+    std::cout << "  Index: " << skim->eventsScanned() << " / "
+              << index->size() << " events read" << std::endl;
+  if (skim)
+    std::cout << "  Skimmed: " << nEvents << " / " << skim->eventsScanned()
+              << " events with a D*, " << skim->particlesMaterialized()
+              << " / " << skim->particlesScanned() << " particles built"
+              << std::endl;
+  long nRead = index ? long(index->size())
+                     : skim ? skim->eventsScanned() : nEvents;
+  if (allocStart >= 0 && nRead > 0)
+    std::cout << "  Allocations per event: "
+              << double(hepgen::allocCount() - allocStart) / nRead
+              << std::endl;
 
   return 0;
 }
@@ -1,5 +1,7 @@
 #include "Pythia8/Pythia.h"
-#include "Pythia8Plugins/HepMC3.h"
+#include "alloc_counter.h"
+#include "event_index_writer.h"
+#include "hepmc3_pool.h"
 #include <iostream>
 
 using namespace Pythia8;
@@ -7,6 +9,8 @@ using namespace Pythia8;
 int main(int argc, char *argv[]) {
   int nEvents = (argc > 1) ? std::atoi(argv[1]) : 10;
   std::string outFile = (argc > 2) ? argv[2] : "angantyr_test.hepmc3";
+  // --pooled-hepmc: format HepMC3 directly instead of through WriterAscii
+  bool pooledHepMC = argc > 3 && std::string(argv[3]) == "--pooled-hepmc";
 
   Pythia pythia;
 
@@ -30,10 +34,14 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  // HepMC3 Writer
-  HepMC3::Pythia8ToHepMC3 hepmcWriter;
-  hepmcWriter.set_print_inconsistency(false);
-  HepMC3::WriterAscii asciiWriter(outFile);
+  // HepMC3 Writer (pooled event reused across events)
+  hepgen::PooledHepMC3Event hepmcevt;
+  auto output = hepgen::openHepMC3Output(outFile, pooledHepMC);
+  if (!output)
+    return 1;
+  hepgen::HepMC3Output &asciiWriter = *output;
+  auto index = hepgen::EventIndexWriter::open(outFile); // outFile.idx
+  long allocStart = hepgen::allocCount();
 
   std::cout << "Generating " << nEvents << " pPb events with Angantyr..."
             << std::endl;
@@ -42,16 +50,26 @@ int main(int argc, char *argv[]) {
     if (!pythia.next())
       continue;
 
-    HepMC3::GenEvent hepmcevt;
-    hepmcWriter.fill_next_event(pythia, &hepmcevt);
-    asciiWriter.write_event(hepmcevt);
+    hepmcevt.fill(pythia);
+    asciiWriter.write(hepmcevt);
+    if (index)
+      index->add(asciiWriter, hepmcevt, pythia);
 
     if (i % 2 == 0)
       std::cout << "  Event " << i << std::endl;
   }
 
   pythia.stat();
+  asciiWriter.close();
+  if (index)
+    index->close(asciiWriter);
+  if (asciiWriter.failed())
+    return 1;
   std::cout << "Done! Output saved to " << outFile << std::endl;
+  if (allocStart >= 0 && nEvents > 0)
+    std::cout << "Allocations per event: "
+              << double(hepgen::allocCount() - allocStart) / nEvents
+              << std::endl;
 
   return 0;
 }
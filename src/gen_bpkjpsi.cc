@@ -4,22 +4,57 @@
 // B+ -> K+ J/psi (J/psi -> mu+ mu-) generator
 // Using PYTHIA8 (CMS CP5 tune) + EvtGen 2.2
 //
-// Usage: ./gen_bpkjpsi [nEvents] [outputFile.hepmc3]
+// Usage: ./gen_bpkjpsi [nEvents] [outputFile.hepmc3] [--native <file.yoda>]
+//                      [--native-configs <card>] [--snapshot-every <n>]
+//                      [--no-hepmc] [--pooled-hepmc]
+//                      [--seed <n>] [--first-event <k> | --job <j>]
+//                      [--variations <file.cmnd>] [--detector <card>]
+//                      [--pdf-table on|memo|validate]
+//                      [--columnar <file>] [--columnar-pids <list>]
+//                      [--columnar-compress]
+//
+// What nEvents counts depends on the seeding options:
+//   (none) or --job j   nEvents signal events (B+ -> K+ J/psi -> mu+mu-)
+//   --first-event k     nEvents TRIED events, global indices
+//                       k ... k + nEvents - 1; the number of signal events
+//                       is then whatever those events contain
+// --first-event splits a sample in tried events, so that jobs with disjoint
+// ranges add up to the same sample however the work is split. --job keeps
+// counting signal events: job j draws its tried events from indices
+// j * 2^32, j * 2^32 + 1, ... of the campaign seed, so jobs of one campaign
+// never share events and the seed is never offset per job.
+//
+// --native runs the J/psi-in-jet analysis without its non-prompt veto: every
+// J/psi here comes from a B, so Rivet (and the default native analysis)
+// would reject every event. The result cannot be validated against Rivet.
+//
+// --pooled-hepmc formats the HepMC3 output directly (hepmc3_pool.h) instead
+// of through HepMC3::WriterAscii.
+//
+// --snapshot-every n rewrites the --native YODA file every n signal events,
+// for scripts/aggregate_results.py.
 // =============================================================================
 
 #include "Pythia8/Pythia.h"
 #include "Pythia8Plugins/EvtGen.h"
-#include "Pythia8Plugins/HepMC3.h"
-
-#include "HepMC3/GenEvent.h"
-#include "HepMC3/WriterAscii.h"
 
 #include "EvtGenExternal/EvtExternalGenList.hh"
 
+#include "alloc_counter.h"
+#include "columnar_writer.h"
+#include "counter_rng.h"
+#include "detector_response.h"
+#include "event_index_writer.h"
+#include "hepmc3_pool.h"
+#include "jpsijet_native.h"
+#include "pdf_table.h"
+#include "signal_selector.h"
+
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 using namespace Pythia8;
 
@@ -34,11 +69,73 @@ int main(int argc, char *argv[]) {
   if (argc > 2)
     outputFile = argv[2];
 
+  // Native J/psi-in-jet analysis on the generator record
+  std::string nativeYoda;
+  std::string nativeConfigs;  // extra jet selections (jpsijet_configs.txt)
+  long snapshotEvery = 0;     // periodic --native snapshot
+  std::string variationsCard; // shower uncertainty weights
+  std::unique_ptr<hepgen::DetectorResponse> detector; // detector-level output
+  std::string columnarFile;
+  std::vector<int> columnarPids; // empty: ColumnarWriter::defaultPids()
+  bool columnarCompress = false;
+  bool writeHepMC = true;
+  bool pooledHepMC = false;
+  int seed = 0; // 0 = use system time
+  long long firstEvent = -1;
+  long job = -1;
+  hepgen::PdfTableMode pdfMode = hepgen::PdfTableMode::kOff;
+  for (int iArg = 3; iArg < argc; ++iArg) {
+    std::string arg = argv[iArg];
+    if (arg == "--native" && iArg + 1 < argc) {
+      nativeYoda = argv[++iArg];
+    } else if (arg == "--native-configs" && iArg + 1 < argc) {
+      nativeConfigs = argv[++iArg];
+    } else if (arg == "--snapshot-every" && iArg + 1 < argc) {
+      snapshotEvery = std::atol(argv[++iArg]);
+    } else if (arg == "--variations" && iArg + 1 < argc) {
+      variationsCard = argv[++iArg];
+    } else if (arg == "--no-hepmc") {
+      writeHepMC = false;
+    } else if (arg == "--pooled-hepmc") {
+      pooledHepMC = true;
+    } else if (arg == "--seed" && iArg + 1 < argc) {
+      seed = std::atoi(argv[++iArg]);
+    } else if (arg == "--first-event" && iArg + 1 < argc) {
+      firstEvent = std::atoll(argv[++iArg]);
+    } else if (arg == "--job" && iArg + 1 < argc) {
+      job = std::atol(argv[++iArg]);
+    } else if (arg == "--detector" && iArg + 1 < argc) {
+      detector = std::make_unique<hepgen::DetectorResponse>();
+      if (!detector->readFile(argv[++iArg]))
+        return 1;
+    } else if (arg == "--columnar" && iArg + 1 < argc) {
+      columnarFile = argv[++iArg];
+    } else if (arg == "--columnar-pids" && iArg + 1 < argc) {
+      if (!hepgen::parsePidList(argv[++iArg], columnarPids))
+        return 1;
+    } else if (arg == "--columnar-compress") {
+      columnarCompress = true;
+    } else if (arg == "--pdf-table" && iArg + 1 < argc) {
+      if (!hepgen::parsePdfTableMode(argv[++iArg], pdfMode))
+        return 1;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (firstEvent >= 0 && job >= 0) {
+    std::cerr << "--first-event and --job are exclusive" << std::endl;
+    return 1;
+  }
+
   std::cout << "========================================\n";
   std::cout << "B+ -> K+ J/psi (mu+mu-) Generator\n";
   std::cout << "========================================\n";
-  std::cout << "Events to generate: " << nEvents << "\n";
-  std::cout << "Output file: " << outputFile << "\n";
+  std::cout << "Events to generate: " << nEvents
+            << (firstEvent >= 0 ? " (tried)" : " (signal)") << "\n";
+  std::cout << "Output file: " << (writeHepMC ? outputFile : "none") << "\n";
+  if (!nativeYoda.empty())
+    std::cout << "Native analysis: " << nativeYoda << "\n";
   std::cout << "========================================\n\n";
 
   // Initialize Pythia
@@ -97,8 +194,23 @@ int main(int argc, char *argv[]) {
   // =========================================================================
   // Random seed
   // =========================================================================
-  pythia.readString("Random:setSeed = on");
-  pythia.readString("Random:seed = 0"); // 0 = use system time
+  // A non-zero seed selects counter-based seeding: Pythia, EvtGen and PHOTOS
+  // draw from a stream keyed by (seed, global event index)
+  std::shared_ptr<hepgen::CounterRndmEngine> rndm;
+  if (seed != 0) {
+    rndm = hepgen::installCounterRndm(pythia, seed);
+  } else {
+    pythia.readString("Random:setSeed = on");
+    pythia.readString("Random:seed = 0");
+  }
+
+  // =========================================================================
+  // Shower variations: UncertaintyBands weights, one per variation
+  // =========================================================================
+  if (!variationsCard.empty() && !pythia.readFile(variationsCard)) {
+    std::cerr << "Cannot read variations card " << variationsCard << "\n";
+    return 1;
+  }
 
   // =========================================================================
   // Suppress unnecessary output
@@ -122,6 +234,16 @@ int main(int argc, char *argv[]) {
   pythia.readString("541:mayDecay = off");  // Bc+
   pythia.readString("-541:mayDecay = off"); // Bc-
 
+  // =========================================================================
+  // Tabulated PDF in place of direct LHAPDF calls (same set as PDF:pSet)
+  // =========================================================================
+  std::shared_ptr<hepgen::PdfTableStats> pdfStats;
+  if (pdfMode != hepgen::PdfTableMode::kOff) {
+    pdfStats = hepgen::installTabulatedPDF(pythia, pdfMode);
+    if (!pdfStats)
+      return 1;
+  }
+
   // =========================================================================
   // Initialize EvtGen
   // =========================================================================
@@ -161,8 +283,43 @@ int main(int argc, char *argv[]) {
   // =========================================================================
   // Set up HepMC3 output
   // =========================================================================
-  HepMC3::WriterAscii hepmcWriter(outputFile);
-  HepMC3::Pythia8ToHepMC3 toHepMC;
+  // Pooled event, written through WriterAscii or, with --pooled-hepmc,
+  // directly without per-event allocations
+  hepgen::PooledHepMC3Event hepmcEvent;
+  std::unique_ptr<hepgen::HepMC3Output> hepmcWriter;
+  std::unique_ptr<hepgen::EventIndexWriter> index; // sidecar outputFile.idx
+  if (writeHepMC) {
+    hepmcWriter = hepgen::openHepMC3Output(outputFile, pooledHepMC);
+    if (!hepmcWriter)
+      return 1;
+    index = hepgen::EventIndexWriter::open(outputFile);
+    hepmcWriter->setWeightNames(
+        hepgen::PooledHepMC3Event::weightNames(pythia));
+    hepmcWriter->addRunAttribute("detector",
+                                 detector ? detector->describe() : "none");
+  }
+
+  // Columnar particle output (final state + selected intermediates)
+  std::unique_ptr<hepgen::ColumnarWriter> columnar;
+  if (!columnarFile.empty()) {
+    columnar = std::make_unique<hepgen::ColumnarWriter>(columnarFile,
+                                                        columnarCompress);
+    if (!columnar->ok())
+      return 1;
+    if (!columnarPids.empty())
+      columnar->keepPids(columnarPids);
+  }
+
+  // Native analysis. The selection is kept identical to
+  // rivet/JpsiJet_RivetAnalyzer.cc, which vetoes J/psi from b decays.
+  std::unique_ptr<hepgen::JpsiJetNativeAnalysis> native;
+  if (!nativeYoda.empty()) {
+    native = std::make_unique<hepgen::JpsiJetNativeAnalysis>();
+    native->setVetoNonPrompt(false); // all signal J/psi are from B+
+    if (!nativeConfigs.empty() && !native->readSelections(nativeConfigs))
+      return 1;
+    native->setWeightNames(hepgen::PooledHepMC3Event::weightNames(pythia));
+  }
 
   // =========================================================================
   // Event loop
@@ -171,68 +328,67 @@ int main(int argc, char *argv[]) {
   int nBplusKJpsi = 0;
   int nEventsGenerated = 0;
   int nEventsTotal = 0;
+  long allocStart = hepgen::allocCount();
+
+  // Signal chain, charge conjugate included
+  const hepgen::DecayChain kBpToKJpsi(521, {321, {443, {13, -13}}});
+  hepgen::PidIndex pidIndex;
+  std::vector<int> signalMatches;
 
   std::cout << "Starting event generation...\n";
 
-  while (nBplusKJpsi < nEvents) {
+  bool countTried = firstEvent >= 0;
+  long long iGlobal = countTried ? firstEvent
+                       : job > 0 ? (long long)(uint64_t(job) << 32)
+                                 : 0;
+  while (countTried ? nEventsTotal < nEvents : nBplusKJpsi < nEvents) {
     nEventsTotal++;
+    long long iThis = iGlobal++;
+    if (rndm)
+      rndm->setEvent(iThis);
 
     // Generate event
     if (!pythia.next())
       continue;
     nEventsGenerated++;
 
-    // Check for B+ in the event
-    bool hasBplus = false;
-    for (int i = 0; i < pythia.event.size(); ++i) {
-      int absId = std::abs(pythia.event[i].id());
-      if (absId == 521) { // B+ or B-
-        hasBplus = true;
-        nBplusFound++;
-        break;
-      }
-    }
+    // Index the event by |PID| once; all selections below use it
+    pidIndex.build(pythia.event);
 
-    if (!hasBplus)
+    // Check for B+ in the event
+    if (!pidIndex.contains(521))
       continue;
+    nBplusFound++;
 
-    // Apply EvtGen decays to all B hadrons
+    // Apply EvtGen decays to all B hadrons, then index the decay products
     evtgen->decay();
+    pidIndex.update(pythia.event);
 
     // Check if we have B+ -> K+ J/psi (mu+mu-)
-    bool hasSignal = false;
-    for (int i = 0; i < pythia.event.size(); ++i) {
-      const Particle &p = pythia.event[i];
-
-      // Look for J/psi from B+
-      if (std::abs(p.id()) == 443) { // J/psi
-        // Check if J/psi comes from B+
-        int mother1 = p.mother1();
-        if (mother1 > 0 && std::abs(pythia.event[mother1].id()) == 521) {
-          // Check if J/psi decays to mu+mu-
-          int d1 = p.daughter1();
-          int d2 = p.daughter2();
-          if (d1 > 0 && d2 > 0) {
-            int id1 = std::abs(pythia.event[d1].id());
-            int id2 = std::abs(pythia.event[d2].id());
-            if ((id1 == 13 && id2 == 13)) { // mu+ mu-
-              hasSignal = true;
-              break;
-            }
-          }
-        }
-      }
-    }
-
-    if (!hasSignal)
+    if (kBpToKJpsi.findAll(pythia.event, pidIndex, signalMatches) == 0)
       continue;
 
     nBplusKJpsi++;
 
+    // Detector-level final state, after the EvtGen decays
+    if (detector)
+      detector->apply(pythia.event, uint64_t(seed), uint64_t(iThis));
+
     // Convert to HepMC3 and write
-    HepMC3::GenEvent hepmcEvent;
-    toHepMC.fill_next_event(pythia, &hepmcEvent);
-    hepmcWriter.write_event(hepmcEvent);
+    hepmcEvent.fill(pythia);
+    if (rndm)
+      hepmcEvent.eventNumber = long(iThis);
+    if (hepmcWriter)
+      hepmcWriter->write(hepmcEvent);
+    if (index)
+      index->add(*hepmcWriter, hepmcEvent, pythia);
+    if (native) {
+      native->analyze(pythia.event, hepmcEvent);
+      if (snapshotEvery > 0 && native->eventsAnalyzed() % snapshotEvery == 0)
+        native->write(nativeYoda);
+    }
+    if (columnar)
+      columnar->add(pythia.event, iThis, pythia.info.weight());
 
     // Progress report
     if (nBplusKJpsi % 1000 == 0) {
@@ -254,10 +410,39 @@ int main(int argc, char *argv[]) {
             << "\n";
   std::cout << "Overall efficiency: " << 100.0 * nBplusKJpsi / nEventsTotal
             << "%\n";
-  std::cout << "Output written to: " << outputFile << "\n";
+  if (hepmcWriter) {
+    hepmcWriter->close();
+    std::cout << "Output written to: " << outputFile << "\n";
+    if (index) {
+      index->close(*hepmcWriter);
+      std::cout << "Event index: " << index->path() << "\n";
+    }
+    if (hepmcWriter->failed())
+      return 1;
+  }
+  if (native) {
+    if (!native->write(nativeYoda))
+      return 1;
+    std::cout << "Native analysis written to: " << nativeYoda << "\n";
+  }
+  if (columnar) {
+    if (!columnar->close())
+      return 1;
+    std::cout << "Columnar output: " << columnar->path() << " ("
+              << columnar->eventsWritten() << " events, "
+              << columnar->bytesWritten() / 1e6 << " MB)\n";
+  }
+  if (allocStart >= 0 && nEventsTotal > 0)
+    std::cout << "Allocations per tried event: "
+              << double(hepgen::allocCount() - allocStart) / nEventsTotal
+              << "\n";
   std::cout << "========================================\n";
 
   pythia.stat();
+  if (pdfStats)
+    pdfStats->print(std::cout);
+  if (detector)
+    detector->print(std::cout);
 
   return 0;
 }
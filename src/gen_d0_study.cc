@@ -1,10 +1,19 @@
 #include "Pythia8/Pythia.h"
 #include "Pythia8Plugins/EvtGen.h"
+#include "bkg_library.h"
+#include "centrality.h"
+#include "columnar_writer.h"
+#include "counter_rng.h"
+#include "pdf_table.h"
+#include "precision_monitor.h"
+#include "signal_selector.h"
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
-#include <random>
+#include <memory>
 #include <string>
+#include <vector>
 
 using namespace Pythia8;
 
@@ -31,8 +40,7 @@ Vec4 boostToRest(const Vec4 &p, const Vec4 &pParent) {
 bool isNonPrompt(int idx, const Event &event) {
   int mother = event[idx].mother1();
   while (mother > 0) {
-    int aid = std::abs(event[mother].id());
-    if ((aid >= 500 && aid < 600) || (aid >= 5000 && aid < 6000))
+    if (hepgen::flavour::isBHadron(event[mother].id()))
       return true;
     mother = event[mother].mother1();
   }
@@ -42,6 +50,14 @@ bool isNonPrompt(int idx, const Event &event) {
 int main(int argc, char *argv[]) {
   if (argc < 4) {
     std::cerr << "Usage: " << argv[0] << " <nEvents> <seed> <outputFile.txt>"
+              << " [--centrality 0-10,30-50] [--sigma-inel <mb>]"
+              << " [--build-library | --embed <library>]"
+              << " [--first-event <k>] [--pdf-table on|memo|validate]"
+              << " [--columnar <file> [--columnar-pids <list>]"
+              << " [--columnar-compress]]"
+              << " [--target-precision rho00=<err>,v2=<err>"
+              << " [--precision-pt <edges>] [--adaptive-bias <power>]]"
+              << " [--snapshot <file.acc> [--snapshot-every <n>]]"
               << std::endl;
     return 1;
   }
@@ -49,18 +65,106 @@ int main(int argc, char *argv[]) {
   int seed = std::atoi(argv[2]);
   std::string outFile = argv[3];
 
+  // Optional flags after the positional arguments
+  std::string centralitySpec;
+  double sigmaInelMb = hepgen::kSigmaInelPbPb5TeV;
+  bool buildLibrary = false; // outputFile is a background library
+  std::string embedLibrary;  // embed pp signal into this library
+  long long firstEvent = 0;  // global index of the first event
+  hepgen::PdfTableMode pdfMode = hepgen::PdfTableMode::kOff;
+  std::string columnarFile;      // columnar particle output
+  std::vector<int> columnarPids; // empty: ColumnarWriter::defaultPids()
+  bool columnarCompress = false;
+  hepgen::PrecisionMonitor precision; // stop once all bins reach targets
+  double biasPower = 0.;              // pTHat bias towards starved bins
+  std::string snapshotFile; // per-bin sums for scripts/aggregate_results.py
+  long snapshotEvery = 1000;
+  for (int iArg = 4; iArg < argc; ++iArg) {
+    std::string arg = argv[iArg];
+    if (arg == "--centrality" && iArg + 1 < argc) {
+      centralitySpec = argv[++iArg];
+    } else if (arg == "--sigma-inel" && iArg + 1 < argc) {
+      sigmaInelMb = std::atof(argv[++iArg]);
+    } else if (arg == "--build-library") {
+      buildLibrary = true;
+    } else if (arg == "--embed" && iArg + 1 < argc) {
+      embedLibrary = argv[++iArg];
+    } else if (arg == "--first-event" && iArg + 1 < argc) {
+      firstEvent = std::atoll(argv[++iArg]);
+    } else if (arg == "--columnar" && iArg + 1 < argc) {
+      columnarFile = argv[++iArg];
+    } else if (arg == "--columnar-pids" && iArg + 1 < argc) {
+      if (!hepgen::parsePidList(argv[++iArg], columnarPids))
+        return 1;
+    } else if (arg == "--columnar-compress") {
+      columnarCompress = true;
+    } else if (arg == "--target-precision" && iArg + 1 < argc) {
+      if (!precision.parseTargets(argv[++iArg]))
+        return 1;
+    } else if (arg == "--precision-pt" && iArg + 1 < argc) {
+      if (!precision.parsePtEdges(argv[++iArg]))
+        return 1;
+    } else if (arg == "--adaptive-bias" && iArg + 1 < argc) {
+      biasPower = std::atof(argv[++iArg]);
+      if (biasPower <= 0.) {
+        std::cerr << "--adaptive-bias needs a positive power" << std::endl;
+        return 1;
+      }
+    } else if (arg == "--snapshot" && iArg + 1 < argc) {
+      snapshotFile = argv[++iArg];
+    } else if (arg == "--snapshot-every" && iArg + 1 < argc) {
+      snapshotEvery = std::max(1L, std::atol(argv[++iArg]));
+    } else if (arg == "--pdf-table" && iArg + 1 < argc) {
+      if (!hepgen::parsePdfTableMode(argv[++iArg], pdfMode))
+        return 1;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  // Centrality classes (minimum bias if none requested)
+  std::vector<hepgen::CentralityClass> centClasses;
+  if (!centralitySpec.empty() &&
+      !hepgen::parseCentralityClasses(centralitySpec, sigmaInelMb,
+                                      centClasses))
+    return 1;
+  if (buildLibrary && !embedLibrary.empty()) {
+    std::cerr << "--build-library and --embed are exclusive" << std::endl;
+    return 1;
+  }
+
+  // Background library for embedding (memory-mapped, shared between jobs)
+  std::unique_ptr<hepgen::BkgLibrary> bkgLibrary;
+  if (!embedLibrary.empty()) {
+    bkgLibrary = std::make_unique<hepgen::BkgLibrary>(embedLibrary);
+    if (!bkgLibrary->ok() || bkgLibrary->size() == 0)
+      return 1;
+    if (!centClasses.empty())
+      std::cout << "Note: centrality is set by the library, ignoring "
+                << "--centrality" << std::endl;
+  }
+
   Pythia pythia;
 
-  // Pb-Pb @ 5.02 TeV with Angantyr
-  pythia.readString("HeavyIon:mode = 1");
-  pythia.readString("Beams:idA = 1000822080");
-  pythia.readString("Beams:idB = 1000822080");
+  if (embedLibrary.empty()) {
+    // Pb-Pb @ 5.02 TeV with Angantyr
+    pythia.readString("HeavyIon:mode = 1");
+    pythia.readString("Beams:idA = 1000822080");
+    pythia.readString("Beams:idB = 1000822080");
+  } else {
+    // Embedding: only the hard cc/bb subcollision, as pp at the same sqrt(sNN)
+    pythia.readString("Beams:idA = 2212");
+    pythia.readString("Beams:idB = 2212");
+  }
   pythia.readString("Beams:eCM = 5020.");
 
-  // Enable charm and beauty
-  pythia.readString("HardQCD:hardccbar = on");
-  pythia.readString("HardQCD:hardbbbar = on");
-  pythia.readString("PhaseSpace:pTHatMin = 3.0");
+  // Enable charm and beauty (minimum-bias underlying event for a library)
+  if (!buildLibrary) {
+    pythia.readString("HardQCD:hardccbar = on");
+    pythia.readString("HardQCD:hardbbbar = on");
+    pythia.readString("PhaseSpace:pTHatMin = 3.0");
+  }
 
   // =========================================================================
   // TUNE SELECTION - CMS CP5 (recommended for LHC spectra)
@@ -96,13 +200,84 @@ int main(int argc, char *argv[]) {
   pythia.readString("Next:numberShowProcess = 0");
   pythia.readString("Next:numberShowEvent = 0");
 
-  // Set random seed
-  pythia.readString("Random:setSeed = on");
-  pythia.readString("Random:seed = " + std::to_string(seed));
+  // Counter-based random numbers: event i of the sample is generated from
+  // (seed, i) whatever the number of jobs it is split into
+  auto rndm = hepgen::installCounterRndm(pythia, seed);
+
+  // Tabulated PDF for the pp signal of embedding. Angantyr builds its own
+  // sub-collision generators, which do not take user PDF objects.
+  std::shared_ptr<hepgen::PdfTableStats> pdfStats;
+  if (pdfMode != hepgen::PdfTableMode::kOff) {
+    if (embedLibrary.empty()) {
+      std::cout << "Note: --pdf-table applies to --embed only, ignored for "
+                << "Angantyr" << std::endl;
+    } else {
+      pdfStats = hepgen::installTabulatedPDF(pythia, pdfMode);
+      if (!pdfStats)
+        return 1;
+    }
+  }
+
+  // Bias towards the pT bins that have not reached their precision. The
+  // hook acts on the hard process, which is the pp signal when embedding;
+  // Angantyr builds its sub-collision generators without user hooks.
+  std::shared_ptr<hepgen::PtHatBiasHook> biasHook;
+  if (biasPower > 0.) {
+    if (!precision.enabled()) {
+      std::cerr << "--adaptive-bias needs --target-precision" << std::endl;
+      return 1;
+    }
+    if (embedLibrary.empty()) {
+      std::cout << "Note: --adaptive-bias applies to --embed only, ignored "
+                << "for Angantyr" << std::endl;
+    } else {
+      biasHook = std::make_shared<hepgen::PtHatBiasHook>(biasPower);
+      pythia.setUserHooksPtr(biasHook);
+    }
+  }
+
+  // Library events are stored with the reaction plane along x
+  if (buildLibrary && centClasses.empty())
+    hepgen::parseCentralityClasses("0-100", sigmaInelMb, centClasses);
+
+  // Restrict impact-parameter sampling to the requested centrality classes
+  if (embedLibrary.empty() && !centClasses.empty()) {
+    pythia.setHIHooks(std::make_shared<hepgen::CentralityHIHooks>(
+        centClasses, !buildLibrary));
+    std::cout << "Centrality classes:" << std::endl;
+    for (const auto &cls : centClasses)
+      std::cout << "  " << cls.label() << " : b = [" << cls.bMin << ", "
+                << cls.bMax << ") fm" << std::endl;
+  }
 
   if (!pythia.init())
     return 1;
 
+  // Library build: store the underlying events and skip the D* analysis
+  if (buildLibrary) {
+    hepgen::BkgLibraryWriter libWriter(outFile);
+    if (!libWriter.ok())
+      return 1;
+    std::cout << "Building background library (" << nEvents
+              << " events)..." << std::endl;
+    for (int iEvent = 0; iEvent < nEvents; ++iEvent) {
+      rndm->setEvent(firstEvent + iEvent);
+      if (!pythia.next())
+        continue;
+      if (!libWriter.addEvent(pythia.event, pythia.info.hiInfo->b(),
+                              pythia.info.hiInfo->nCollTot() -
+                                  pythia.info.hiInfo->nCollEL()))
+        return 1;
+      if (iEvent % 100 == 0)
+        std::cout << "  Event " << iEvent << "/" << nEvents << std::endl;
+    }
+    if (!libWriter.close())
+      return 1;
+    pythia.stat();
+    std::cout << "Background library written to " << outFile << std::endl;
+    return 0;
+  }
+
   // EvtGen Setup
   std::string evtGenDec = "/opt/hep/share/EvtGen/DECAY.DEC";
   std::string evtGenPdt = "/opt/hep/share/EvtGen/evt.pdl";
@@ -116,44 +291,89 @@ int main(int argc, char *argv[]) {
   // Output file for measurements only
   std::ofstream fout(outFile);
 
-  // Random generator for event plane
-  std::mt19937 rand_gen(seed);
-  std::uniform_real_distribution<> runif(0, M_PI);
+  // Columnar particle output: every event, after decays and embedding
+  std::unique_ptr<hepgen::ColumnarWriter> columnar;
+  if (!columnarFile.empty()) {
+    columnar = std::make_unique<hepgen::ColumnarWriter>(columnarFile,
+                                                        columnarCompress);
+    if (!columnar->ok())
+      return 1;
+    if (!columnarPids.empty())
+      columnar->keepPids(columnarPids);
+  }
+
+  // Event plane and background pick: own stream, so they do not shift the
+  // numbers Pythia and EvtGen draw
+  hepgen::CounterRng planeRng(seed, hepgen::kStreamEventPlane);
 
   int countPrompt = 0, countNonPrompt = 0;
+  double sumWeight = 0.;
 
-  std::cout << "Starting generation (Seed: " << seed << ", Events: " << nEvents
-            << ")..." << std::endl;
+  // Signal chain D*+ -> D0 pi+, charge conjugate included
+  const hepgen::DecayChain kDstarToD0Pi(413, {421, 211});
+  hepgen::PidIndex pidIndex;
+  std::vector<int> dstarMatches;
 
+  std::cout << "Starting generation (Seed: " << seed << ", Events: "
+            << firstEvent << " - " << firstEvent + nEvents - 1 << ")..."
+            << std::endl;
+  if (precision.enabled())
+    std::cout << "Stopping once every (type, pT) bin reaches the target "
+              << "precision, at most " << nEvents << " events" << std::endl;
+
+  int nProcessed = 0; // events looped over (less than nEvents if stopped)
   for (int iEvent = 0; iEvent < nEvents; ++iEvent) {
+    nProcessed = iEvent + 1;
+    rndm->setEvent(firstEvent + iEvent);
+    planeRng.setEvent(firstEvent + iEvent);
     if (!pythia.next())
       continue;
 
     // Random event plane angle
-    double psi_RP = runif(rand_gen);
+    double psi_RP = M_PI * planeRng.flat();
+
+    // Collision geometry of this event
+    double weight = pythia.info.weight();
+    double bImpact = 0.;
+    int nColl = 0;
+    long bkgIndex = -1;
+    if (bkgLibrary) {
+      bkgIndex = std::min(long(planeRng.flat() * bkgLibrary->size()),
+                          long(bkgLibrary->size()) - 1);
+      bImpact = bkgLibrary->record(bkgIndex).b;
+      nColl = int(bkgLibrary->record(bkgIndex).nColl);
+    } else {
+      bImpact = pythia.info.hiInfo->b();
+      nColl = pythia.info.hiInfo->nCollTot() - pythia.info.hiInfo->nCollEL();
+    }
+    sumWeight += weight;
+    int iClass = hepgen::findCentralityClass(centClasses, bImpact);
+    if (iClass >= 0) {
+      centClasses[iClass].nEvents++;
+      centClasses[iClass].sumWeight += weight;
+    }
 
     // Perform EvtGen decays
     evtgen->decay();
 
+    // Overlay the underlying event, rotated to this event plane. Appended
+    // particles come after the signal, so signal indices are unchanged.
+    int nSignal = pythia.event.size();
+    pidIndex.build(pythia.event, nSignal);
+    if (bkgLibrary)
+      bkgLibrary->overlay(bkgIndex, psi_RP, pythia.event);
+
+    if (columnar)
+      columnar->add(pythia.event, firstEvent + iEvent, weight);
+
     // RP normal in lab frame (perpendicular to beam, B-field direction)
     Vec4 nLab(-std::sin(psi_RP), std::cos(psi_RP), 0.0, 0.0);
 
-    // Loop over particles to find D*
-    for (int i = 0; i < pythia.event.size(); ++i) {
-      if (pythia.event[i].idAbs() != 413)
-        continue; // D*+/-
-
-      // Find D0 daughter
-      int d0_idx = -1;
-      for (int d = pythia.event[i].daughter1();
-           d <= pythia.event[i].daughter2(); ++d) {
-        if (d > 0 && pythia.event[d].idAbs() == 421) {
-          d0_idx = d;
-          break;
-        }
-      }
-      if (d0_idx < 0)
-        continue;
+    // Loop over D* -> D0 pi candidates
+    int nDstar = kDstarToD0Pi.findAll(pythia.event, pidIndex, dstarMatches);
+    for (int iMatch = 0; iMatch < nDstar; ++iMatch) {
+      int i = dstarMatches[iMatch * kDstarToD0Pi.size()];
+      int d0_idx = dstarMatches[iMatch * kDstarToD0Pi.size() + 1];
 
       Vec4 pStar = pythia.event[i].p();
       Vec4 pD0 = pythia.event[d0_idx].p();
@@ -182,17 +402,44 @@ int main(int argc, char *argv[]) {
                           (pD0Mag * nMag);
         bool nonPrompt = isNonPrompt(i, pythia.event);
 
-        // Output: type pT rapidity cosTheta cos2DeltaPhi
+        // Output: type pT rapidity cosTheta cos2DeltaPhi b nColl weight
+        //         bkgIndex psi_RP
         fout << (nonPrompt ? 1 : 0) << " " << pt << " " << rapidity << " "
-             << cosTheta << " " << cos2DeltaPhi << "\n";
+             << cosTheta << " " << cos2DeltaPhi << " " << bImpact << " "
+             << nColl << " " << weight << " " << bkgIndex << " " << psi_RP
+             << "\n";
 
         if (nonPrompt)
           countNonPrompt++;
         else
           countPrompt++;
+        if (precision.enabled() || !snapshotFile.empty())
+          precision.add(nonPrompt, pt, cosTheta, cos2DeltaPhi, weight);
       }
     }
 
+    // Stop at the target precision, checked when new candidates came in
+    if (precision.enabled() && nDstar > 0 && precision.done()) {
+      std::cout << "  All bins at target precision after " << nProcessed
+                << " events" << std::endl;
+      break;
+    }
+
+    // Move the bias threshold to the lowest bin that still needs candidates.
+    // On a fixed cadence of 100 events, whether or not this event had a D*,
+    // so it neither stalls at low D* rates nor flips with every candidate
+    // near a target.
+    if (precision.enabled() && biasHook && nProcessed % 100 == 0 &&
+        precision.starvedPt() != biasHook->getThreshold()) {
+      biasHook->setThreshold(precision.starvedPt());
+      std::cout << "  Event " << iEvent << ": biasing against pTHat < "
+                << biasHook->getThreshold() << " GeV" << std::endl;
+    }
+
+    if (!snapshotFile.empty() && nProcessed % snapshotEvery == 0)
+      precision.writeSnapshot(snapshotFile, seed, firstEvent, nProcessed,
+                              false);
+
     if (iEvent % 500 == 0) {
       std::cout << "  Event " << iEvent << "/" << nEvents
                 << " (Prompt: " << countPrompt
@@ -201,10 +448,49 @@ int main(int argc, char *argv[]) {
   }
 
   pythia.stat();
+  if (pdfStats)
+    pdfStats->print(std::cout);
   std::cout << "\nGeneration complete!" << std::endl;
   std::cout << "  Prompt D*: " << countPrompt << std::endl;
   std::cout << "  Non-prompt D*: " << countNonPrompt << std::endl;
+  if (nProcessed < nEvents)
+    std::cout << "  Events: " << nProcessed << " of " << nEvents
+              << " (stopped at target precision)" << std::endl;
+  if (precision.enabled()) {
+    precision.print(std::cout);
+    precision.write(fout);
+  }
+  if (!snapshotFile.empty() &&
+      precision.writeSnapshot(snapshotFile, seed, firstEvent, nProcessed,
+                              true))
+    std::cout << "  Snapshot: " << snapshotFile << std::endl;
+
+  // Per-class cross sections, also appended as comments to the output file.
+  // When embedding, Pythia generates the pp signal only: sigmaGen and its
+  // per-class shares are pp cross sections, labelled as such.
+  double sigmaGen = pythia.info.sigmaGen();
+  const bool ppSigma = bool(bkgLibrary);
+  std::cout << "  Cross section" << (ppSigma ? " (pp signal)" : "") << ": "
+            << sigmaGen << " mb" << std::endl;
+  for (const auto &cls : centClasses) {
+    double sigmaClass =
+        (sumWeight > 0.) ? sigmaGen * cls.sumWeight / sumWeight : 0.;
+    std::cout << "  Class " << cls.label() << ": " << cls.nEvents
+              << " events, sigma" << (ppSigma ? " (pp signal)" : "") << " = "
+              << sigmaClass << " mb" << std::endl;
+    fout << "# class " << cls.cMin << " " << cls.cMax << " bMin " << cls.bMin
+         << " bMax " << cls.bMax << " nEvents " << cls.nEvents << " sumW "
+         << cls.sumWeight << (ppSigma ? " sigma_pp_mb " : " sigma_mb ")
+         << sigmaClass << "\n";
+  }
   std::cout << "  Output: " << outFile << std::endl;
+  if (columnar) {
+    if (!columnar->close())
+      return 1;
+    std::cout << "  Columnar output: " << columnar->path() << " ("
+              << columnar->eventsWritten() << " events, "
+              << columnar->bytesWritten() / 1e6 << " MB)" << std::endl;
+  }
 
   return 0;
 }
@@ -8,10 +8,24 @@
 // =============================================================================
 
 #include "Pythia8/Pythia.h"
-#include "Pythia8Plugins/HepMC3.h"
+#include "alloc_counter.h"
+#include "columnar_writer.h"
+#include "counter_rng.h"
+#include "detector_response.h"
+#include "event_filter.h"
+#include "event_index_writer.h"
+#include "hepmc3_pool.h"
+#include "jpsijet_native.h"
+#include "onium_ldme.h"
+#include "pdf_table.h"
+#include "signal_selector.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace Pythia8;
 
@@ -22,6 +36,105 @@ int main(int argc, char *argv[]) {
   int nEvents = (argc > 1) ? std::atoi(argv[1]) : 10000;
   std::string outFile = (argc > 2) ? argv[2] : "prompt_jpsi.hepmc3";
 
+  // Optional acceptance filter, applied before HepMC3 conversion:
+  //   --filter-card <file>   runcard with Filter:* settings
+  //   --filter "pTMin = 6.5" single setting (repeatable)
+  // Native J/psi-in-jet analysis on the generator record:
+  //   --native <file.yoda>   run JpsiJet_RivetAnalyzer in-process
+  //   --no-hepmc             do not write HepMC3 (outFile is ignored)
+  //   --pooled-hepmc         format HepMC3 directly instead of through
+  //                          HepMC3::WriterAscii (hepmc3_pool.h)
+  //   --native-configs <f>   extra jet selections filled in the same pass,
+  //                          e.g. runcards/jpsijet_configs.txt
+  //   --snapshot-every <n>   rewrite the YODA file every n analyzed events,
+  //                          for scripts/aggregate_results.py
+  // Shower uncertainty weights, written as named HepMC3 weights:
+  //   --variations <file>    e.g. runcards/shower_variations.cmnd
+  // NRQCD LDME sets as extra event weights (O_new / O_gen per subprocess):
+  //   --ldme-set <name>=<card>  e.g. ldme_chao=runcards/ldme/chao2012.txt
+  // Random seed (default: Pythia's fixed default seed):
+  //   --seed <n>             campaign seed; each event gets a counter-based
+  //                          stream keyed by (seed, global event index)
+  //   --first-event <k>      global index of the first event (default 0), so
+  //                          parallel jobs cover disjoint index ranges
+  // Columnar particle output for numpy / ML (scripts/columnar.py):
+  //   --columnar <file>      final state and selected intermediates
+  //   --columnar-pids <list> |PID|s of the intermediates, e.g. 443,100443
+  //   --columnar-compress    byte-shuffle + deflate each column chunk
+  // Parametric detector response before output and analysis:
+  //   --detector <file>      e.g. runcards/detector_cms.cmnd
+  // Tabulated PDF in place of direct LHAPDF calls:
+  //   --pdf-table <mode>     on | memo (plus (x, Q2) memo cache) | validate
+  //                          (compare every evaluation with LHAPDF)
+  hepgen::EventFilter filter;
+  std::string nativeYoda;
+  std::string nativeConfigs;
+  long snapshotEvery = 0;
+  std::string variationsCard;
+  std::unique_ptr<hepgen::DetectorResponse> detector;
+  std::string columnarFile;
+  std::vector<int> columnarPids; // empty: ColumnarWriter::defaultPids()
+  bool columnarCompress = false;
+  std::vector<std::pair<std::string, hepgen::LdmeSet>> ldmeSets;
+  bool writeHepMC = true;
+  bool pooledHepMC = false;
+  int seed = -1;
+  long long firstEvent = 0;
+  hepgen::PdfTableMode pdfMode = hepgen::PdfTableMode::kOff;
+  for (int iArg = 3; iArg < argc; ++iArg) {
+    std::string arg = argv[iArg];
+    if (arg == "--filter-card" && iArg + 1 < argc) {
+      if (!filter.readFile(argv[++iArg]))
+        return 1;
+    } else if (arg == "--filter" && iArg + 1 < argc) {
+      if (!filter.readString(argv[++iArg]))
+        return 1;
+    } else if (arg == "--native" && iArg + 1 < argc) {
+      nativeYoda = argv[++iArg];
+    } else if (arg == "--native-configs" && iArg + 1 < argc) {
+      nativeConfigs = argv[++iArg];
+    } else if (arg == "--snapshot-every" && iArg + 1 < argc) {
+      snapshotEvery = std::atol(argv[++iArg]);
+    } else if (arg == "--variations" && iArg + 1 < argc) {
+      variationsCard = argv[++iArg];
+    } else if (arg == "--ldme-set" && iArg + 1 < argc) {
+      std::string spec = argv[++iArg];
+      size_t eq = spec.find('=');
+      if (eq == 0 || eq == std::string::npos) {
+        std::cerr << "--ldme-set expects <name>=<card>" << std::endl;
+        return 1;
+      }
+      ldmeSets.emplace_back(spec.substr(0, eq), hepgen::LdmeSet());
+      if (!ldmeSets.back().second.readFile(spec.substr(eq + 1)))
+        return 1;
+    } else if (arg == "--no-hepmc") {
+      writeHepMC = false;
+    } else if (arg == "--pooled-hepmc") {
+      pooledHepMC = true;
+    } else if (arg == "--seed" && iArg + 1 < argc) {
+      seed = std::atoi(argv[++iArg]);
+    } else if (arg == "--first-event" && iArg + 1 < argc) {
+      firstEvent = std::atoll(argv[++iArg]);
+    } else if (arg == "--detector" && iArg + 1 < argc) {
+      detector = std::make_unique<hepgen::DetectorResponse>();
+      if (!detector->readFile(argv[++iArg]))
+        return 1;
+    } else if (arg == "--columnar" && iArg + 1 < argc) {
+      columnarFile = argv[++iArg];
+    } else if (arg == "--columnar-pids" && iArg + 1 < argc) {
+      if (!hepgen::parsePidList(argv[++iArg], columnarPids))
+        return 1;
+    } else if (arg == "--columnar-compress") {
+      columnarCompress = true;
+    } else if (arg == "--pdf-table" && iArg + 1 < argc) {
+      if (!hepgen::parsePdfTableMode(argv[++iArg], pdfMode))
+        return 1;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
+
   Pythia pythia;
 
   // =========================================================================
@@ -126,12 +239,33 @@ int main(int argc, char *argv[]) {
   pythia.readString("443:onMode = off");       // Turn off all J/psi decays
   pythia.readString("443:onIfMatch = 13 -13"); // Enable only mu+ mu-
 
+  // --- Random Seed ---
+  // Counter-based: the events do not depend on how a sample is split
+  std::shared_ptr<hepgen::CounterRndmEngine> rndm;
+  if (seed >= 0)
+    rndm = hepgen::installCounterRndm(pythia, seed);
+
+  // --- Shower Variations (UncertaintyBands weights) ---
+  if (!variationsCard.empty() && !pythia.readFile(variationsCard)) {
+    std::cerr << "Cannot read variations card " << variationsCard
+              << std::endl;
+    return 1;
+  }
+
   // --- Output Control ---
   pythia.readString("Next:numberShowInfo = 0");
   pythia.readString("Next:numberShowProcess = 0");
   pythia.readString("Next:numberShowEvent = 0");
   pythia.readString("Next:numberCount = 1000");
 
+  // --- Tabulated PDF (same set as PDF:pSet) ---
+  std::shared_ptr<hepgen::PdfTableStats> pdfStats;
+  if (pdfMode != hepgen::PdfTableMode::kOff) {
+    pdfStats = hepgen::installTabulatedPDF(pythia, pdfMode);
+    if (!pdfStats)
+      return 1;
+  }
+
   // =========================================================================
   // INITIALIZATION
   // =========================================================================
@@ -141,14 +275,71 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  // HepMC3 output
-  HepMC3::Pythia8ToHepMC3 toHepMC;
-  HepMC3::WriterAscii writer(outFile);
+  // Hard onium subprocess of every event, for LDME reweighting. The LDME
+  // sets add one weight each after the Pythia weights.
+  hepgen::OniumSubprocess onium;
+  onium.init(pythia);
+  std::vector<std::string> weightNames =
+      hepgen::PooledHepMC3Event::weightNames(pythia);
+  for (const auto &set : ldmeSets)
+    weightNames.push_back(set.first);
+
+  // HepMC3 output (pooled event, reused for every event)
+  hepgen::PooledHepMC3Event hepmcEvent;
+  std::unique_ptr<hepgen::HepMC3Output> writer;
+  std::unique_ptr<hepgen::EventIndexWriter> index; // outFile.idx
+  if (writeHepMC) {
+    writer = hepgen::openHepMC3Output(outFile, pooledHepMC);
+    if (!writer)
+      return 1;
+    index = hepgen::EventIndexWriter::open(outFile);
+    // Run metadata: weight names and filter configuration
+    writer->setWeightNames(weightNames);
+    writer->addRunAttribute("filter",
+                            filter.enabled() ? filter.describe() : "none");
+    writer->addRunAttribute("detector",
+                            detector ? detector->describe() : "none");
+  }
+
+  // Columnar particle output (final state + selected intermediates)
+  std::unique_ptr<hepgen::ColumnarWriter> columnar;
+  if (!columnarFile.empty()) {
+    columnar = std::make_unique<hepgen::ColumnarWriter>(columnarFile,
+                                                        columnarCompress);
+    if (!columnar->ok())
+      return 1;
+    if (!columnarPids.empty())
+      columnar->keepPids(columnarPids);
+  }
+
+  // Native analysis, fed the same events that are written
+  std::unique_ptr<hepgen::JpsiJetNativeAnalysis> native;
+  if (!nativeYoda.empty()) {
+    native = std::make_unique<hepgen::JpsiJetNativeAnalysis>();
+    if (!nativeConfigs.empty() && !native->readSelections(nativeConfigs))
+      return 1;
+    native->setWeightNames(weightNames);
+  }
 
   std::cout << "\n=== Prompt J/psi Generation ===" << std::endl;
   std::cout << "sqrt(s) = " << sqrtS << " GeV" << std::endl;
   std::cout << "Events: " << nEvents << std::endl;
-  std::cout << "Output: " << outFile << std::endl;
+  if (rndm)
+    std::cout << "Seed: " << seed << ", events " << firstEvent << " - "
+              << firstEvent + nEvents - 1 << std::endl;
+  std::cout << "Output: " << (writeHepMC ? outFile : "none") << std::endl;
+  if (native)
+    std::cout << "Native analysis: " << nativeYoda << " ("
+              << native->nSelections() << " jet selection(s), "
+              << native->nClusterings() << " clustering(s) per event)"
+              << std::endl;
+  if (filter.enabled())
+    std::cout << "Filter: " << filter.describe() << std::endl;
+  if (detector)
+    std::cout << "Detector: " << detector->describe() << std::endl;
+  if (weightNames.size() > 1)
+    std::cout << "Event weights: " << weightNames.size()
+              << " (nominal + shower variations + LDME sets)" << std::endl;
   std::cout << "================================\n" << std::endl;
 
   // =========================================================================
@@ -156,21 +347,63 @@ int main(int argc, char *argv[]) {
   // =========================================================================
 
   int nJpsi = 0;
+  long allocStart = hepgen::allocCount();
+  hepgen::PidIndex pidIndex;
 
   for (int iEvent = 0; iEvent < nEvents; ++iEvent) {
+    if (rndm)
+      rndm->setEvent(firstEvent + iEvent);
     if (!pythia.next())
       continue;
 
-    // Count J/psi in event
-    for (int i = 0; i < pythia.event.size(); ++i) {
-      if (pythia.event[i].id() == 443)
+    // Index the event by |PID| once for the counting and the filter
+    pidIndex.build(pythia.event);
+
+    // Count J/psi in event (each once, not every recoil copy)
+    for (int i : pidIndex.find(443))
+      if (pythia.event[i].iBotCopyId() == i)
         nJpsi++;
-    }
 
-    // Write to HepMC3
-    HepMC3::GenEvent hepmcEvent;
-    toHepMC.fill_next_event(pythia, &hepmcEvent);
-    writer.write_event(hepmcEvent);
+    // Acceptance filter: skip conversion of events the analysis would veto.
+    // Written events carry the running filter counters; the final totals,
+    // which include events rejected after the last accepted one, are written
+    // at close.
+    if (filter.accept(pythia.event, pidIndex)) {
+      // Detector-level final state for everything downstream
+      if (detector)
+        detector->apply(pythia.event, uint64_t(std::max(seed, 0)),
+                        uint64_t(firstEvent + iEvent));
+      hepmcEvent.fill(pythia);
+      if (rndm)
+        hepmcEvent.eventNumber = long(firstEvent + iEvent);
+      // Subprocess and colour state, so the sample can be reweighted to
+      // other LDMEs later (scripts/reweight_ldme.py)
+      if (onium.classify(pythia)) {
+        hepmcEvent.setAttribute("onium_code", onium.code);
+        hepmcEvent.setAttribute("onium_state", onium.state);
+        if (!onium.channelName().empty())
+          hepmcEvent.setAttribute("onium_channel", onium.channelName());
+        hepmcEvent.setAttribute("onium_ldme", onium.ldme);
+      }
+      for (const auto &set : ldmeSets)
+        hepmcEvent.weights.push_back(hepmcEvent.weights[0] *
+                                     onium.reweight(set.second));
+      if (writer) {
+        hepmcEvent.setAttribute("filter_ntried", filter.nTried);
+        hepmcEvent.setAttribute("filter_naccepted", filter.nAccepted);
+        writer->write(hepmcEvent);
+        if (index)
+          index->add(*writer, hepmcEvent, pythia);
+      }
+      if (native) {
+        native->analyze(pythia.event, hepmcEvent);
+        if (snapshotEvery > 0 && native->eventsAnalyzed() % snapshotEvery == 0)
+          native->write(nativeYoda);
+      }
+      if (columnar)
+        columnar->add(pythia.event, firstEvent + iEvent,
+                      hepmcEvent.weights[0]);
+    }
 
     if (iEvent % 1000 == 0) {
       std::cout << "Event " << iEvent << " / " << nEvents
@@ -183,10 +416,51 @@ int main(int argc, char *argv[]) {
   // =========================================================================
 
   pythia.stat();
+  if (pdfStats)
+    pdfStats->print(std::cout);
+  if (detector)
+    detector->print(std::cout);
 
   std::cout << "\n=== Generation Complete ===" << std::endl;
   std::cout << "Total J/psi produced: " << nJpsi << std::endl;
-  std::cout << "Output file: " << outFile << std::endl;
+  if (filter.enabled())
+    std::cout << "Filter accepted: " << filter.nAccepted << " / "
+              << filter.nTried << " (" << 100.0 * filter.acceptRate()
+              << "%)" << std::endl;
+  if (writer) {
+    if (filter.enabled()) {
+      writer->addTrailerAttribute("filter_ntried",
+                                  std::to_string(filter.nTried));
+      writer->addTrailerAttribute("filter_naccepted",
+                                  std::to_string(filter.nAccepted));
+    }
+    writer->close();
+    std::cout << "Output file: " << outFile << std::endl;
+    if (index) {
+      index->close(*writer);
+      std::cout << "Event index: " << index->path() << std::endl;
+    }
+    if (writer->failed())
+      return 1;
+  }
+  if (columnar) {
+    if (!columnar->close())
+      return 1;
+    std::cout << "Columnar output: " << columnar->path() << " ("
+              << columnar->eventsWritten() << " events, "
+              << columnar->bytesWritten() / 1e6 << " MB)" << std::endl;
+  }
+  if (native) {
+    if (!native->write(nativeYoda))
+      return 1;
+    std::cout << "Native analysis: " << native->eventsSelected() << " / "
+              << native->eventsAnalyzed() << " events with a J/psi jet -> "
+              << nativeYoda << std::endl;
+  }
+  if (allocStart >= 0 && nEvents > 0)
+    std::cout << "Allocations per event: "
+              << double(hepgen::allocCount() - allocStart) / nEvents
+              << std::endl;
 
   return 0;
 }
@@ -0,0 +1,59 @@
+// =============================================================================
+// check.h
+// -----------------------------------------------------------------------------
+// Minimal helpers for the round-trip tests in this directory: failed checks
+// are printed and counted, and main() returns the count, so ctest reports a
+// test as failed if any check failed.
+// =============================================================================
+
+#ifndef HEPGEN_TEST_CHECK_H
+#define HEPGEN_TEST_CHECK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace hepgen {
+namespace test {
+
+inline int &failures() {
+  static int n = 0;
+  return n;
+}
+
+inline bool check(bool ok, const std::string &what) {
+  if (!ok) {
+    ++failures();
+    std::cerr << "FAIL: " << what << std::endl;
+  }
+  return ok;
+}
+
+// Equal within a relative tolerance
+inline bool same(double a, double b, double rel = 1e-14) {
+  return a == b || std::abs(a - b) <= rel * std::max(std::abs(a), std::abs(b));
+}
+
+// Scratch file in the working directory (the test's build directory),
+// unique per process
+inline std::string scratchPath(const std::string &name) {
+  return "hepgen_test_" + std::to_string(::getpid()) + "_" + name;
+}
+
+// Exit status for main(): 0 if every check passed
+inline int summary(const char *test) {
+  if (failures() == 0)
+    std::cout << test << ": all checks passed" << std::endl;
+  else
+    std::cerr << test << ": " << failures() << " checks failed" << std::endl;
+  return failures() == 0 ? 0 : 1;
+}
+
+} // namespace test
+} // namespace hepgen
+
+#endif // HEPGEN_TEST_CHECK_H
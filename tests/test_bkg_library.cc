@@ -0,0 +1,115 @@
+// =============================================================================
+// test_bkg_library.cc
+// -----------------------------------------------------------------------------
+// Round trip of the background library of include/bkg_library.h: hand-made
+// events with odd and even final-state counts are written, mapped back and
+// overlaid, and the event table must be aligned for BkgEventRecord. A write
+// to a full device must make the writer fail.
+// =============================================================================
+
+#include "Pythia8/Pythia.h"
+
+#include "bkg_library.h"
+#include "check.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using hepgen::test::check;
+using hepgen::test::same;
+
+namespace {
+
+// System line, two beams and nFinal final-state pions, with momenta derived
+// from the event number so every event is distinguishable
+void makeEvent(int k, int nFinal, Pythia8::Event &ev) {
+  using Pythia8::Vec4;
+  ev.append(90, -11, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 0., 5020.), 5020.);
+  ev.append(2212, -12, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 2510., 2510.), 0.938);
+  ev.append(2212, -12, 0, 0, 0, 0, 0, 0, Vec4(0., 0., -2510., 2510.), 0.938);
+  for (int j = 0; j < nFinal; ++j) {
+    double px = 0.25 * (k + 1), py = -0.5 * (j + 1), pz = 1.5 * (j - k);
+    double e = 0.125 + std::abs(px) + std::abs(py) + std::abs(pz);
+    ev.append(j % 2 ? 211 : -211, 84, 1, 2, 0, 0, 0, 0, Vec4(px, py, pz, e),
+              0.13957);
+  }
+}
+
+void roundTrip() {
+  // Nine particles in total: 32 + 9 * 20 bytes is not a multiple of 8, so the
+  // table is only aligned with padding
+  const std::vector<int> nFinal = {3, 0, 4, 2};
+  const std::string path = hepgen::test::scratchPath("bkg.lib");
+  std::vector<Pythia8::Event> events(nFinal.size());
+  {
+    hepgen::BkgLibraryWriter writer(path);
+    if (!check(writer.ok(), "open " + path))
+      return;
+    for (size_t k = 0; k < events.size(); ++k) {
+      makeEvent(int(k), nFinal[k], events[k]);
+      check(writer.addEvent(events[k], 1.5 + k, 10 * int(k) + 1),
+            "add event " + std::to_string(k));
+    }
+    check(writer.close(), "close");
+  }
+
+  hepgen::BkgLibrary library(path);
+  if (!check(library.ok() && library.size() == events.size(),
+             "map library with " + std::to_string(events.size()) + " events"))
+    return;
+  uint64_t first = 0;
+  for (size_t k = 0; k < events.size(); ++k) {
+    std::string tag = "event " + std::to_string(k);
+    const hepgen::BkgEventRecord &rec = library.record(k);
+    check(reinterpret_cast<uintptr_t>(&rec) % alignof(hepgen::BkgEventRecord) ==
+              0,
+          tag + ": record alignment");
+    check(rec.firstParticle == first && rec.nParticles == uint32_t(nFinal[k]),
+          tag + ": particle range");
+    check(rec.b == float(1.5 + k) && rec.nColl == uint32_t(10 * k + 1),
+          tag + ": geometry");
+    first += rec.nParticles;
+
+    // Unrotated overlay reproduces the final-state particles
+    Pythia8::Event overlay;
+    int added = library.overlay(k, 0., overlay);
+    if (!check(added == nFinal[k] && overlay.size() == nFinal[k],
+               tag + ": overlay size"))
+      continue;
+    for (int j = 0; j < added; ++j) {
+      const Pythia8::Particle &in = events[k][3 + j];
+      const Pythia8::Particle &out = overlay[j];
+      check(out.id() == in.id() && out.status() == 201 &&
+                same(out.px(), float(in.px())) &&
+                same(out.py(), float(in.py())) &&
+                same(out.pz(), float(in.pz())) && same(out.e(), float(in.e())),
+            tag + ": particle " + std::to_string(j));
+    }
+  }
+  std::remove(path.c_str());
+}
+
+// Writes that do not reach the disk must be reported
+void fullDevice() {
+  std::FILE *probe = std::fopen("/dev/full", "wb");
+  if (!probe)
+    return;
+  std::fclose(probe);
+  hepgen::BkgLibraryWriter writer("/dev/full");
+  Pythia8::Event ev;
+  makeEvent(0, 5, ev);
+  for (int k = 0; k < 1000 && writer.ok(); ++k)
+    writer.addEvent(ev, 1., 1);
+  check(!writer.close(), "close on a full device fails");
+}
+
+} // namespace
+
+int main() {
+  roundTrip();
+  fullDevice();
+  return hepgen::test::summary("test_bkg_library");
+}
@@ -0,0 +1,152 @@
+// =============================================================================
+// test_cards.cc
+// -----------------------------------------------------------------------------
+// Write -> read round trips of the text cards: LDME cards (onium_ldme.h) and
+// acceptance-filter runcards (event_filter.h). Cards are written to scratch
+// files and read back, the cards shipped in runcards/ must parse, and a
+// filter's describe() output must read back into the same filter.
+// =============================================================================
+
+#include "Pythia8/Pythia.h"
+
+#include "check.h"
+#include "event_filter.h"
+#include "onium_ldme.h"
+#include "signal_selector.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using hepgen::test::check;
+
+namespace {
+
+const std::string kSourceDir = HEPGEN_SOURCE_DIR;
+
+std::string writeCard(const std::string &name, const std::string &text) {
+  std::string path = hepgen::test::scratchPath(name);
+  std::ofstream(path) << text;
+  return path;
+}
+
+bool ldmeIs(const hepgen::LdmeSet &set, int state, const std::string &channel,
+            double expected) {
+  double value = 0.;
+  return set.find(state, channel, value) && value == expected;
+}
+
+void ldmeCards() {
+  std::string path = writeCard("ldme.txt", "# header comment\n"
+                                           "\n"
+                                           "443    3S1(1)  1.16   # inline\n"
+                                           "443    3P0(8)  -0.00716\n"
+                                           "100443 3S1(8)  0.0050\n"
+                                           "100443 3S1(8)  0.0075\n"
+                                           "  20443 3P0(1) 5e-2\n");
+  hepgen::LdmeSet set;
+  check(set.readFile(path), "LDME card: read");
+  check(set.size() == 4, "LDME card: 4 distinct entries");
+  check(ldmeIs(set, 443, "3S1(1)", 1.16), "LDME card: 443 3S1(1)");
+  check(ldmeIs(set, 443, "3P0(8)", -0.00716), "LDME card: negative value");
+  check(ldmeIs(set, 100443, "3S1(8)", 0.0075), "LDME card: last entry wins");
+  check(ldmeIs(set, 20443, "3P0(1)", 0.05), "LDME card: leading blanks");
+  double value = 0.;
+  check(!set.find(443, "1S0(8)", value), "LDME card: missing channel");
+  check(!set.find(10441, "3P0(1)", value), "LDME card: missing state");
+  std::remove(path.c_str());
+
+  path = writeCard("ldme_bad.txt", "443 3S1(1) 1.16\n443 3S1(8)\n");
+  hepgen::LdmeSet bad;
+  check(!bad.readFile(path), "LDME card: line without value is rejected");
+  std::remove(path.c_str());
+  check(!bad.readFile(hepgen::test::scratchPath("missing.txt")),
+        "LDME card: missing file is rejected");
+
+  for (const char *card : {"pythia_default", "chao2012",
+                           "butenschoen_kniehl2011"}) {
+    hepgen::LdmeSet shipped;
+    std::string name = std::string("runcards/ldme/") + card + ".txt";
+    check(shipped.readFile(kSourceDir + "/" + name) && shipped.size() > 0 &&
+              shipped.find(443, "3S1(8)", value),
+          name + " parses");
+  }
+}
+
+// One J/psi at pT = pT, y = 0, plus a soft pion
+void makeJpsiEvent(double pT, Pythia8::Event &ev) {
+  using Pythia8::Vec4;
+  ev.append(90, -11, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 0., 13600.), 13600.);
+  double m = 3.0969, eT = std::sqrt(m * m + pT * pT);
+  ev.append(443, 2, 0, 0, 0, 0, 0, 0, Vec4(pT, 0., 0., eT), m);
+  ev.append(211, 1, 0, 0, 0, 0, 0, 0, Vec4(0.3, 0.2, 1.0, 1.07), 0.13957);
+}
+
+void filterCards() {
+  std::string path = writeCard("filter.cmnd",
+                               "! filter for the round trip\n"
+                               "Filter:pids         = 443, -100443\n"
+                               "Filter:pTMin        = 6.5   ! GeV\n"
+                               "filter:PTMAX        = 30.\n"
+                               "Filter:etaMax       = 2.4   # comment\n"
+                               "nMin = 1\n"
+                               "Filter:nMax         = 2\n"
+                               "Filter:jetR         = 0.6\n"
+                               "Filter:jetEtaMax    = 4.5\n"
+                               "\n");
+  hepgen::EventFilter filter;
+  check(!filter.enabled(), "filter: disabled before reading");
+  check(filter.readFile(path), "filter card: read");
+  std::remove(path.c_str());
+  check(filter.enabled(), "filter card: enabled");
+  check(filter.absPids == std::vector<int>({443, 100443}), "filter card: pids");
+  check(filter.pTMin == 6.5 && filter.pTMax == 30. && filter.etaMax == 2.4,
+        "filter card: kinematic window");
+  check(filter.nMin == 1 && filter.nMax == 2, "filter card: multiplicity");
+  check(filter.leadJetPTMin == 0. && filter.jetR == 0.6 &&
+            filter.jetEtaMax == 4.5,
+        "filter card: jet settings");
+
+  // describe() is "key=value ...", which reads back into the same filter
+  hepgen::EventFilter copy;
+  std::istringstream is(filter.describe());
+  std::string token;
+  bool ok = true;
+  while (is >> token)
+    ok = copy.readString(token) && ok;
+  check(ok && copy.describe() == filter.describe(),
+        "filter: describe() reads back, got '" + copy.describe() + "'");
+
+  check(!copy.readString("Filter:pTmn = 3"), "filter: unknown key rejected");
+  check(copy.readString("   ! only a comment"), "filter: comment line");
+
+  hepgen::EventFilter shipped;
+  check(shipped.readFile(kSourceDir + "/runcards/jpsijet_filter.cmnd") &&
+            shipped.absPids == std::vector<int>({443}) &&
+            shipped.pTMin == 6.5 && shipped.leadJetPTMin == 0.,
+        "runcards/jpsijet_filter.cmnd parses");
+
+  // The card read back selects as configured, with or without a PID index
+  hepgen::PidIndex index;
+  for (double pT : {5., 10., 40.}) {
+    Pythia8::Event ev;
+    makeJpsiEvent(pT, ev);
+    index.build(ev);
+    bool expected = pT > 6.5 && pT < 30.;
+    std::string what = "filter: J/psi with pT " + std::to_string(pT);
+    check(filter.accept(ev) == expected, what);
+    check(filter.accept(ev, index) == expected, what + " (PID index)");
+  }
+  check(filter.nTried == 6 && filter.nAccepted == 2, "filter: counters");
+}
+
+} // namespace
+
+int main() {
+  ldmeCards();
+  filterCards();
+  return hepgen::test::summary("test_cards");
+}
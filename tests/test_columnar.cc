@@ -0,0 +1,166 @@
+// =============================================================================
+// test_columnar.cc
+// -----------------------------------------------------------------------------
+// Write side of the columnar output round trip (columnar_writer.h): writes
+// hand-made events in small batches, uncompressed, compressed and with a
+// reduced PID list, together with the values a reader must get back. The
+// files are read with scripts/columnar.py by test_columnar.py. Writing to a
+// full device must make close() fail.
+//
+// Usage: test_columnar <prefix>
+//   writes <prefix>raw.col, <prefix>deflate.col, <prefix>jpsi.col and the
+//   expected values as <prefix><name>.txt:
+//     event <number> <weight>
+//     p <pid> <status> <mother> <px> <py> <pz> <e>   (per stored particle)
+// =============================================================================
+
+#include "Pythia8/Pythia.h"
+
+#include "check.h"
+#include "columnar_writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+using hepgen::test::check;
+
+namespace {
+
+// gg -> c cbar; c -> J/psi (two copies) -> mu+ mu-, pi+; cbar -> D*+ ->
+// (D0 -> K- pi+) pi+; plus a photon without mothers. Stored mothers by hand:
+// with the default PIDs the D*+ and D0 are kept, with {443} only they are
+// skipped and their products lose their stored ancestor.
+struct Entry {
+  int id, status, m1, m2, d1, d2;
+  double px, py, pz, e, m;
+  int motherAll;  // stored mother index, default PIDs; -2 = not stored
+  int motherJpsi; // the same, keepPids({443})
+};
+
+const std::vector<Entry> kTemplate = {
+    {90, -11, 0, 0, 0, 0, 0., 0., 0., 13600., 13600., -2, -2},
+    {2212, -12, 0, 0, 3, 0, 0., 0., 6800., 6800., 0.938, -2, -2},
+    {2212, -12, 0, 0, 4, 0, 0., 0., -6800., 6800., 0.938, -2, -2},
+    {21, -21, 1, 0, 5, 6, 0., 0., 120.5, 120.5, 0., -2, -2},
+    {21, -21, 2, 0, 5, 6, 0., 0., -30.25, 30.25, 0., -2, -2},
+    {4, -23, 3, 4, 7, 0, 12.5, -3.25, 60.1, 62.2, 1.5, -2, -2},
+    {-4, -23, 3, 4, 12, 0, -12.5, 3.25, 30.15, 33.2, 1.5, -2, -2},
+    {443, -83, 5, 6, 8, 8, 5.125, 1.0625, 40., 40.8, 3.0969, -2, -2},
+    {443, -91, 7, 0, 9, 10, 5.125, 1.0625, 40., 40.8, 3.0969, -1, -1},
+    {-13, 91, 8, 0, 0, 0, 2.5, 0.5, 20., 20.2, 0.10566, 0, 0},
+    {13, 91, 8, 0, 0, 0, 2.625, 0.5625, 20., 20.6, 0.10566, 0, 0},
+    {211, 84, 5, 6, 0, 0, -5.125, -1.0625, 50.25, 54.6, 0.13957, -1, -1},
+    {413, -83, 6, 0, 13, 14, -7.5, 2., 20., 21.6, 2.0103, -1, -2},
+    {421, -91, 12, 0, 15, 16, -7., 1.875, 18.5, 20., 1.8648, 4, -2},
+    {211, 91, 12, 0, 0, 0, -0.5, 0.125, 1.5, 1.6, 0.13957, 4, -1},
+    {-321, 91, 13, 0, 0, 0, -4., 1., 10., 10.8, 0.49368, 5, -1},
+    {211, 91, 13, 0, 0, 0, -3., 0.875, 8.5, 9.1, 0.13957, 5, -1},
+    {22, 1, 0, 0, 0, 0, 1e-3, 2e-3, 3e-3, 1.5e-2, 0., -1, -1}};
+
+// Event k: the template with momenta scaled by 1 + k / 2, except event 3,
+// which has the system line only and so stores no particles
+void makeEvent(int k, Pythia8::Event &ev) {
+  double f = 1. + 0.5 * k;
+  for (const Entry &p : kTemplate) {
+    if (k == 3 && ev.size() > 0)
+      break;
+    ev.append(p.id, p.status, p.m1, p.m2, p.d1, p.d2, 0, 0,
+              Pythia8::Vec4(f * p.px, f * p.py, f * p.pz, f * p.e), p.m);
+  }
+}
+
+const int kEvents = 5;
+int64_t eventNumber(int k) { return 500 + k; }
+double eventWeight(int k) { return 0.5 * k - 0.75; }
+
+void writeExpected(const std::string &path, bool jpsiOnly) {
+  std::FILE *out = std::fopen(path.c_str(), "w");
+  if (!check(out != nullptr, "open " + path))
+    return;
+  for (int k = 0; k < kEvents; ++k) {
+    std::fprintf(out, "event %lld %.17g\n", (long long)eventNumber(k),
+                 eventWeight(k));
+    double f = 1. + 0.5 * k;
+    for (const Entry &p : kTemplate) {
+      int mother = jpsiOnly ? p.motherJpsi : p.motherAll;
+      if (k == 3 || mother == -2)
+        continue;
+      std::fprintf(out, "p %d %d %d %.9g %.9g %.9g %.9g\n", p.id, p.status,
+                   mother, float(f * p.px), float(f * p.py), float(f * p.pz),
+                   float(f * p.e));
+    }
+  }
+  std::fclose(out);
+}
+
+void writeFile(const std::string &prefix, const std::string &name,
+               bool compress, bool jpsiOnly) {
+  const std::string path = prefix + name + ".col";
+  uint64_t nParticles = 0;
+  {
+    hepgen::ColumnarWriter writer(path, compress, 2);
+    if (!check(writer.ok(), "open " + path))
+      return;
+    if (jpsiOnly)
+      writer.keepPids({443});
+    for (int k = 0; k < kEvents; ++k) {
+      Pythia8::Event ev;
+      makeEvent(k, ev);
+      writer.add(ev, eventNumber(k), eventWeight(k));
+    }
+    check(writer.close(), name + ": close");
+    check(writer.eventsWritten() == uint64_t(kEvents), name + ": events");
+    struct stat st;
+    check(::stat(path.c_str(), &st) == 0 &&
+              uint64_t(st.st_size) ==
+                  writer.bytesWritten() + 3 * sizeof(hepgen::ColumnarBatch) +
+                      30 * sizeof(hepgen::ColumnarChunk),
+          name + ": file size");
+  }
+  for (const Entry &p : kTemplate)
+    nParticles += (jpsiOnly ? p.motherJpsi : p.motherAll) != -2;
+  nParticles *= kEvents - 1;
+
+  // The header is finalized: three batches of at most two events
+  hepgen::ColumnarHeader header = {};
+  std::FILE *in = std::fopen(path.c_str(), "rb");
+  check(in && std::fread(&header, sizeof(header), 1, in) == 1,
+        name + ": read header");
+  if (in)
+    std::fclose(in);
+  check(header.nEvents == uint64_t(kEvents) &&
+            header.nParticles == nParticles && header.nBatches == 3 &&
+            header.footerOffset > 0 && header.footerOffset % 64 == 0,
+        name + ": header");
+
+  writeExpected(prefix + name + ".txt", jpsiOnly);
+}
+
+// Writes that do not reach the disk must make close() fail
+void fullDevice() {
+  std::FILE *probe = std::fopen("/dev/full", "wb");
+  if (!probe)
+    return;
+  std::fclose(probe);
+  hepgen::ColumnarWriter writer("/dev/full", false, 2);
+  for (int k = 0; k < 1000 && writer.ok(); ++k) {
+    Pythia8::Event ev;
+    makeEvent(k % kEvents, ev);
+    writer.add(ev, eventNumber(k), eventWeight(k));
+  }
+  check(!writer.close(), "close on a full device fails");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const std::string prefix = argc > 1 ? argv[1] : "columnar_";
+  writeFile(prefix, "raw", false, false);
+  writeFile(prefix, "deflate", true, false);
+  writeFile(prefix, "jpsi", false, true);
+  fullDevice();
+  return hepgen::test::summary("test_columnar");
+}
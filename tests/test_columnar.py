@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Read side of the columnar output round trip.
+
+    test_columnar.py <prefix>
+
+Reads the files test_columnar wrote under <prefix> with scripts/columnar.py
+and compares them, batch by batch and concatenated, with the expected
+values written next to them. Exits 77 (skipped) without numpy.
+"""
+
+import os
+import subprocess
+import sys
+
+SCRIPTS = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       os.pardir, "scripts")
+sys.path.insert(0, SCRIPTS)
+
+try:
+    import numpy as np
+    from columnar import ColumnarFile, CODEC_SHUFFLE_DEFLATE
+except ImportError as e:
+    print(f"skipped: {e}")
+    sys.exit(77)
+
+PARTICLE_COLUMNS = ("pid", "status", "mother", "px", "py", "pz", "e")
+MOMENTUM = ("px", "py", "pz", "e")
+failures = 0
+
+
+def check(ok, what):
+    global failures
+    if not ok:
+        failures += 1
+        print(f"FAIL: {what}", file=sys.stderr)
+    return ok
+
+
+def read_expected(path):
+    """Events as (number, weight, {column: list}) from the expected file."""
+    events = []
+    with open(path) as f:
+        for line in f:
+            tokens = line.split()
+            if tokens[0] == "event":
+                events.append((int(tokens[1]), float(tokens[2]),
+                               {c: [] for c in PARTICLE_COLUMNS}))
+            else:
+                columns = events[-1][2]
+                for c, value in zip(PARTICLE_COLUMNS, tokens[1:]):
+                    columns[c].append(float(value) if c in MOMENTUM
+                                      else int(value))
+    return events
+
+
+def compare(name, got, expected, dtype):
+    return check(got.dtype == np.dtype(dtype) and
+                 np.array_equal(got, np.array(expected, dtype=dtype)),
+                 f"{name}: got {got.tolist()}, expected {expected}")
+
+
+def round_trip(prefix, name, compressed):
+    path = prefix + name + ".col"
+    events = read_expected(prefix + name + ".txt")
+    f = ColumnarFile(path)
+    dtypes = {c: dt for c, dt, _ in f.columns}
+    check(f.names == ["event", "weight", "offsets", "pid", "px", "py", "pz",
+                      "e", "status", "mother"], f"{name}: columns")
+    n_particles = sum(len(e[2]["pid"]) for e in events)
+    check(f.n_events == len(events) and f.n_particles == n_particles,
+          f"{name}: {f.n_events} events, {f.n_particles} particles")
+    codecs = {c[3] for c in f._chunks}
+    check((CODEC_SHUFFLE_DEFLATE in codecs) == compressed,
+          f"{name}: chunk codecs {sorted(codecs)}")
+
+    # Batch by batch, with offsets local to the batch
+    first = 0
+    for i, b in enumerate(f.batches()):
+        tag = f"{name} batch {i}"
+        part = events[first:first + len(b["event"])]
+        first += len(b["event"])
+        compare(f"{tag} event", b["event"], [e[0] for e in part], "<i8")
+        compare(f"{tag} weight", b["weight"], [e[1] for e in part], "<f8")
+        counts = [len(e[2]["pid"]) for e in part]
+        compare(f"{tag} offsets", b["offsets"],
+                [0] + list(np.cumsum(counts)), "<i4")
+        for c in PARTICLE_COLUMNS:
+            compare(f"{tag} {c}", b[c],
+                    [v for e in part for v in e[2][c]], dtypes[c])
+    check(first == len(events), f"{name}: batches cover all events")
+    del b  # views into the mapped file must go before close()
+
+    # Whole file: global int64 offsets over the concatenated columns
+    counts = [len(e[2]["pid"]) for e in events]
+    compare(f"{name} column offsets", f.column("offsets"),
+            [0] + list(np.cumsum(counts)), "<i8")
+    for c in PARTICLE_COLUMNS:
+        compare(f"{name} column {c}", f.column(c),
+                [v for e in events for v in e[2][c]], dtypes[c])
+    f.close()
+
+    # The command-line reader accepts the file too
+    npz = prefix + name + ".npz"
+    run = subprocess.run([sys.executable, os.path.join(SCRIPTS, "columnar.py"),
+                          "npz", path, "-o", npz], capture_output=True)
+    if check(run.returncode == 0, f"{name}: columnar.py npz"):
+        with np.load(npz) as data:
+            check(np.array_equal(data["pid"],
+                                 [v for e in events for v in e[2]["pid"]]),
+                  f"{name}: npz pid column")
+        os.remove(npz)
+    for suffix in (".col", ".txt"):
+        os.remove(prefix + name + suffix)
+
+
+def main():
+    prefix = sys.argv[1] if len(sys.argv) > 1 else "columnar_"
+    round_trip(prefix, "raw", False)
+    round_trip(prefix, "deflate", True)
+    round_trip(prefix, "jpsi", False)
+    if failures:
+        print(f"test_columnar.py: {failures} checks failed", file=sys.stderr)
+        return 1
+    print("test_columnar.py: all checks passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
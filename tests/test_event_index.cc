@@ -0,0 +1,191 @@
+// =============================================================================
+// test_event_index.cc
+// -----------------------------------------------------------------------------
+// Round trip of the sidecar event index (event_index.h, event_index_writer.h):
+// hand-made events are written through both HepMC3 writers with an index,
+// which is then mapped back. Every record, including the first one after
+// the run information, must point at its own "E" line and carry the summary
+// fields of its event; final counters must follow the end-of-listing line,
+// a changed HepMC3 file must no longer match, and an unfinished index must be
+// read up to its last whole record.
+// =============================================================================
+
+#include "Pythia8/Pythia.h"
+
+#include "check.h"
+#include "event_index.h"
+#include "event_index_writer.h"
+#include "hepmc3_pool.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using hepgen::test::check;
+using hepgen::test::same;
+
+namespace {
+
+struct Expected {
+  long eventNumber;
+  double weight;
+  double leadingJetPt;
+  unsigned nJpsi, nDstar;
+};
+
+// k = 0: J/psi (top and bottom copy) -> mu+ mu-, D*+ -> D0 pi+ and a pair
+//        of back-to-back 40 GeV pions, the leading jets
+// k = 1: soft pions only, no jet above 5 GeV
+// k = 2: two J/psi and a 12 GeV pion
+void makeEvent(int k, Pythia8::Event &ev) {
+  using Pythia8::Vec4;
+  ev.append(90, -11, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 0., 13600.), 13600.);
+  ev.append(2212, -12, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 6800., 6800.), 0.938);
+  ev.append(2212, -12, 0, 0, 0, 0, 0, 0, Vec4(0., 0., -6800., 6800.), 0.938);
+  auto pion = [&ev](double px, double py, double pz) {
+    double e = std::sqrt(px * px + py * py + pz * pz + 0.13957 * 0.13957);
+    ev.append(211, 84, 1, 2, 0, 0, 0, 0, Vec4(px, py, pz, e), 0.13957);
+  };
+  if (k == 0) {
+    ev.append(443, -62, 1, 2, 4, 4, 0, 0, Vec4(0., 2., 1., 3.84), 3.0969);
+    ev.append(443, -91, 3, 3, 5, 6, 0, 0, Vec4(0., 2., 1., 3.84), 3.0969);
+    ev.append(-13, 91, 4, 0, 0, 0, 0, 0, Vec4(0.5, 1., 0.5, 1.22), 0.10566);
+    ev.append(13, 91, 4, 0, 0, 0, 0, 0, Vec4(-0.5, 1., 0.5, 2.62), 0.10566);
+    ev.append(413, -91, 1, 2, 8, 9, 0, 0, Vec4(0., -2., 0., 2.83), 2.0103);
+    ev.append(421, 91, 7, 0, 0, 0, 0, 0, Vec4(0., -1.9, 0., 2.68), 1.8648);
+    ev.append(211, 91, 7, 0, 0, 0, 0, 0, Vec4(0., -0.1, 0., 0.17), 0.13957);
+    pion(40., 0., 0.);
+    pion(-40., 0., 0.);
+  } else if (k == 1) {
+    pion(0.5, 0.2, 3.);
+    pion(-0.3, 0.4, -2.);
+  } else {
+    ev.append(443, 2, 1, 2, 0, 0, 0, 0, Vec4(1., 0., 0., 3.25), 3.0969);
+    ev.append(443, 2, 1, 2, 0, 0, 0, 0, Vec4(-1., 0., 0., 3.25), 3.0969);
+    pion(0., 12., 0.);
+  }
+}
+
+const std::vector<Expected> kExpected = {
+    {7000, 1.5, 40., 1, 1}, {7001, 0.25, 0., 0, 0}, {7002, -2., 12., 2, 0}};
+
+std::string readAll(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &path, const std::string &data) {
+  std::ofstream(path, std::ios::binary) << data;
+}
+
+void roundTrip(bool pooledWriter) {
+  const std::string tag = pooledWriter ? "PooledHepMC3Writer"
+                                       : "HepMC3AsciiWriter";
+  const std::string path =
+      hepgen::test::scratchPath(pooledWriter ? "pooled.hepmc3" : "ascii.hepmc3");
+  const std::string indexPath = hepgen::eventIndexPath(path);
+
+  // Default xmldoc, no banner; the event record needs the particle data for
+  // the visible-particle selection of the jet finder
+  Pythia8::Pythia pythia("../share/Pythia8/xmldoc", false);
+  {
+    auto out = hepgen::openHepMC3Output(path, pooledWriter);
+    if (!check(out != nullptr, tag + ": open " + path))
+      return;
+    // Run information as the generators set it: written ahead of event 0,
+    // which must still be indexed from its "E" line
+    out->setWeightNames({"Weight"});
+    out->addRunAttribute("filter", "pids=443 pTMin=6.5");
+    out->addRunAttribute("detector", "none");
+    auto index = hepgen::EventIndexWriter::open(path);
+    if (!check(index != nullptr && index->path() == indexPath,
+               tag + ": open index"))
+      return;
+    pythia.event.init("(complete event)", &pythia.particleData);
+    hepgen::PooledHepMC3Event evt;
+    for (size_t k = 0; k < kExpected.size(); ++k) {
+      pythia.event.clear();
+      makeEvent(int(k), pythia.event);
+      evt.fillRecord(pythia.event);
+      evt.eventNumber = kExpected[k].eventNumber;
+      evt.weights = {kExpected[k].weight};
+      out->write(evt);
+      index->add(*out, evt, pythia);
+    }
+    out->addTrailerAttribute("filter_ntried", "7");
+    out->addTrailerAttribute("filter_naccepted", "3");
+    out->close();
+    index->close(*out);
+  }
+
+  const std::string text = readAll(path);
+  const std::string tail = "HepMC::Asciiv3-END_EVENT_LISTING\n\n"
+                           "A filter_ntried 7\nA filter_naccepted 3\n";
+  check(text.size() >= tail.size() &&
+            text.compare(text.size() - tail.size(), tail.size(), tail) == 0,
+        tag + ": trailer after the end of the listing");
+  {
+    hepgen::EventIndex index(indexPath);
+    if (!check(index.ok() && index.complete() &&
+                   index.size() == kExpected.size(),
+               tag + ": index with " + std::to_string(kExpected.size()) +
+                   " events"))
+      return;
+    check(index.matches(path), tag + ": index matches its file");
+    for (size_t k = 0; k < index.size(); ++k) {
+      const hepgen::EventIndexRecord &rec = index.record(k);
+      const Expected &exp = kExpected[k];
+      std::string ev = tag + ": record " + std::to_string(k);
+      std::string head = "E " + std::to_string(exp.eventNumber) + " ";
+      check(rec.length > 0 && rec.offset + rec.length <= text.size() &&
+                text.compare(rec.offset, head.size(), head) == 0,
+            ev + " byte range");
+      if (k + 1 < index.size())
+        check(rec.offset + rec.length == index.record(k + 1).offset,
+              ev + " ends where the next event starts");
+      check(rec.eventNumber == exp.eventNumber && rec.weight == exp.weight,
+            ev + " event number and weight");
+      check(rec.nJpsi == exp.nJpsi && rec.nDstar == exp.nDstar,
+            ev + " J/psi and D* counts");
+      check(same(rec.leadingJetPt, exp.leadingJetPt, 1e-3),
+            ev + " leading jet pT " + std::to_string(rec.leadingJetPt));
+      check(rec.b == -1.f, ev + " no impact parameter for pp");
+    }
+  }
+
+  // An index written before the file changed no longer matches it
+  writeFile(path, text + "\n");
+  {
+    hepgen::EventIndex index(indexPath);
+    check(index.ok() && !index.matches(path), tag + ": stale index detected");
+  }
+
+  // Unfinished index (nEvents still 0, last record cut): whole records only
+  std::string data = readAll(indexPath);
+  const size_t nEventsAt = offsetof(hepgen::EventIndexHeader, nEvents);
+  data.replace(nEventsAt, sizeof(uint64_t), sizeof(uint64_t), '\0');
+  data.resize(data.size() - sizeof(hepgen::EventIndexRecord) / 2);
+  writeFile(indexPath, data);
+  {
+    hepgen::EventIndex index(indexPath);
+    check(index.ok() && !index.complete() &&
+              index.size() == kExpected.size() - 1 && index.matches(path),
+          tag + ": unfinished index");
+  }
+
+  std::remove(path.c_str());
+  std::remove(indexPath.c_str());
+}
+
+} // namespace
+
+int main() {
+  roundTrip(false);
+  roundTrip(true);
+  return hepgen::test::summary("test_event_index");
+}
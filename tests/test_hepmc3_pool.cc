@@ -0,0 +1,270 @@
+// =============================================================================
+// test_hepmc3_pool.cc
+// -----------------------------------------------------------------------------
+// Round trip of the HepMC3 outputs of include/hepmc3_pool.h: hand-made Pythia
+// event records are converted to pooled events and written through both
+// HepMC3Output implementations, read back with HepMC3::ReaderAscii, and
+// compared with the GenEvents toGenEvent() builds from the same pooled
+// events: particles, production vertices, weights, event and run attributes,
+// and the byte offsets the event index uses. Writing to a full device must
+// make both outputs fail.
+// =============================================================================
+
+#include "Pythia8/Pythia.h"
+
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenParticle.h"
+#include "HepMC3/GenRunInfo.h"
+#include "HepMC3/GenVertex.h"
+#include "HepMC3/ReaderAscii.h"
+
+#include "check.h"
+#include "hepmc3_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using hepgen::test::check;
+using hepgen::test::same;
+
+namespace {
+
+const std::vector<std::string> kWeightNames = {"Weight", "fsr:muRfac=2.0",
+                                               "fsr:muRfac=0.5"};
+
+// gg -> c cbar -> J/psi (-> mu+ mu-, displaced) + pi+, plus a photon with a
+// production point but no mothers. Covers vertices with several incoming
+// particles, with one incoming particle (implicit in Asciiv3), with a
+// position, and with a position but no incoming particle.
+void makeCharmonium(Pythia8::Event &ev) {
+  using Pythia8::Vec4;
+  ev.append(90, -11, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 0., 13600.), 13600.);
+  ev.append(2212, -12, 0, 0, 3, 0, 0, 0, Vec4(0., 0., 6800., 6800.), 0.938);
+  ev.append(2212, -12, 0, 0, 4, 0, 0, 0, Vec4(0., 0., -6800., 6800.), 0.938);
+  ev.append(21, -21, 1, 0, 5, 6, 101, 102, Vec4(0., 0., 120.5, 120.5), 0.);
+  ev.append(21, -21, 2, 0, 5, 6, 102, 101, Vec4(0., 0., -30.25, 30.25), 0.);
+  ev.append(4, -23, 3, 4, 7, 0, 101, 0, Vec4(12.5, -3.25, 60.1, 62.2), 1.5);
+  ev.append(-4, -23, 3, 4, 7, 0, 0, 101, Vec4(-12.5, 3.25, 30.15, 33.2), 1.5);
+  ev.append(443, -83, 5, 6, 8, 9, 0, 0, Vec4(5.125, 1.0625, 40.0, 40.8),
+            3.0969);
+  ev.append(-13, 91, 7, 0, 0, 0, 0, 0, Vec4(2.5, 0.5, 20.0, 20.2), 0.10566);
+  ev.append(13, 91, 7, 0, 0, 0, 0, 0, Vec4(2.625, 0.5625, 20.0, 20.6),
+            0.10566);
+  ev.append(211, 84, 5, 6, 0, 0, 0, 0, Vec4(-5.125, -1.0625, 50.25, 54.6),
+            0.13957);
+  ev.append(22, 1, 0, 0, 0, 0, 0, 0, Vec4(1e-3, 2e-3, 3e-3, 1.5e-2), 0.);
+  for (int i : {8, 9})
+    ev[i].vProd(0.0125, -0.025, 0.375, 0.4375);
+  ev[11].vProd(1.0, 2.0, 3.0, 4.0);
+}
+
+// q qbar -> Z -> mu+ mu-: smaller than the first, so buffers reused from
+// the first event must not leak into it
+void makeDrellYan(Pythia8::Event &ev) {
+  using Pythia8::Vec4;
+  ev.append(90, -11, 0, 0, 0, 0, 0, 0, Vec4(0., 0., 0., 13600.), 13600.);
+  ev.append(2, -21, 0, 0, 3, 0, 101, 0, Vec4(0., 0., 80., 80.), 0.);
+  ev.append(-2, -21, 0, 0, 3, 0, 0, 101, Vec4(0., 0., -26., 26.), 0.);
+  ev.append(23, -22, 1, 2, 4, 5, 0, 0, Vec4(0., 0., 54., 106.), 91.1876);
+  ev.append(-13, 1, 3, 3, 0, 0, 0, 0, Vec4(40.5, 10.25, 30., 51.4),
+            0.10566);
+  ev.append(13, 1, 3, 3, 0, 0, 0, 0, Vec4(-40.5, -10.25, 24., 54.6),
+            0.10566);
+}
+
+std::vector<hepgen::PooledHepMC3Event> makeEvents() {
+  std::vector<hepgen::PooledHepMC3Event> events(3);
+  for (size_t k = 0; k < events.size(); ++k) {
+    Pythia8::Event record;
+    if (k == 1)
+      makeDrellYan(record);
+    else
+      makeCharmonium(record);
+    hepgen::PooledHepMC3Event &evt = events[k];
+    evt.fillRecord(record);
+    evt.eventNumber = 1000 + long(k);
+    evt.weights = {1.5 + k, 1.25 / 3., -0.1};
+    evt.setAttribute("GenCrossSection", "1.23456789e+03 4.56700000e+00 10 20");
+    evt.setAttribute("signal_process_id", 201 + int(k));
+    evt.setAttribute("event_scale", 91.1876 / 7.);
+    evt.setAttribute("onium_channel", "3S1(8) with spaces");
+    evt.setAttribute("filter_ntried", 123456789012L);
+  }
+  return events;
+}
+
+// Whitespace-separated tokens of got start with those of expected; numbers
+// compare within the 9 digits of %.8e (GenCrossSection is re-formatted by
+// HepMC3 and gets one cross section per weight appended)
+bool sameTokens(const std::string &expected, const std::string &got) {
+  std::istringstream se(expected), sg(got);
+  std::vector<std::string> te{std::istream_iterator<std::string>(se), {}};
+  std::vector<std::string> tg{std::istream_iterator<std::string>(sg), {}};
+  if (tg.size() < te.size())
+    return false;
+  for (size_t i = 0; i < te.size(); ++i) {
+    char *endE = nullptr, *endG = nullptr;
+    double e = std::strtod(te[i].c_str(), &endE);
+    double g = std::strtod(tg[i].c_str(), &endG);
+    bool numbers = *endE == '\0' && *endG == '\0';
+    if (numbers ? !same(e, g, 1e-8) : te[i] != tg[i])
+      return false;
+  }
+  return true;
+}
+
+// Ids of the incoming particles of a particle's production vertex, sorted;
+// the root vertex and no vertex both give an empty list
+std::vector<int> parents(const HepMC3::ConstGenParticlePtr &p) {
+  std::vector<int> ids;
+  if (auto v = p->production_vertex())
+    for (const auto &in : v->particles_in())
+      ids.push_back(in->id());
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+HepMC3::FourVector position(const HepMC3::ConstGenParticlePtr &p) {
+  auto v = p->production_vertex();
+  return v ? v->position() : HepMC3::FourVector();
+}
+
+bool sameVector(const HepMC3::FourVector &a, const HepMC3::FourVector &b) {
+  return same(a.px(), b.px()) && same(a.py(), b.py()) &&
+         same(a.pz(), b.pz()) && same(a.e(), b.e());
+}
+
+void compare(const hepgen::PooledHepMC3Event &pooled,
+             const HepMC3::GenEvent &expected, const HepMC3::GenEvent &read,
+             const std::string &tag) {
+  std::string ev = tag + " event " + std::to_string(pooled.eventNumber);
+  check(read.event_number() == expected.event_number(), ev + ": number");
+  check(read.momentum_unit() == HepMC3::Units::GEV &&
+            read.length_unit() == HepMC3::Units::MM,
+        ev + ": units");
+  check(read.weights() == expected.weights(), ev + ": weights");
+
+  const auto &pe = expected.particles();
+  const auto &pr = read.particles();
+  if (!check(pr.size() == pe.size() && pe.size() == pooled.nParticles(),
+             ev + ": particle count"))
+    return;
+  check(read.vertices().size() == expected.vertices().size(),
+        ev + ": vertex count");
+  for (size_t i = 0; i < pe.size(); ++i) {
+    std::string p = ev + ": particle " + std::to_string(i + 1);
+    check(pr[i]->id() == pe[i]->id() && pe[i]->id() == int(i + 1), p + " id");
+    check(pr[i]->pid() == pe[i]->pid(), p + " pid");
+    check(pr[i]->status() == pe[i]->status(), p + " status");
+    check(sameVector(pr[i]->momentum(), pe[i]->momentum()), p + " momentum");
+    check(same(pr[i]->generated_mass(), pe[i]->generated_mass()), p + " mass");
+    check(parents(pr[i]) == parents(pe[i]), p + " production vertex");
+    check(sameVector(position(pr[i]), position(pe[i])), p + " position");
+  }
+
+  for (size_t a = 0; a < pooled.nAttributes(); ++a) {
+    const std::string &name = pooled.attributeName(a);
+    check(sameTokens(pooled.attributeValue(a), read.attribute_as_string(name)),
+          ev + ": attribute " + name + " '" + read.attribute_as_string(name) +
+              "', expected '" + pooled.attributeValue(a) + "'");
+  }
+}
+
+void roundTrip(bool pooledWriter) {
+  const std::string tag = pooledWriter ? "PooledHepMC3Writer"
+                                       : "HepMC3AsciiWriter";
+  const std::string path =
+      hepgen::test::scratchPath(pooledWriter ? "pooled.hepmc3" : "ascii.hepmc3");
+  std::vector<hepgen::PooledHepMC3Event> events = makeEvents();
+
+  // Write, recording the offsets as the event index does
+  std::vector<std::pair<uint64_t, uint64_t>> offsets;
+  {
+    auto out = hepgen::openHepMC3Output(path, pooledWriter);
+    if (!check(out != nullptr, tag + ": open " + path))
+      return;
+    out->setWeightNames(kWeightNames);
+    out->addRunAttribute("filter", "pTMin = 6.5, |y| < 2.4");
+    out->addRunAttribute("detector", "none");
+    for (const auto &evt : events) {
+      out->write(evt);
+      offsets.emplace_back(out->lastEventOffset(), out->offset());
+    }
+    out->close();
+    check(out->eventsWritten() == long(events.size()), tag + ": event count");
+  }
+
+  // Every recorded range holds exactly its event
+  std::ifstream in(path, std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  for (size_t k = 0; k < events.size(); ++k) {
+    std::string head = "E " + std::to_string(events[k].eventNumber) + " ";
+    const auto &range = offsets[k];
+    check(range.first < range.second && range.second <= text.size() &&
+              text.compare(range.first, head.size(), head) == 0 &&
+              (k + 1 == events.size() || range.second == offsets[k + 1].first),
+          tag + ": byte range of event " + std::to_string(k));
+  }
+
+  HepMC3::ReaderAscii reader(path);
+  size_t nRead = 0;
+  while (!reader.failed()) {
+    HepMC3::GenEvent read;
+    reader.read_event(read);
+    if (reader.failed())
+      break;
+    if (!check(nRead < events.size(), tag + ": extra event"))
+      break;
+    HepMC3::GenEvent expected;
+    hepgen::toGenEvent(events[nRead], expected);
+    compare(events[nRead], expected, read, tag);
+    if (nRead == 0) {
+      auto run = read.run_info();
+      check(run && run->weight_names() == kWeightNames,
+            tag + ": run weight names");
+      check(run && run->attribute_as_string("filter") ==
+                       "pTMin = 6.5, |y| < 2.4",
+            tag + ": run attribute");
+    }
+    ++nRead;
+  }
+  reader.close();
+  check(nRead == events.size(), tag + ": read " + std::to_string(nRead) +
+                                    " of " + std::to_string(events.size()) +
+                                    " events");
+  std::remove(path.c_str());
+}
+
+// Writes that do not reach the disk must be reported by failed()
+void fullDevice(bool pooledWriter) {
+  std::FILE *probe = std::fopen("/dev/full", "wb");
+  if (!probe)
+    return;
+  std::fclose(probe);
+  auto out = hepgen::openHepMC3Output("/dev/full", pooledWriter);
+  const std::string tag =
+      pooledWriter ? "PooledHepMC3Writer" : "HepMC3AsciiWriter";
+  if (!check(out != nullptr, tag + ": open /dev/full"))
+    return;
+  for (const auto &evt : makeEvents())
+    out->write(evt);
+  out->close();
+  check(out->failed(), tag + ": full device fails");
+}
+
+} // namespace
+
+int main() {
+  roundTrip(false);
+  roundTrip(true);
+  fullDevice(false);
+  fullDevice(true);
+  return hepgen::test::summary("test_hepmc3_pool");
+}